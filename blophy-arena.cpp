@@ -0,0 +1,223 @@
+/*
+ * blophy-arena.cpp - Oboe Wrapper for C#
+ * Copyright (C) 2025  MojaveHao
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include "blophy-arena.h"
+#include "blophy-common.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <utility>
+
+namespace {
+
+size_t roundUp(const size_t bytes, const size_t alignment) {
+    return (bytes + alignment - 1) / alignment * alignment;
+}
+
+} // namespace
+
+FixedPool::FixedPool(const size_t chunkBytes, const size_t chunkCount) :
+        m_chunkBytes(roundUp(std::max<size_t>(1, chunkBytes), kAlignment)),
+        m_chunkCount(chunkCount),
+        m_storage(static_cast<uint8_t*>(::operator new(m_chunkBytes * m_chunkCount, std::align_val_t(kAlignment)))) {
+    // 逐页写一遍，把缺页都放在初始化阶段
+    std::memset(m_storage, 0, m_chunkBytes * m_chunkCount);
+    m_freeChunks.reserve(m_chunkCount);
+    for (auto i = m_chunkCount; i > 0; i--) {
+        m_freeChunks.push_back(static_cast<uint32_t>(i - 1));
+    }
+}
+
+FixedPool::~FixedPool() {
+    ::operator delete(m_storage, std::align_val_t(kAlignment));
+}
+
+void* FixedPool::acquire() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_freeChunks.empty()) {
+        return nullptr;
+    }
+    const uint32_t index = m_freeChunks.back();
+    m_freeChunks.pop_back();
+    return m_storage + static_cast<size_t>(index) * m_chunkBytes;
+}
+
+bool FixedPool::release(void* chunk) {
+    if (!owns(chunk)) {
+        return false;
+    }
+    const auto offset = static_cast<size_t>(static_cast<uint8_t*>(chunk) - m_storage);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    // 容量在构造时已预留，这里不会重新分配
+    m_freeChunks.push_back(static_cast<uint32_t>(offset / m_chunkBytes));
+    return true;
+}
+
+size_t FixedPool::available() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_freeChunks.size();
+}
+
+bool FixedPool::owns(const void* chunk) const {
+    const auto* p = static_cast<const uint8_t*>(chunk);
+    return p >= m_storage && p < m_storage + m_chunkBytes * m_chunkCount;
+}
+
+PooledSamples::~PooledSamples() {
+    reset();
+}
+
+PooledSamples::PooledSamples(PooledSamples&& other) noexcept :
+        m_pool(std::exchange(other.m_pool, nullptr)),
+        m_data(std::exchange(other.m_data, nullptr)),
+        m_heap(std::exchange(other.m_heap, false)) {
+}
+
+PooledSamples& PooledSamples::operator=(PooledSamples&& other) noexcept {
+    if (this != &other) {
+        reset();
+        m_pool = std::exchange(other.m_pool, nullptr);
+        m_data = std::exchange(other.m_data, nullptr);
+        m_heap = std::exchange(other.m_heap, false);
+    }
+    return *this;
+}
+
+bool PooledSamples::allocate(FixedPool& pool, const size_t samples) {
+    reset();
+    if (samples * sizeof(float) <= pool.chunkBytes()) {
+        m_data = static_cast<float*>(pool.acquire());
+    }
+    if (m_data) {
+        m_pool = &pool;
+        return true;
+    }
+    // 退回堆分配时同样先写一遍
+    m_data = new (std::nothrow) float[samples]();
+    m_heap = m_data != nullptr;
+    return m_heap;
+}
+
+void PooledSamples::reset() {
+    if (m_heap) {
+        delete[] m_data;
+    } else if (m_pool && m_data) {
+        m_pool->release(m_data);
+    }
+    m_pool = nullptr;
+    m_data = nullptr;
+    m_heap = false;
+}
+
+#if defined(BLOPHY_RT_ALLOC_CHECK)
+
+namespace {
+
+thread_local int32_t t_realtimeDepth = 0;
+
+void checkRealtime(const char* what, const size_t bytes) {
+    if (t_realtimeDepth > 0) {
+        // 先退出实时区域再报错，日志本身可能分配内存
+        t_realtimeDepth = 0;
+        LOGE("Memory %s of %zu bytes inside the audio callback", what, bytes);
+        std::abort();
+    }
+}
+
+void* checkedAlloc(const size_t bytes) {
+    checkRealtime("allocation", bytes);
+    void* p = std::malloc(bytes > 0 ? bytes : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* checkedAlignedAlloc(const size_t bytes, const std::align_val_t alignment) {
+    checkRealtime("allocation", bytes);
+    void* p = nullptr;
+    const size_t align = std::max(sizeof(void*), static_cast<size_t>(alignment));
+    if (posix_memalign(&p, align, bytes > 0 ? bytes : 1) != 0) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void checkedFree(void* p) {
+    if (p) {
+        checkRealtime("release", 0);
+    }
+    std::free(p);
+}
+
+} // namespace
+
+RealtimeScope::RealtimeScope() {
+    t_realtimeDepth++;
+}
+
+RealtimeScope::~RealtimeScope() {
+    t_realtimeDepth--;
+}
+
+bool RealtimeScope::active() {
+    return t_realtimeDepth > 0;
+}
+
+// 替换全局的分配函数，其余重载（nothrow、sized delete）默认会转到这几个
+void* operator new(const size_t bytes) {
+    return checkedAlloc(bytes);
+}
+
+void* operator new[](const size_t bytes) {
+    return checkedAlloc(bytes);
+}
+
+void* operator new(const size_t bytes, const std::align_val_t alignment) {
+    return checkedAlignedAlloc(bytes, alignment);
+}
+
+void* operator new[](const size_t bytes, const std::align_val_t alignment) {
+    return checkedAlignedAlloc(bytes, alignment);
+}
+
+void operator delete(void* p) noexcept {
+    checkedFree(p);
+}
+
+void operator delete[](void* p) noexcept {
+    checkedFree(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept {
+    checkedFree(p);
+}
+
+void operator delete[](void* p, std::align_val_t) noexcept {
+    checkedFree(p);
+}
+
+#else
+
+bool RealtimeScope::active() {
+    return false;
+}
+
+#endif
@@ -0,0 +1,99 @@
+/*
+ * blophy-arena.h - Oboe Wrapper for C#
+ * Copyright (C) 2025  MojaveHao
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// 实时路径用的预分配内存池：构造时一次性分配并逐页写入，之后取还都不经过系统分配器，
+// 音频线程读写池中的内存不会遇到缺页或分配器的锁
+// 取还用互斥锁保护，只在控制线程和解码线程调用，音频线程只使用已经拿到的块
+class FixedPool {
+    public:
+        // 块按缓存行对齐，足以容纳alignas(64)的对象
+        static constexpr size_t kAlignment = 64;
+
+        FixedPool(size_t chunkBytes, size_t chunkCount);
+        ~FixedPool();
+
+        FixedPool(const FixedPool&) = delete;
+        FixedPool& operator=(const FixedPool&) = delete;
+
+        // 池已用完时返回nullptr，调用方自行退回堆分配
+        void* acquire();
+        // 不属于本池的指针返回false，不做任何事
+        bool release(void* chunk);
+
+        size_t chunkBytes() const { return m_chunkBytes; }
+        size_t capacity() const { return m_chunkCount; }
+        size_t available() const;
+
+    private:
+        bool owns(const void* chunk) const;
+
+        const size_t m_chunkBytes;
+        const size_t m_chunkCount;
+        uint8_t* m_storage;
+        mutable std::mutex m_mutex;
+        std::vector<uint32_t> m_freeChunks;
+};
+
+// 从池中借用的float缓冲，池用完或块不够大时退回堆分配；析构时归还
+class PooledSamples {
+    public:
+        PooledSamples() : m_pool(nullptr), m_data(nullptr), m_heap(false) {}
+        ~PooledSamples();
+
+        PooledSamples(PooledSamples&& other) noexcept;
+        PooledSamples& operator=(PooledSamples&& other) noexcept;
+        PooledSamples(const PooledSamples&) = delete;
+        PooledSamples& operator=(const PooledSamples&) = delete;
+
+        bool allocate(FixedPool& pool, size_t samples);
+        void reset();
+
+        float* data() const { return m_data; }
+        bool pooled() const { return m_data && !m_heap; }
+
+    private:
+        FixedPool* m_pool;
+        float* m_data;
+        bool m_heap;
+};
+
+// 标记当前线程正处在实时回调中，可以嵌套
+// 以BLOPHY_RT_ALLOC_CHECK编译时，区域内任何operator new或delete都会打印错误并中止进程，
+// 用来在调试构建中抓出onAudioReady里的内存分配；平时是空操作
+class RealtimeScope {
+    public:
+#if defined(BLOPHY_RT_ALLOC_CHECK)
+        RealtimeScope();
+        ~RealtimeScope();
+#else
+        RealtimeScope() {}
+#endif
+
+        RealtimeScope(const RealtimeScope&) = delete;
+        RealtimeScope& operator=(const RealtimeScope&) = delete;
+
+        static bool active();
+};
@@ -17,498 +17,954 @@
  */
 
 #include "blophy-audio.h"
-#include <fstream>
+#include "blophy-arena.h"
+#include "blophy-bank.h"
+#include "blophy-clip.h"
+#include "blophy-engine.h"
+#include "blophy-handle.h"
+#include "blophy-offline.h"
 #include <iostream>
-#include <chrono>
+#include <cmath>
+#include <ctime>
 #include <android/asset_manager.h>
 #include <android/asset_manager_jni.h>
 
 // 全局变量
-static std::unordered_map<void *, UnityAudioPlayer *> g_audioPlayers;
-static auto g_nextPlayerId = 1;
-static AAssetManager* g_assetManager = nullptr;
+// 导出句柄到播放器的映射，查找无锁，任意线程都可创建和销毁
+static HandleTable<UnityAudioPlayer> g_players;
+static HandleTable<OfflineSession, 6> g_offlineSessions;
+
+static FixedPool& playerPool() {
+    static FixedPool pool(sizeof(UnityAudioPlayer), AudioMixer::kMaxVoices);
+    return pool;
+}
 
 // 设置AssetManager (从Java端调用)
 extern "C" JNIEXPORT void JNICALL
 Java_net_blophy_audio_setAssetManager(JNIEnv *env, jclass clazz, const jobject assetManager) {
-    g_assetManager = AAssetManager_fromJava(env, assetManager);
+    setClipAssetManager(AAssetManager_fromJava(env, assetManager));
 }
 
 UnityAudioPlayer::UnityAudioPlayer() :
-        m_state(AUDIO_STATE_IDLE),
-        m_currentTime(0.0f),
-        m_volume(1.0f),
-        m_loop(false),
-        m_delayTime(0.0f),
-        m_sampleRate(48000),
-        m_channels(2),
-        m_totalFrames(0),
-        m_delayCancelled(false) {
+        m_lastPosition(0.0),
+        m_lastTimelineVersion(0),
+        m_registered(false) {
     // 不再生成测试音频，等待setClip调用
+    m_registered = AudioEngine::instance().mixer().addVoice(&m_voice);
+    // 输出流已预热时，片段设置后即可备好重采样器
+    m_voice.setOutputSampleRate(AudioEngine::instance().getSampleRate());
 }
 
 UnityAudioPlayer::~UnityAudioPlayer() {
-    m_delayCancelled = true;
-    m_delayCondition.notify_all();
-    if (m_delayThread.joinable()) {
-        m_delayThread.join();
-    }
-
-    if (m_audioStream) {
-        m_audioStream->close();
-        m_audioStream.reset();
+    ClipLoader::instance().cancel(this);
+    if (m_registered) {
+        AudioEngine::instance().mixer().removeVoice(&m_voice);
     }
 }
 
-std::vector<uint8_t> loadAssetData(const std::string& filename) {
-    std::vector<uint8_t> buffer;
+bool UnityAudioPlayer::isValid() const {
+    return m_registered;
+}
 
-    if (!g_assetManager) {
-        LOGE("AssetManager is not set!");
-        return buffer;
+void* UnityAudioPlayer::operator new(const size_t size) {
+    FixedPool& pool = playerPool();
+    if (size <= pool.chunkBytes()) {
+        if (void* p = pool.acquire()) {
+            return p;
+        }
     }
+    return ::operator new(size, std::align_val_t(alignof(UnityAudioPlayer)));
+}
 
-    AAsset* asset = AAssetManager_open(g_assetManager, filename.c_str(), AASSET_MODE_UNKNOWN);
-    if (!asset) {
-        LOGE("Failed to open asset: %s", filename.c_str());
-        return buffer;
+void UnityAudioPlayer::operator delete(void* p) {
+    if (!playerPool().release(p)) {
+        ::operator delete(p, std::align_val_t(alignof(UnityAudioPlayer)));
     }
+}
 
-    const off_t size = AAsset_getLength(asset);
-    buffer.resize(size);
+void UnityAudioPlayer::reservePool() {
+    playerPool();
+}
 
-    const int read = AAsset_read(asset, buffer.data(), size);
-    if (read != size) {
-        LOGE("Failed to read asset: %s", filename.c_str());
-        buffer.clear();
+bool UnityAudioPlayer::setClip(const std::string &clipPath) {
+    // 同步设置会覆盖尚未完成的异步加载
+    ClipLoader::instance().cancel(this);
+    m_clipPath = clipPath;
+    // 同一路径只解码一次，其余播放器共享同一份PCM
+    auto clip = ClipCache::instance().acquire(clipPath);
+    if (!clip) {
+        return false;
     }
+    m_voice.setClip(std::move(clip));
+    return true;
+}
 
-    AAsset_close(asset);
-    return buffer;
+int32_t UnityAudioPlayer::setClipAsync(const std::string& clipPath) {
+    m_clipPath = clipPath;
+    return ClipLoader::instance().load(clipPath, this, [this](std::shared_ptr<const AudioClip> clip) {
+        m_voice.setClip(std::move(clip));
+    });
 }
 
-bool UnityAudioPlayer::setClip(const std::string &clipPath) {
+bool UnityAudioPlayer::setStreamingClip(const std::string& clipPath) {
+    ClipLoader::instance().cancel(this);
     m_clipPath = clipPath;
-    return loadAudioData(clipPath);
+    auto stream = openStreamSource(clipPath);
+    if (!stream) {
+        // 不支持流式解码的格式退回整段解码
+        LOGW("Falling back to full decode for: %s", clipPath.c_str());
+        return setClip(clipPath);
+    }
+    m_voice.setStream(std::move(stream));
+    return true;
 }
 
 void UnityAudioPlayer::play() {
-    if (m_state == AUDIO_STATE_PAUSED) {
+    if (m_voice.getState() == AUDIO_STATE_PAUSED) {
         unpause();
         return;
     }
 
-    oboe::AudioStreamBuilder builder;
-    builder.setDirection(oboe::Direction::Output);
-    builder.setPerformanceMode(oboe::PerformanceMode::LowLatency);
-    builder.setSharingMode(oboe::SharingMode::Exclusive);
-    builder.setFormat(oboe::AudioFormat::Float);
-    builder.setChannelCount(m_channels);
-    builder.setSampleRate(m_sampleRate);
-    builder.setCallback(this);
-
-    oboe::Result result = builder.openStream(m_audioStream);
-    if (result != oboe::Result::OK) {
-        // 处理错误
-        std::cerr << "Failed to open audio stream: " << oboe::convertToText(result) << std::endl;
+    if (prepareOutput() == 0) {
         return;
     }
+    m_voice.play();
+}
 
-    result = m_audioStream->requestStart();
-    if (result == oboe::Result::OK) {
-        m_state = AUDIO_STATE_PLAYING;
-    } else {
-        std::cerr << "Failed to start audio stream: " << oboe::convertToText(result) << std::endl;
+bool UnityAudioPlayer::playAtFrame(const int64_t streamFrame) {
+    if (prepareOutput() == 0) {
+        return false;
     }
+    m_voice.playAtFrame(streamFrame);
+    return true;
 }
 
-void UnityAudioPlayer::playWithDelay(const float delay) {
-    m_delayTime = delay;
-    m_delayCancelled = false;
+bool UnityAudioPlayer::playAtTime(const double streamTime) {
+    const int sampleRate = prepareOutput();
+    if (sampleRate == 0) {
+        return false;
+    }
+    m_voice.playAtFrame(std::llround(streamTime * sampleRate));
+    return true;
+}
 
-    if (m_delayThread.joinable()) {
-        m_delayThread.join();
+void UnityAudioPlayer::playWithDelay(const float delay) {
+    if (prepareOutput() == 0) {
+        return;
     }
+    int64_t streamFrame = 0;
+    auto sampleRate = 0;
+    if (!AudioEngine::instance().getStreamFrame(streamFrame, sampleRate)) {
+        m_voice.play();
+        return;
+    }
+    // 延迟按输出流时钟计算，起播由回调对齐到采样，不再依赖线程休眠
+    m_voice.playAtFrame(streamFrame + std::llround(std::max(0.0f, delay) * sampleRate));
+}
 
-    m_delayThread = std::thread(&UnityAudioPlayer::scheduleDelayedPlay, this);
+int UnityAudioPlayer::prepareOutput() {
+    // 共享输出流只在第一次播放时打开，之后一直保持运行
+    if (!AudioEngine::instance().start()) {
+        return 0;
+    }
+    const int sampleRate = AudioEngine::instance().getSampleRate();
+    m_voice.setOutputSampleRate(sampleRate);
+    return sampleRate;
 }
 
 void UnityAudioPlayer::pause() {
-    if (m_audioStream && m_state == AUDIO_STATE_PLAYING) {
-        m_audioStream->pause();
-        m_state = AUDIO_STATE_PAUSED;
-    }
+    m_voice.pause();
 }
 
 void UnityAudioPlayer::stop() {
-    if (m_audioStream) {
-        m_audioStream->stop();
-        m_state = AUDIO_STATE_STOPPED;
-        m_currentTime = 0.0f;
-    }
+    m_voice.stop();
 }
 
 void UnityAudioPlayer::unpause() {
-    if (m_audioStream && m_state == AUDIO_STATE_PAUSED) {
-        m_audioStream->start();
-        m_state = AUDIO_STATE_PLAYING;
-    }
+    m_voice.unpause();
 }
 
 float UnityAudioPlayer::getCurrentTime() const {
-    return m_currentTime;
+    return m_voice.getCurrentTime();
 }
 
 void UnityAudioPlayer::setCurrentTime(const float time) {
-    m_currentTime = std::max(0.0f, std::min(time, getMusicLength()));
+    m_voice.setCurrentTime(time);
+}
+
+int64_t UnityAudioPlayer::getCurrentFrame() const {
+    return m_voice.getCurrentFrame();
+}
+
+void UnityAudioPlayer::getPlaybackPosition(double& songTime, int64_t& clockNanos) {
+    timespec now{};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    clockNanos = static_cast<int64_t>(now.tv_sec) * 1000000000LL + now.tv_nsec;
+
+    const uint32_t version = m_voice.getTimelineVersion();
+    double position = static_cast<double>(m_voice.getCurrentFrame()) / m_voice.getSampleRate();
+
+    AudioVoice::TimelineAnchor anchor{};
+    double presentedFrame = 0.0;
+    auto streamRate = 0;
+    auto monotonic = false;
+    if (!m_voice.isSeekPending() && m_voice.readAnchor(anchor) && anchor.playing &&
+        anchor.timelineVersion == version &&
+        AudioEngine::instance().getPresentedFrame(clockNanos, presentedFrame, streamRate)) {
+        // 锚点之后（或之前）经过的输出帧按播放倍率换算成歌曲前进（或尚未播出）的部分
+        position = static_cast<double>(anchor.voiceFrame) / m_voice.getSampleRate() +
+                   (presentedFrame - static_cast<double>(anchor.streamFrame)) / streamRate * anchor.playbackRate;
+        position = std::max(0.0, std::min(position, static_cast<double>(m_voice.getMusicLength())));
+        monotonic = true;
+    }
+
+    std::lock_guard<std::mutex> lock(m_positionMutex);
+    if (monotonic && version == m_lastTimelineVersion) {
+        position = std::max(position, m_lastPosition);
+    }
+    m_lastTimelineVersion = version;
+    m_lastPosition = position;
+    songTime = position;
 }
 
 void UnityAudioPlayer::offsetTime(const float offset) {
-    setCurrentTime(m_currentTime + offset);
+    m_voice.setCurrentTime(m_voice.getCurrentTime() + offset);
 }
 
 void UnityAudioPlayer::resetTime() {
-    m_currentTime = 0.0f;
+    m_voice.setCurrentFrame(0);
 }
 
 void UnityAudioPlayer::restartTime() {
-    m_currentTime = 0.0f;
-    if (m_state == AUDIO_STATE_PLAYING) {
-        stop();
-        play();
-    }
+    // 共享流无需重开，回到开头继续播放即可
+    m_voice.setCurrentFrame(0);
 }
 
 void UnityAudioPlayer::setVolume(const float volume) {
-    m_volume = std::max(0.0f, std::min(1.0f, volume));
+    m_voice.setVolume(volume);
+}
+
+void UnityAudioPlayer::rampVolume(const float volume, const int32_t durationMs, const GainRampCurve curve) {
+    m_voice.rampVolume(volume, durationMs, curve);
 }
 
 float UnityAudioPlayer::getVolume() const {
-    return m_volume;
+    return m_voice.getVolume();
+}
+
+void UnityAudioPlayer::setPan(const float pan) {
+    m_voice.setPan(pan);
+}
+
+float UnityAudioPlayer::getPan() const {
+    return m_voice.getPan();
+}
+
+void UnityAudioPlayer::setBus(const AudioBus bus) {
+    m_voice.setBus(bus);
+}
+
+AudioBus UnityAudioPlayer::getBus() const {
+    return m_voice.getBus();
+}
+
+void UnityAudioPlayer::fadeIn(const int32_t durationMs) {
+    if (!AudioEngine::instance().start()) {
+        return;
+    }
+    m_voice.setOutputSampleRate(AudioEngine::instance().getSampleRate());
+    m_voice.fadeIn(durationMs);
+}
+
+void UnityAudioPlayer::fadeOut(const int32_t durationMs) {
+    m_voice.fadeOut(durationMs);
 }
 
 void UnityAudioPlayer::setLoop(const bool loop) {
-    m_loop = loop;
+    m_voice.setLoop(loop);
 }
 
 bool UnityAudioPlayer::getLoop() const {
-    return m_loop;
+    return m_voice.getLoop();
 }
 
-bool UnityAudioPlayer::isPlaying() const {
-    return m_state == AUDIO_STATE_PLAYING;
+void UnityAudioPlayer::setLoopRegion(const int64_t startFrame, const int64_t endFrame, const int32_t crossfadeMs) {
+    m_voice.setLoopRegion(startFrame, endFrame, crossfadeMs);
 }
 
-AudioState UnityAudioPlayer::getState() const {
-    return m_state;
+void UnityAudioPlayer::setLoopRegionTime(const double startTime, const double endTime, const int32_t crossfadeMs) {
+    const double rate = m_voice.getSampleRate();
+    m_voice.setLoopRegion(std::llround(startTime * rate), std::llround(endTime * rate), crossfadeMs);
 }
 
-oboe::DataCallbackResult UnityAudioPlayer::onAudioReady(
-    oboe::AudioStream *audioStream,
-    void *audioData,
-    const int32_t numFrames) {
+int64_t UnityAudioPlayer::getLoopStartFrame() const {
+    return m_voice.getLoopStartFrame();
+}
 
-    if (m_state != AUDIO_STATE_PLAYING || m_interleavedData.empty()) {
-        generateSilence(static_cast<float*>(audioData), numFrames, audioStream->getChannelCount());
-        return oboe::DataCallbackResult::Continue;
-    }
+int64_t UnityAudioPlayer::getLoopEndFrame() const {
+    return m_voice.getLoopEndFrame();
+}
 
-    // 计算每帧的时间增量
-    const float frameTime = numFrames / static_cast<float>(audioStream->getSampleRate());
+void UnityAudioPlayer::setResampleQuality(const ResampleQuality quality) {
+    m_voice.setResampleQuality(quality);
+}
 
-    auto output = static_cast<float*>(audioData);
-    const int32_t outputChannels = audioStream->getChannelCount();
+void UnityAudioPlayer::setPlaybackRate(const float rate, const PlaybackRateMode mode) {
+    m_voice.setPlaybackRate(rate, mode);
+}
 
-    // 计算当前帧位置
-    const auto currentFrame = static_cast<int>(m_currentTime * m_sampleRate);
-    const int framesRemaining = m_totalFrames - currentFrame;
-    const int framesToCopy = std::min(numFrames, framesRemaining);
+float UnityAudioPlayer::getPlaybackRate() const {
+    return m_voice.getPlaybackRate();
+}
 
-    if (framesToCopy > 0) {
-        // 复制音频数据
-        for (auto i = 0; i < framesToCopy; i++) {
-            const int srcIndex = (currentFrame + i) * m_channels;
+bool UnityAudioPlayer::isPlaying() const {
+    return m_voice.getState() == AUDIO_STATE_PLAYING;
+}
 
-            for (auto c = 0; c < outputChannels; c++) {
-                // 如果输出通道多于输入通道，循环使用输入通道
-                const int srcChannel = c % m_channels;
-                *output++ = m_interleavedData[srcIndex + srcChannel] * m_volume;
+AudioState UnityAudioPlayer::getState() const {
+    return m_voice.getState();
+}
+
+int32_t UnityAudioPlayer::getStatusSlot() const {
+    return AudioEngine::instance().mixer().slotOf(&m_voice);
+}
+
+void UnityAudioPlayer::queryStatus(PlayerStatus& status) {
+    status.currentFrame = m_voice.getCurrentFrame();
+    getPlaybackPosition(status.songTime, status.clockNanos);
+    status.currentTime = m_voice.getCurrentTime();
+    status.volume = m_voice.getVolume();
+    status.state = m_voice.getState();
+    status.valid = 1;
+}
+
+bool UnityAudioPlayer::applyCommand(const PlayerCommand& command) {
+    switch (command.type) {
+        case PLAYER_COMMAND_PLAY:
+            play();
+            return true;
+        case PLAYER_COMMAND_PAUSE:
+            pause();
+            return true;
+        case PLAYER_COMMAND_UNPAUSE:
+            unpause();
+            return true;
+        case PLAYER_COMMAND_STOP:
+            stop();
+            return true;
+        case PLAYER_COMMAND_SET_VOLUME:
+            if (command.durationMs > 0) {
+                rampVolume(command.value, command.durationMs, command.curve);
+            } else {
+                setVolume(command.value);
             }
-        }
-    }
+            return true;
+        case PLAYER_COMMAND_SET_CURRENT_TIME:
+            setCurrentTime(command.value);
+            return true;
+        case PLAYER_COMMAND_SET_CURRENT_FRAME:
+            m_voice.setCurrentFrame(command.frame);
+            return true;
+        case PLAYER_COMMAND_SET_LOOP:
+            setLoop(command.value != 0.0f);
+            return true;
+        case PLAYER_COMMAND_FADE_IN:
+            fadeIn(command.durationMs);
+            return true;
+        case PLAYER_COMMAND_FADE_OUT:
+            fadeOut(command.durationMs);
+            return true;
+        case PLAYER_COMMAND_PLAY_AT_FRAME:
+            return playAtFrame(command.frame);
+        case PLAYER_COMMAND_SET_PAN:
+            setPan(command.value);
+            return true;
+    }
+    LOGW("Unknown player command: %d", static_cast<int>(command.type));
+    return false;
+}
 
-    // 如果剩余帧需要填充
-    if (framesToCopy < numFrames) {
-        if (m_loop) {
-            // 循环播放：从开头继续复制
-            const int remainingFrames = numFrames - framesToCopy;
-            for (auto i = 0; i < remainingFrames; i++) {
-                const int srcIndex = (i % m_totalFrames) * m_channels;
+// C接口函数实现
+bool WarmUpAudioEngine() {
+    UnityAudioPlayer::reservePool();
+    return AudioEngine::instance().start();
+}
 
-                for (auto c = 0; c < outputChannels; c++) {
-                    const int srcChannel = c % m_channels;
-                    *output++ = m_interleavedData[srcIndex + srcChannel] * m_volume;
-                }
-            }
-            m_currentTime = remainingFrames / static_cast<float>(m_sampleRate);
-        } else {
-            // 非循环：填充静音
-            generateSilence(output, numFrames - framesToCopy, outputChannels);
-            m_currentTime += frameTime;
-
-            // 检查是否播放完毕
-            if (m_currentTime >= getMusicLength()) {
-                m_state = AUDIO_STATE_STOPPED;
-                return oboe::DataCallbackResult::Stop;
-            }
-        }
-    } else {
-        m_currentTime += frameTime;
+void* Create() {
+    auto player = std::make_unique<UnityAudioPlayer>();
+    if (!player->isValid()) {
+        LOGE("Too many players, mixer supports at most %d voices", AudioMixer::kMaxVoices);
+        return nullptr;
+    }
+    void* handle = g_players.insert(player);
+    if (!handle) {
+        LOGE("Too many players, at most %u can be created", HandleTable<UnityAudioPlayer>::kCapacity);
     }
+    return handle;
+}
 
-    return oboe::DataCallbackResult::Continue;
+void Destroy(void* player) {
+    // 过期句柄被识别出来直接忽略，不会误删复用同一槽位的新播放器
+    if (!g_players.erase(player)) {
+        LOGW("Destroy called with an invalid player handle");
+    }
 }
 
-void UnityAudioPlayer::onErrorAfterClose(oboe::AudioStream *audioStream, const oboe::Result error) {
-    // 处理音频流错误
-    m_state = AUDIO_STATE_STOPPED;
-    std::cerr << "Audio stream error: " << oboe::convertToText(error) << std::endl;
+void Play(void* player) {
+    const auto ref = g_players.acquire(player);
+    if (ref) {
+        ref->play();
+    }
 }
 
-std::vector<uint8_t> loadFileData(const std::string& filename) {
-    std::vector<uint8_t> buffer;
-    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+void PlayWithDelay(void* player, const float delay) {
+    const auto ref = g_players.acquire(player);
+    if (ref) {
+        ref->playWithDelay(delay);
+    }
+}
 
-    if (!file.is_open()) {
-        LOGE("Failed to open file: %s", filename.c_str());
-        return buffer;
+bool PlayAtFrame(void* player, const int64_t streamFrame) {
+    const auto ref = g_players.acquire(player);
+    if (ref) {
+        return ref->playAtFrame(streamFrame);
     }
+    return false;
+}
 
-    const std::streamsize size = file.tellg();
-    file.seekg(0, std::ios::beg);
+bool PlayAtTime(void* player, const double streamTime) {
+    const auto ref = g_players.acquire(player);
+    if (ref) {
+        return ref->playAtTime(streamTime);
+    }
+    return false;
+}
 
-    buffer.resize(size);
-    if (!file.read(reinterpret_cast<char*>(buffer.data()), size)) {
-        LOGE("Failed to read file: %s", filename.c_str());
-        buffer.clear();
+int64_t GetStreamFrame() {
+    int64_t streamFrame = 0;
+    auto sampleRate = 0;
+    if (!AudioEngine::instance().getStreamFrame(streamFrame, sampleRate)) {
+        return -1;
     }
+    return streamFrame;
+}
 
-    return buffer;
+double GetStreamTime() {
+    int64_t streamFrame = 0;
+    auto sampleRate = 0;
+    if (!AudioEngine::instance().getStreamFrame(streamFrame, sampleRate) || sampleRate <= 0) {
+        return -1.0;
+    }
+    return static_cast<double>(streamFrame) / sampleRate;
 }
 
-bool UnityAudioPlayer::loadAudioData(const std::string& filePath) {
-    try {
-        // 确定文件路径是assets中的还是文件系统中的
-        const bool isAsset = (filePath.find("assets/") == 0);
-        std::vector<uint8_t> fileData;
+void SetBufferPolicy(const BufferPolicy policy) {
+    AudioEngine::instance().setBufferPolicy(policy);
+}
 
-        if (isAsset) {
-            // 从assets加载
-            const std::string assetPath = filePath.substr(7); // 去掉"assets/"前缀
-            fileData = loadAssetData(assetPath);
-        } else {
-            // 从文件系统加载
-            fileData = loadFileData(filePath);
-        }
+int32_t GetBufferSizeFrames() {
+    return AudioEngine::instance().getBufferSizeInFrames();
+}
 
-        if (fileData.empty()) {
-            LOGE("Failed to load audio file: %s", filePath.c_str());
-            return false;
-        }
+int32_t GetFramesPerBurst() {
+    return AudioEngine::instance().getFramesPerBurst();
+}
 
-        m_audioData = std::make_unique<nqr::AudioData>();
-        nqr::NyquistIO loader;
+int32_t GetXRunCount() {
+    return AudioEngine::instance().getXRunCount();
+}
 
-        // 从内存加载并解码音频
-        loader.Load(m_audioData.get(), filePath, fileData);
+bool GetAudioStats(AudioStats* stats) {
+    if (!stats) {
+        return false;
+    }
+    AudioEngine::instance().mixer().stats().snapshot(*stats);
+    return true;
+}
 
-        // 获取音频信息
-        m_sampleRate = m_audioData->sampleRate;
-        m_channels = m_audioData->channelCount;
-        m_totalFrames = m_audioData->samples.size() / m_channels;
+void ResetAudioStats() {
+    AudioEngine::instance().mixer().stats().requestReset();
+}
 
-        // 将音频数据转换为交错格式（如果需要）
-        m_interleavedData = std::move(m_audioData->samples);
+int32_t GetStreamRestartCount() {
+    return AudioEngine::instance().getRestartCount();
+}
 
-        LOGI("Loaded audio: %s, SR: %d, Channels: %d, Frames: %d",
-             filePath.c_str(), m_sampleRate, m_channels, m_totalFrames);
+double GetLastGlitchMillis() {
+    return AudioEngine::instance().getLastGlitchMillis();
+}
 
-        return true;
-    } catch (const std::exception& e) {
-        LOGE("Failed to load audio data: %s", e.what());
-        return false;
+void Pause(void* player) {
+    const auto ref = g_players.acquire(player);
+    if (ref) {
+        ref->pause();
     }
 }
 
-float UnityAudioPlayer::getMusicLength() const {
-    return m_totalFrames / static_cast<float>(m_sampleRate);
+void Stop(void* player) {
+    const auto ref = g_players.acquire(player);
+    if (ref) {
+        ref->stop();
+    }
 }
 
-void UnityAudioPlayer::scheduleDelayedPlay() {
-    std::unique_lock<std::mutex> lock(m_delayMutex);
-    if (m_delayCondition.wait_for(lock,
-                                  std::chrono::milliseconds(static_cast<int>(m_delayTime * 1000)),
-                                  [this] { return m_delayCancelled.load(); })) {
-        // 延迟被取消
-        return;
+void UnPause(void* player) {
+    const auto ref = g_players.acquire(player);
+    if (ref) {
+        ref->unpause();
     }
+}
 
-    if (!m_delayCancelled) {
-        play();
+float GetCurrentTime(void* player) {
+    const auto ref = g_players.acquire(player);
+    if (ref) {
+        return ref->getCurrentTime();
     }
+    return 0.0f;
 }
 
-void UnityAudioPlayer::generateSilence(float* buffer, const int32_t numFrames, const int32_t channels) {
-    for (auto i = 0; i < numFrames * channels; i++) {
-        buffer[i] = 0.0f;
+int64_t GetCurrentFrame(void* player) {
+    const auto ref = g_players.acquire(player);
+    if (ref) {
+        return ref->getCurrentFrame();
     }
+    return 0;
 }
 
-void UnityAudioPlayer::generateSineWave(float* buffer, const int32_t numFrames, const int32_t channels, const float frequency) {
-    for (auto i = 0; i < numFrames; i++) {
-        const float sample = 0.5f * sin(2.0f * M_PI * frequency * (m_currentTime + i / static_cast<float>(m_sampleRate)));
-        for (auto c = 0; c < channels; c++) {
-            buffer[i * channels + c] = sample * m_volume;
-        }
+bool GetPlaybackPosition(void* player, double* songTime, int64_t* clockNanos) {
+    const auto ref = g_players.acquire(player);
+    if (ref && songTime && clockNanos) {
+        ref->getPlaybackPosition(*songTime, *clockNanos);
+        return true;
     }
+    return false;
 }
 
-// C接口函数实现
-void* Create() {
-    auto* player = new UnityAudioPlayer();
-    const auto handle = reinterpret_cast<void*>(g_nextPlayerId++);
-    g_audioPlayers[handle] = player;
-    return handle;
+void SetCurrentTime(void* player, const float time) {
+    const auto ref = g_players.acquire(player);
+    if (ref) {
+        ref->setCurrentTime(time);
+    }
 }
 
-void Destroy(void* player) {
-    const auto it = g_audioPlayers.find(player);
-    if (it != g_audioPlayers.end()) {
-        delete it->second;
-        g_audioPlayers.erase(it);
+void OffsetTime(void* player, const float offset) {
+    const auto ref = g_players.acquire(player);
+    if (ref) {
+        ref->offsetTime(offset);
     }
 }
 
-void Play(void* player) {
-    const auto it = g_audioPlayers.find(player);
-    if (it != g_audioPlayers.end()) {
-        it->second->play();
+void ResetTime(void* player) {
+    const auto ref = g_players.acquire(player);
+    if (ref) {
+        ref->resetTime();
     }
 }
 
-void PlayWithDelay(void* player, const float delay) {
-    const auto it = g_audioPlayers.find(player);
-    if (it != g_audioPlayers.end()) {
-        it->second->playWithDelay(delay);
+void RestartTime(void* player) {
+    const auto ref = g_players.acquire(player);
+    if (ref) {
+        ref->restartTime();
     }
 }
 
-void Pause(void* player) {
-    const auto it = g_audioPlayers.find(player);
-    if (it != g_audioPlayers.end()) {
-        it->second->pause();
+void SetClip(void* player, const char* clipPath) {
+    const auto ref = g_players.acquire(player);
+    if (ref) {
+        ref->setClip(clipPath);
     }
 }
 
-void Stop(void* player) {
-    const auto it = g_audioPlayers.find(player);
-    if (it != g_audioPlayers.end()) {
-        it->second->stop();
+int32_t SetClipAsync(void* player, const char* clipPath) {
+    const auto ref = g_players.acquire(player);
+    if (ref && clipPath) {
+        return ref->setClipAsync(clipPath);
     }
+    return 0;
 }
 
-void UnPause(void* player) {
-    const auto it = g_audioPlayers.find(player);
-    if (it != g_audioPlayers.end()) {
-        it->second->unpause();
+bool SetStreamingClip(void* player, const char* clipPath) {
+    const auto ref = g_players.acquire(player);
+    if (ref && clipPath) {
+        return ref->setStreamingClip(clipPath);
     }
+    return false;
 }
 
-float GetCurrentTime(void* player) {
-    const auto it = g_audioPlayers.find(player);
-    if (it != g_audioPlayers.end()) {
-        return it->second->getCurrentTime();
+void SetVolume(void* player, const float volume) {
+    const auto ref = g_players.acquire(player);
+    if (ref) {
+        ref->setVolume(volume);
+    }
+}
+
+float GetVolume(void* player) {
+    const auto ref = g_players.acquire(player);
+    if (ref) {
+        return ref->getVolume();
     }
     return 0.0f;
 }
 
-void SetCurrentTime(void* player, const float time) {
-    const auto it = g_audioPlayers.find(player);
-    if (it != g_audioPlayers.end()) {
-        it->second->setCurrentTime(time);
+void SetVolumeRamp(void* player, const float volume, const int32_t durationMs, const GainRampCurve curve) {
+    const auto ref = g_players.acquire(player);
+    if (ref) {
+        ref->rampVolume(volume, durationMs, curve);
     }
 }
 
-void OffsetTime(void* player, const float offset) {
-    const auto it = g_audioPlayers.find(player);
-    if (it != g_audioPlayers.end()) {
-        it->second->offsetTime(offset);
+void SetPan(void* player, const float pan) {
+    const auto ref = g_players.acquire(player);
+    if (ref) {
+        ref->setPan(pan);
     }
 }
 
-void ResetTime(void* player) {
-    const auto it = g_audioPlayers.find(player);
-    if (it != g_audioPlayers.end()) {
-        it->second->resetTime();
+float GetPan(void* player) {
+    const auto ref = g_players.acquire(player);
+    if (ref) {
+        return ref->getPan();
     }
+    return 0.0f;
 }
 
-void RestartTime(void* player) {
-    const auto it = g_audioPlayers.find(player);
-    if (it != g_audioPlayers.end()) {
-        it->second->restartTime();
+void SetPlayerBus(void* player, const AudioBus bus) {
+    const auto ref = g_players.acquire(player);
+    if (ref) {
+        ref->setBus(bus);
     }
 }
 
-void SetClip(void* player, const char* clipPath) {
-    const auto it = g_audioPlayers.find(player);
-    if (it != g_audioPlayers.end()) {
-        it->second->setClip(clipPath);
+AudioBus GetPlayerBus(void* player) {
+    const auto ref = g_players.acquire(player);
+    if (ref) {
+        return ref->getBus();
     }
+    return AUDIO_BUS_MUSIC;
 }
 
-void SetVolume(void* player, const float volume) {
-    const auto it = g_audioPlayers.find(player);
-    if (it != g_audioPlayers.end()) {
-        it->second->setVolume(volume);
+void FadeIn(void* player, const int32_t durationMs) {
+    const auto ref = g_players.acquire(player);
+    if (ref) {
+        ref->fadeIn(durationMs);
     }
 }
 
-float GetVolume(void* player) {
-    const auto it = g_audioPlayers.find(player);
-    if (it != g_audioPlayers.end()) {
-        return it->second->getVolume();
+void FadeOut(void* player, const int32_t durationMs) {
+    const auto ref = g_players.acquire(player);
+    if (ref) {
+        ref->fadeOut(durationMs);
     }
-    return 0.0f;
 }
 
 void SetLoop(void* player, const bool loop) {
-    const auto it = g_audioPlayers.find(player);
-    if (it != g_audioPlayers.end()) {
-        it->second->setLoop(loop);
+    const auto ref = g_players.acquire(player);
+    if (ref) {
+        ref->setLoop(loop);
     }
 }
 
 bool GetLoop(void* player) {
-    const auto it = g_audioPlayers.find(player);
-    if (it != g_audioPlayers.end()) {
-        return it->second->getLoop();
+    const auto ref = g_players.acquire(player);
+    if (ref) {
+        return ref->getLoop();
     }
     return false;
 }
 
+void SetLoopRegion(void* player, const int64_t startFrame, const int64_t endFrame, const int32_t crossfadeMs) {
+    const auto ref = g_players.acquire(player);
+    if (ref) {
+        ref->setLoopRegion(startFrame, endFrame, crossfadeMs);
+    }
+}
+
+void SetLoopRegionTime(void* player, const double startTime, const double endTime, const int32_t crossfadeMs) {
+    const auto ref = g_players.acquire(player);
+    if (ref) {
+        ref->setLoopRegionTime(startTime, endTime, crossfadeMs);
+    }
+}
+
+int64_t GetLoopStartFrame(void* player) {
+    const auto ref = g_players.acquire(player);
+    if (ref) {
+        return ref->getLoopStartFrame();
+    }
+    return 0;
+}
+
+int64_t GetLoopEndFrame(void* player) {
+    const auto ref = g_players.acquire(player);
+    if (ref) {
+        return ref->getLoopEndFrame();
+    }
+    return 0;
+}
+
+void SetResampleQuality(void* player, const ResampleQuality quality) {
+    const auto ref = g_players.acquire(player);
+    if (ref) {
+        ref->setResampleQuality(quality);
+    }
+}
+
+void SetPlaybackRate(void* player, const float rate, const PlaybackRateMode mode) {
+    const auto ref = g_players.acquire(player);
+    if (ref) {
+        ref->setPlaybackRate(rate, mode);
+    }
+}
+
+float GetPlaybackRate(void* player) {
+    const auto ref = g_players.acquire(player);
+    if (ref) {
+        return ref->getPlaybackRate();
+    }
+    return 1.0f;
+}
+
 bool IsPlaying(void* player) {
-    const auto it = g_audioPlayers.find(player);
-    if (it != g_audioPlayers.end()) {
-        return it->second->isPlaying();
+    const auto ref = g_players.acquire(player);
+    if (ref) {
+        return ref->isPlaying();
     }
     return false;
 }
 
 AudioState GetState(void* player) {
-    const auto it = g_audioPlayers.find(player);
-    if (it != g_audioPlayers.end()) {
-        return it->second->getState();
+    const auto ref = g_players.acquire(player);
+    if (ref) {
+        return ref->getState();
     }
     return AUDIO_STATE_IDLE;
 }
+
+int32_t QueryPlayers(void* const* players, PlayerStatus* statuses, const int32_t count) {
+    if (!players || !statuses) {
+        return 0;
+    }
+    auto valid = 0;
+    for (auto i = 0; i < count; i++) {
+        statuses[i] = PlayerStatus{};
+        if (const auto ref = g_players.acquire(players[i])) {
+            ref->queryStatus(statuses[i]);
+            valid++;
+        }
+    }
+    return valid;
+}
+
+int32_t SubmitPlayerCommands(const PlayerCommand* commands, const int32_t count) {
+    if (!commands) {
+        return 0;
+    }
+    auto applied = 0;
+    for (auto i = 0; i < count; i++) {
+        const auto ref = g_players.acquire(commands[i].player);
+        if (ref && ref->applyCommand(commands[i])) {
+            applied++;
+        }
+    }
+    return applied;
+}
+
+const StatusBlock* GetStatusBlock() {
+    return AudioEngine::instance().mixer().statusBlock();
+}
+
+int32_t GetStatusSlot(void* player) {
+    const auto ref = g_players.acquire(player);
+    if (ref) {
+        return ref->getStatusSlot();
+    }
+    return -1;
+}
+
+void* CreateOfflineSession(const int32_t sampleRate, const int32_t channels) {
+    auto session = std::make_unique<OfflineSession>(sampleRate, channels);
+    if (!session->isValid()) {
+        LOGE("Invalid offline session format: %d Hz, %d channels", sampleRate, channels);
+        return nullptr;
+    }
+    void* handle = g_offlineSessions.insert(session);
+    if (!handle) {
+        LOGE("Too many offline sessions, at most %u can be open",
+             HandleTable<OfflineSession, 6>::kCapacity);
+    }
+    return handle;
+}
+
+void DestroyOfflineSession(void* session) {
+    g_offlineSessions.erase(session);
+}
+
+int32_t OfflineAddClip(void* session, const char* clipPath, const int64_t startFrame, const double clipOffset,
+                       const float volume) {
+    const auto ref = g_offlineSessions.acquire(session);
+    if (!ref || !clipPath) {
+        return -1;
+    }
+    return ref->addClip(clipPath, startFrame, clipOffset, volume);
+}
+
+int32_t OfflineRender(void* session, float* output, const int32_t numFrames) {
+    const auto ref = g_offlineSessions.acquire(session);
+    if (!ref) {
+        return 0;
+    }
+    return ref->render(output, numFrames);
+}
+
+int32_t ComputePeaks(const float* samples, const int64_t frames, const int32_t channels, const int32_t framesPerPeak,
+                     float* mins, float* maxs, float* rms, const int32_t maxPeaks) {
+    return computePeaks(samples, frames, channels, framesPerPeak, mins, maxs, rms, maxPeaks);
+}
+
+int32_t GetClipPeaks(const char* clipPath, const int32_t framesPerPeak, float* mins, float* maxs, float* rms,
+                     const int32_t maxPeaks) {
+    if (!clipPath) {
+        return 0;
+    }
+    // 直接统计缓存中的PCM，已预加载的片段不会再解码
+    const auto clip = ClipCache::instance().acquire(clipPath);
+    if (!clip) {
+        return 0;
+    }
+    return computeClipPeaks(*clip, framesPerPeak, mins, maxs, rms, maxPeaks);
+}
+
+bool PreloadClip(const char* clipPath) {
+    return clipPath && ClipCache::instance().preload(clipPath);
+}
+
+void EvictClip(const char* clipPath) {
+    if (clipPath) {
+        ClipCache::instance().evict(clipPath);
+    }
+}
+
+void EvictAllClips() {
+    ClipCache::instance().evictAll();
+}
+
+void SetClipFormat(const char* clipPath, const ClipFormat format) {
+    if (clipPath) {
+        ClipCache::instance().setFormat(clipPath, format);
+    }
+}
+
+void SetDefaultClipFormat(const ClipFormat format) {
+    ClipCache::instance().setDefaultFormat(format);
+}
+
+int32_t LoadClipBank(const char* bankPath, const bool prefault) {
+    return bankPath ? loadClipBank(bankPath, prefault) : -1;
+}
+
+void UnloadClipBank(const char* bankPath) {
+    if (bankPath) {
+        unloadClipBank(bankPath);
+    }
+}
+
+int32_t RegisterOneShotClip(const char* clipPath) {
+    if (!clipPath || !AudioEngine::instance().start()) {
+        return 0;
+    }
+    auto clip = ClipCache::instance().acquire(clipPath);
+    if (!clip) {
+        return 0;
+    }
+    // 音效池不带实时重采样，注册时一次性转换到输出采样率
+    const int outputRate = AudioEngine::instance().getSampleRate();
+    if (outputRate > 0 && clip->sampleRate != outputRate) {
+        clip = resampleClip(*clip, outputRate, RESAMPLE_QUALITY_HIGH);
+        if (!clip) {
+            return 0;
+        }
+    }
+    return AudioEngine::instance().mixer().oneShots().registerClip(std::move(clip));
+}
+
+void UnregisterOneShotClip(const int32_t clipId) {
+    AudioEngine::instance().mixer().oneShots().unregisterClip(clipId);
+}
+
+bool PlayOneShot(const int32_t clipId, const float gain, const float pan) {
+    return AudioEngine::instance().mixer().oneShots().trigger(clipId, gain, pan);
+}
+
+bool PlayOneShotAtFrame(const int32_t clipId, const float gain, const float pan, const int64_t streamFrame) {
+    return AudioEngine::instance().mixer().oneShots().trigger(clipId, gain, pan, streamFrame);
+}
+
+bool PlayOneShotAtTime(const int32_t clipId, const float gain, const float pan, const double streamTime) {
+    const int sampleRate = AudioEngine::instance().getSampleRate();
+    if (sampleRate <= 0) {
+        return false;
+    }
+    return AudioEngine::instance().mixer().oneShots().trigger(clipId, gain, pan,
+                                                              std::llround(streamTime * sampleRate));
+}
+
+void StopAllOneShots() {
+    AudioEngine::instance().mixer().oneShots().stopAll();
+}
+
+void SetOneShotPolyphony(const int32_t maxVoices) {
+    AudioEngine::instance().mixer().oneShots().setPolyphony(maxVoices);
+}
+
+void SetOneShotStealPolicy(const StealPolicy policy) {
+    AudioEngine::instance().mixer().oneShots().setStealPolicy(policy);
+}
+
+bool PlayOneShotOnBus(const int32_t clipId, const float gain, const float pan, const int64_t streamFrame,
+                      const AudioBus bus) {
+    return AudioEngine::instance().mixer().oneShots().trigger(clipId, gain, pan, streamFrame, bus);
+}
+
+void SetBusGain(const AudioBus bus, const float gain) {
+    AudioEngine::instance().mixer().buses().setGain(bus, gain);
+}
+
+float GetBusGain(const AudioBus bus) {
+    return AudioEngine::instance().mixer().buses().getGain(bus);
+}
+
+void SetLimiter(const bool enabled, const float thresholdDb, const int32_t releaseMs) {
+    AudioEngine::instance().mixer().buses().setLimiter(enabled, thresholdDb, releaseMs);
+}
+
+void SetMusicDucking(const bool enabled, const float thresholdDb, const float depthDb, const int32_t attackMs,
+                     const int32_t releaseMs) {
+    AudioEngine::instance().mixer().buses().setDucking(enabled, thresholdDb, depthDb, attackMs, releaseMs);
+}
+
+float GetLimiterGain() {
+    return AudioEngine::instance().mixer().buses().getLimiterGain();
+}
+
+float GetDuckingGain() {
+    return AudioEngine::instance().mixer().buses().getDuckingGain();
+}
+
+int32_t PreloadClipAsync(const char* clipPath) {
+    if (!clipPath) {
+        return 0;
+    }
+    const std::string path = clipPath;
+    return ClipLoader::instance().load(path, nullptr, [path](std::shared_ptr<const AudioClip>) {
+        // 解码结果已进入缓存，这里只需将其标记为常驻
+        ClipCache::instance().preload(path);
+    });
+}
+
+LoadStatus GetLoadStatus(const int32_t ticket) {
+    return ClipLoader::instance().getStatus(ticket);
+}
+
+void SetLoadCallback(const LoadCallback callback) {
+    ClipLoader::instance().setCallback(callback);
+}
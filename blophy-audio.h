@@ -19,49 +19,38 @@
 #pragma once
 
 #include <string>
-#include <unordered_map>
 #include <vector>
-#include <thread>
-#include <atomic>
-#include <mutex>
-#include <condition_variable>
-#include "oboe/Oboe.h"
 #include <memory>
-#include "libnyquist/include/libnyquist/Common.h"
-#include "libnyquist/include/libnyquist/Decoders.h"
-
-#ifdef __ANDROID__
-#include <android/log.h>
-#define LOG_TAG "UnityAudioPlayer"
-#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
-#define LOGW(...) __android_log_print(ANDROID_LOG_WARN, LOG_TAG, __VA_ARGS__)
-#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
-#else
-#define LOGI(...) printf(__VA_ARGS__); printf("\n")
-#define LOGW(...) printf(__VA_ARGS__); printf("\n")
-#define LOGE(...) printf(__VA_ARGS__); printf("\n")
-#endif
-
-#ifdef _WIN32
-#define EXPORT __declspec(dllexport)
-#else
-#define EXPORT __attribute__((visibility("default")))
-#endif
-
-extern "C" typedef enum {
-    AUDIO_STATE_IDLE,
-    AUDIO_STATE_PLAYING,
-    AUDIO_STATE_PAUSED,
-    AUDIO_STATE_STOPPED
-} AudioState;
-
-class UnityAudioPlayer final : public oboe::AudioStreamCallback {
+#include <mutex>
+#include "blophy-common.h"
+#include "blophy-loader.h"
+#include "blophy-mixer.h"
+
+class UnityAudioPlayer final {
     public:
         UnityAudioPlayer();
-        ~UnityAudioPlayer() override;
+        ~UnityAudioPlayer();
+
+        // 声部没能登记到混音器时返回false，调用方应直接销毁
+        bool isValid() const;
+
+        // 播放器连同其中的声部状态和命令队列从预分配池中分配，池按混音器的声部数预留，用完后退回堆分配
+        static void* operator new(size_t size);
+        static void operator delete(void* p);
+        // 预分配并预先写入播放器池，引擎初始化时调用
+        static void reservePool();
 
         bool setClip(const std::string& clipPath);
+        // 在后台解码，完成后原子地换入；返回加载票据
+        int32_t setClipAsync(const std::string& clipPath);
+        // 边播边解，适合整首歌曲等长音轨，常驻内存只有几个解码块
+        bool setStreamingClip(const std::string& clipPath);
         void play();
+        // 在输出流的第streamFrame帧精确起播，时钟见GetStreamFrame
+        bool playAtFrame(int64_t streamFrame);
+        // streamTime为输出流时钟上的秒数，即帧位置除以输出采样率
+        bool playAtTime(double streamTime);
+        // 比立即Play晚delay秒开始播放，按输出流时钟计算
         void playWithDelay(float delay);
         void pause();
         void stop();
@@ -69,76 +58,198 @@ class UnityAudioPlayer final : public oboe::AudioStreamCallback {
 
         float getCurrentTime() const;
         void setCurrentTime(float time);
+        int64_t getCurrentFrame() const;
+        // 经过输出延迟补偿的歌曲位置（秒），clockNanos为对应的CLOCK_MONOTONIC时刻
+        void getPlaybackPosition(double& songTime, int64_t& clockNanos);
         void offsetTime(float offset);
         void resetTime();
         void restartTime();
 
         void setVolume(float volume);
+        void rampVolume(float volume, int32_t durationMs, GainRampCurve curve);
         float getVolume() const;
+        void setPan(float pan);
+        float getPan() const;
+        void setBus(AudioBus bus);
+        AudioBus getBus() const;
+
+        void fadeIn(int32_t durationMs);
+        void fadeOut(int32_t durationMs);
 
         void setLoop(bool loop);
         bool getLoop() const;
+        // 片段帧计的循环区间，用于练习模式的段落循环和带前奏的菜单音乐
+        void setLoopRegion(int64_t startFrame, int64_t endFrame, int32_t crossfadeMs);
+        void setLoopRegionTime(double startTime, double endTime, int32_t crossfadeMs);
+        int64_t getLoopStartFrame() const;
+        int64_t getLoopEndFrame() const;
+
+        void setResampleQuality(ResampleQuality quality);
+        // 练习模式的变速，播放位置仍按歌曲时间计
+        void setPlaybackRate(float rate, PlaybackRateMode mode);
+        float getPlaybackRate() const;
 
         bool isPlaying() const;
         AudioState getState() const;
 
-        // Oboe回调接口
-        oboe::DataCallbackResult onAudioReady(
-            oboe::AudioStream* audioStream,
-            void* audioData,
-            int32_t numFrames
-        ) override;
+        // 本播放器在共享状态块中的条目序号
+        int32_t getStatusSlot() const;
 
-        void onErrorAfterClose(oboe::AudioStream* audioStream, oboe::Result error) override;
+        // 批量接口一次取回所有常用状态
+        void queryStatus(PlayerStatus& status);
+        bool applyCommand(const PlayerCommand& command);
 
     private:
-        bool loadAudioData(const std::string& filePath);
-        float getMusicLength() const;
-        void scheduleDelayedPlay();
-        void generateSilence(float* buffer, int32_t numFrames, int32_t channels);
-        void generateSineWave(float* buffer, int32_t numFrames, int32_t channels, float frequency = 440.0f);
-
-        AudioState m_state;
-        float m_currentTime;
-        float m_volume;
-        bool m_loop;
+        // 确保共享流已运行并把声部切到输出采样率，返回输出采样率，失败返回0
+        int prepareOutput();
+
         std::string m_clipPath;
-        float m_delayTime;
-        std::shared_ptr<oboe::AudioStream> m_audioStream;
-
-        // 音频数据相关
-        std::unique_ptr<nqr::AudioData> m_audioData;
-        std::vector<float> m_interleavedData;
-        int m_sampleRate;
-        int m_channels;
-        int m_totalFrames;
-
-        // 延迟播放相关
-        std::thread m_delayThread;
-        std::atomic<bool> m_delayCancelled;
-        std::mutex m_delayMutex;
-        std::condition_variable m_delayCondition;
+
+        // 保证getPlaybackPosition在同一时间线内单调不减；C#可能从多个线程查询，由m_positionMutex保护
+        std::mutex m_positionMutex;
+        double m_lastPosition;
+        uint32_t m_lastTimelineVersion;
+
+        // 混音器中的声部，播放状态和音频数据都在这里
+        AudioVoice m_voice;
+        // 声部已登记到混音器；混音器满时为false，这样的播放器不会出声
+        bool m_registered;
 };
 
 // C接口函数声明
 extern "C" {
+    // 提前打开共享输出流，避免第一次Play时等待开流；之后流一直保持运行
+    EXPORT bool WarmUpAudioEngine();
+    // 同时存在的播放器受混音器声部数限制，超出时返回nullptr
     EXPORT void* Create();
     EXPORT void Destroy(void* player);
     EXPORT void Play(void* player);
     EXPORT void PlayWithDelay(void* player, float delay);
+    // 预约起播：streamFrame为GetStreamFrame给出的写入侧时钟，在回调中按采样对齐，不占用额外线程；已过去的位置会立即开始
+    EXPORT bool PlayAtFrame(void* player, int64_t streamFrame);
+    EXPORT bool PlayAtTime(void* player, double streamTime);
+    // 输出流时钟：下一次回调将要写入的帧位置和对应秒数，PlayAt*和PlayOneShotAt*都以它为准，流未运行时返回-1
+    // 预约在这一帧及之后的事件都能按采样对齐起播，实际被听到还要再晚一个输出延迟，与立即播放相同
+    EXPORT int64_t GetStreamFrame();
+    EXPORT double GetStreamTime();
+    // 输出缓冲策略及当前缓冲大小、欠载次数，流未运行时后三者返回-1
+    EXPORT void SetBufferPolicy(BufferPolicy policy);
+    EXPORT int32_t GetBufferSizeFrames();
+    EXPORT int32_t GetFramesPerBurst();
+    EXPORT int32_t GetXRunCount();
+    // 回调耗时直方图和欠载、迟到计数，统计本身不加锁也不分配内存
+    EXPORT bool GetAudioStats(AudioStats* stats);
+    // 清零在下一次回调中生效
+    EXPORT void ResetAudioStats();
+    // 耳机插拔、蓝牙切换等导致断流后引擎会自动重开并保留播放状态
+    // 新设备采样率不同时输出流时钟和预约位置按比例换算，一次性音效在后台重新转换到新采样率
+    // 返回累计重开次数和最近一次断流到恢复出声的毫秒数
+    EXPORT int32_t GetStreamRestartCount();
+    EXPORT double GetLastGlitchMillis();
     EXPORT void Pause(void* player);
     EXPORT void Stop(void* player);
     EXPORT void UnPause(void* player);
     EXPORT float GetCurrentTime(void* player);
+    EXPORT int64_t GetCurrentFrame(void* player);
+    EXPORT bool GetPlaybackPosition(void* player, double* songTime, int64_t* clockNanos);
     EXPORT void SetCurrentTime(void* player, float time);
     EXPORT void OffsetTime(void* player, float offset);
     EXPORT void ResetTime(void* player);
     EXPORT void RestartTime(void* player);
     EXPORT void SetClip(void* player, const char* clipPath);
+    EXPORT int32_t SetClipAsync(void* player, const char* clipPath);
+    EXPORT bool SetStreamingClip(void* player, const char* clipPath);
     EXPORT void SetVolume(void* player, float volume);
     EXPORT float GetVolume(void* player);
+    // 渐变在音频回调中逐帧计算，调用一次即可，无需每帧轮询
+    EXPORT void SetVolumeRamp(void* player, float volume, int32_t durationMs, GainRampCurve curve);
+    // pan取-1（左）到1（右），0为居中；5.1、7.1等多声道片段会先按ITU系数折叠成立体声
+    EXPORT void SetPan(void* player, float pan);
+    EXPORT float GetPan(void* player);
+    // 播放器默认在AUDIO_BUS_MUSIC，音效类播放器可以改到SFX或UI总线
+    EXPORT void SetPlayerBus(void* player, AudioBus bus);
+    EXPORT AudioBus GetPlayerBus(void* player);
+    EXPORT void FadeIn(void* player, int32_t durationMs);
+    EXPORT void FadeOut(void* player, int32_t durationMs);
     EXPORT void SetLoop(void* player, bool loop);
     EXPORT bool GetLoop(void* player);
+    // 循环区间[startFrame, endFrame)，endFrame不大于0表示到结尾；开启SetLoop后才生效
+    // 回绕在回调中按采样对齐，crossfadeMs大于0时首尾交叉淡化（流式音轨忽略）
+    EXPORT void SetLoopRegion(void* player, int64_t startFrame, int64_t endFrame, int32_t crossfadeMs);
+    // 以秒为单位，按片段采样率换算成帧
+    EXPORT void SetLoopRegionTime(void* player, double startTime, double endTime, int32_t crossfadeMs);
+    EXPORT int64_t GetLoopStartFrame(void* player);
+    EXPORT int64_t GetLoopEndFrame(void* player);
+    EXPORT void SetResampleQuality(void* player, ResampleQuality quality);
+    // 播放倍率限制在0.5到2之间；GetCurrentTime、GetPlaybackPosition和状态块报告的都是歌曲时间
+    EXPORT void SetPlaybackRate(void* player, float rate, PlaybackRateMode mode);
+    EXPORT float GetPlaybackRate(void* player);
     EXPORT bool IsPlaying(void* player);
     EXPORT AudioState GetState(void* player);
+
+    // 批量接口：一次调用处理任意多个播放器，每帧的互操作开销与播放器数量无关
+    // 返回有效句柄的个数，无效句柄对应的status.valid为0
+    EXPORT int32_t QueryPlayers(void* const* players, PlayerStatus* statuses, int32_t count);
+    // 按数组顺序依次执行，返回成功执行的条数
+    EXPORT int32_t SubmitPlayerCommands(const PlayerCommand* commands, int32_t count);
+
+    // 共享状态块：取一次指针，之后每帧直接读内存，读取协议见blophy-status.h
+    EXPORT const StatusBlock* GetStatusBlock();
+    // 播放器对应的VoiceStatus序号，无效句柄返回-1
+    EXPORT int32_t GetStatusSlot(void* player);
+
+    // 离线渲染：预览片段、导出混音时在调用线程上快于实时地渲染，片段与实时播放共用缓存
+    EXPORT void* CreateOfflineSession(int32_t sampleRate, int32_t channels);
+    EXPORT void DestroyOfflineSession(void* session);
+    // startFrame为会话输出中的起播帧，clipOffset为片段内的起始秒数；返回声部序号，失败返回-1
+    EXPORT int32_t OfflineAddClip(void* session, const char* clipPath, int64_t startFrame, double clipOffset,
+                                  float volume);
+    // 渲染接下来的numFrames帧到交错的output，返回渲染的帧数
+    EXPORT int32_t OfflineRender(void* session, float* output, int32_t numFrames);
+    // 波形包络：每framesPerPeak帧一格的最小值、最大值和RMS，输出数组为空时返回所需格数
+    EXPORT int32_t ComputePeaks(const float* samples, int64_t frames, int32_t channels, int32_t framesPerPeak,
+                                float* mins, float* maxs, float* rms, int32_t maxPeaks);
+    EXPORT int32_t GetClipPeaks(const char* clipPath, int32_t framesPerPeak, float* mins, float* maxs, float* rms,
+                                int32_t maxPeaks);
+
+    // 片段缓存：关卡加载时预解码，退出时释放
+    EXPORT bool PreloadClip(const char* clipPath);
+    EXPORT void EvictClip(const char* clipPath);
+    EXPORT void EvictAllClips();
+    // 存储格式在下次解码该路径时生效，int16可把片段内存减半
+    EXPORT void SetClipFormat(const char* clipPath, ClipFormat format);
+    EXPORT void SetDefaultClipFormat(ClipFormat format);
+    // 片段包：映射预解码的整包并常驻其中全部片段，之后按包内名字SetClip、RegisterOneShotClip都不再解码
+    // prefault为true时在调用线程上预先换入全部页面；返回注册的片段数，失败返回-1
+    EXPORT int32_t LoadClipBank(const char* bankPath, bool prefault);
+    EXPORT void UnloadClipBank(const char* bankPath);
+
+    // 一次性音效：注册时解码并转换到输出采样率，之后触发只是一次无锁入队
+    EXPORT int32_t RegisterOneShotClip(const char* clipPath);
+    EXPORT void UnregisterOneShotClip(int32_t clipId);
+    EXPORT bool PlayOneShot(int32_t clipId, float gain, float pan);
+    // 与PlayAtFrame/PlayAtTime共用输出流时钟，可把击打音和歌曲起点对齐到同一采样
+    EXPORT bool PlayOneShotAtFrame(int32_t clipId, float gain, float pan, int64_t streamFrame);
+    EXPORT bool PlayOneShotAtTime(int32_t clipId, float gain, float pan, double streamTime);
+    EXPORT void StopAllOneShots();
+    EXPORT void SetOneShotPolyphony(int32_t maxVoices);
+    EXPORT void SetOneShotStealPolicy(StealPolicy policy);
+    // 指定总线的版本，streamFrame为0表示立即播放；其它PlayOneShot系列都混入AUDIO_BUS_SFX
+    EXPORT bool PlayOneShotOnBus(int32_t clipId, float gain, float pan, int64_t streamFrame, AudioBus bus);
+
+    // 总线：MUSIC、SFX、UI汇入MASTER，增益0到1，在回调中按块平滑过渡
+    EXPORT void SetBusGain(AudioBus bus, float gain);
+    EXPORT float GetBusGain(AudioBus bus);
+    // 主总线上的峰值限制器，默认开启，阈值-1dBFS，释放100ms
+    EXPORT void SetLimiter(bool enabled, float thresholdDb, int32_t releaseMs);
+    // SFX总线电平超过thresholdDb时把MUSIC总线压低depthDb（负值），默认关闭
+    EXPORT void SetMusicDucking(bool enabled, float thresholdDb, float depthDb, int32_t attackMs, int32_t releaseMs);
+    // 最近一次回调中限制器的最小增益和当前的闪避增益，1表示没有压缩
+    EXPORT float GetLimiterGain();
+    EXPORT float GetDuckingGain();
+
+    // 异步加载：票据为0表示提交失败，回调在解码线程上触发
+    EXPORT int32_t PreloadClipAsync(const char* clipPath);
+    EXPORT LoadStatus GetLoadStatus(int32_t ticket);
+    EXPORT void SetLoadCallback(LoadCallback callback);
 }
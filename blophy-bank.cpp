@@ -0,0 +1,238 @@
+/*
+ * blophy-bank.cpp - Oboe Wrapper for C#
+ * Copyright (C) 2025  MojaveHao
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include "blophy-bank.h"
+#include "blophy-channels.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+#include <unistd.h>
+
+namespace {
+
+// 每个包注册过的名字，卸载时按此解除常驻
+std::mutex g_banksMutex;
+std::unordered_map<std::string, std::vector<std::string>> g_banks;
+
+size_t sampleBytes(const ClipFormat format) {
+    return format == CLIP_FORMAT_INT16 ? sizeof(int16_t) : sizeof(float);
+}
+
+// 范围检查写成减法形式，偏移和长度来自文件，不能让加法溢出
+bool inRange(const uint64_t offset, const uint64_t length, const size_t size) {
+    return offset <= size && length <= size - offset;
+}
+
+// 每页读一个字节，把映射页面换入内存
+void touchPages(const uint8_t* data, const size_t size) {
+    const auto pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    volatile uint8_t sink = 0;
+    for (size_t offset = 0; offset < size; offset += pageSize) {
+        sink = sink ^ data[offset];
+    }
+}
+
+uint64_t alignUp(const uint64_t value, const uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+bool writeZeros(std::FILE* file, uint64_t count) {
+    static const uint8_t zeros[256] = {};
+    while (count > 0) {
+        const auto n = static_cast<size_t>(std::min<uint64_t>(count, sizeof(zeros)));
+        if (std::fwrite(zeros, 1, n, file) != n) {
+            return false;
+        }
+        count -= n;
+    }
+    return true;
+}
+
+} // namespace
+
+bool openClipBank(const std::string& bankPath, const bool prefault,
+                  std::vector<std::shared_ptr<const AudioClip>>& clips) {
+    clips.clear();
+    const auto file = openFileData(bankPath);
+    if (!file) {
+        LOGE("Failed to open clip bank: %s", bankPath.c_str());
+        return false;
+    }
+    const uint8_t* data = file->data();
+    const size_t size = file->size();
+
+    // 文件内容不保证按结构体对齐，表头和索引都复制出来再读
+    BankHeader header{};
+    if (size < sizeof(header)) {
+        LOGE("Clip bank too small: %s", bankPath.c_str());
+        return false;
+    }
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, kBankMagic, sizeof(kBankMagic)) != 0 || header.version != kBankVersion) {
+        LOGE("Not a clip bank or unsupported version: %s", bankPath.c_str());
+        return false;
+    }
+    if (header.clipCount > (size - sizeof(header)) / sizeof(BankEntry) ||
+        !inRange(header.namesOffset, header.namesSize, size)) {
+        LOGE("Corrupt clip bank index: %s", bankPath.c_str());
+        return false;
+    }
+    const auto names = reinterpret_cast<const char*>(data + header.namesOffset);
+
+    clips.reserve(header.clipCount);
+    for (uint32_t i = 0; i < header.clipCount; i++) {
+        BankEntry entry{};
+        std::memcpy(&entry, data + sizeof(header) + static_cast<size_t>(i) * sizeof(entry), sizeof(entry));
+
+        const auto format = static_cast<ClipFormat>(entry.format);
+        const bool validFormat = format == CLIP_FORMAT_FLOAT32 || format == CLIP_FORMAT_INT16;
+        const bool validShape = entry.channels > 0 && entry.channels <= ChannelMatrix::kMaxChannels &&
+                                entry.sampleRate > 0 && entry.totalFrames > 0;
+        const uint64_t frameBytes = validFormat ? entry.channels * sampleBytes(format) : 0;
+        // 采样直接从映射页面中读取，起点至少要按采样大小对齐
+        if (!validFormat || !validShape || !inRange(entry.nameOffset, entry.nameLength, header.namesSize) ||
+            entry.totalFrames > size / frameBytes ||
+            !inRange(entry.dataOffset, entry.totalFrames * frameBytes, size) ||
+            reinterpret_cast<uintptr_t>(data + entry.dataOffset) % sampleBytes(format) != 0) {
+            LOGE("Corrupt clip bank entry %u: %s", i, bankPath.c_str());
+            clips.clear();
+            return false;
+        }
+
+        auto clip = std::make_shared<AudioClip>();
+        clip->path.assign(names + entry.nameOffset, entry.nameLength);
+        clip->format = format;
+        clip->sampleRate = static_cast<int>(entry.sampleRate);
+        clip->channels = entry.channels;
+        clip->totalFrames = static_cast<int64_t>(entry.totalFrames);
+        clip->mapped = data + entry.dataOffset;
+        clip->backing = file;
+        clips.push_back(std::move(clip));
+    }
+
+    if (prefault) {
+        touchPages(data, size);
+    } else {
+        file->adviseWillNeed();
+    }
+    return true;
+}
+
+bool writeClipBank(const std::string& bankPath, const std::vector<std::shared_ptr<const AudioClip>>& clips) {
+    // 主机和设备都是小端，结构体按原样写出
+    BankHeader header{};
+    std::memcpy(header.magic, kBankMagic, sizeof(kBankMagic));
+    header.version = kBankVersion;
+    header.clipCount = static_cast<uint32_t>(clips.size());
+    header.alignment = kBankAlignment;
+    header.namesOffset = sizeof(header) + clips.size() * sizeof(BankEntry);
+
+    std::vector<BankEntry> entries;
+    entries.reserve(clips.size());
+    for (const auto& clip : clips) {
+        if (!clip || clip->channels <= 0 || clip->channels > ChannelMatrix::kMaxChannels) {
+            LOGE("Cannot pack clip: %s", clip ? clip->path.c_str() : "(null)");
+            return false;
+        }
+        BankEntry entry{};
+        entry.totalFrames = static_cast<uint64_t>(clip->totalFrames);
+        entry.nameOffset = static_cast<uint32_t>(header.namesSize);
+        entry.nameLength = static_cast<uint32_t>(clip->path.size());
+        entry.sampleRate = static_cast<uint32_t>(clip->sampleRate);
+        entry.channels = static_cast<uint16_t>(clip->channels);
+        entry.format = static_cast<uint16_t>(clip->format);
+        header.namesSize += clip->path.size();
+        entries.push_back(entry);
+    }
+    uint64_t offset = header.namesOffset + header.namesSize;
+    for (size_t i = 0; i < clips.size(); i++) {
+        offset = alignUp(offset, kBankAlignment);
+        entries[i].dataOffset = offset;
+        offset += entries[i].totalFrames * entries[i].channels * sampleBytes(clips[i]->format);
+    }
+
+    std::FILE* file = std::fopen(bankPath.c_str(), "wb");
+    if (!file) {
+        LOGE("Failed to create clip bank: %s", bankPath.c_str());
+        return false;
+    }
+    bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+              (entries.empty() || std::fwrite(entries.data(), sizeof(BankEntry), entries.size(), file) == entries.size());
+    for (size_t i = 0; ok && i < clips.size(); i++) {
+        const auto& name = clips[i]->path;
+        ok = std::fwrite(name.data(), 1, name.size(), file) == name.size();
+    }
+    uint64_t written = header.namesOffset + header.namesSize;
+    for (size_t i = 0; ok && i < clips.size(); i++) {
+        const auto& clip = *clips[i];
+        const auto bytes = static_cast<size_t>(entries[i].totalFrames * entries[i].channels * sampleBytes(clip.format));
+        const void* samples = clip.format == CLIP_FORMAT_INT16 ? static_cast<const void*>(clip.int16Data()) :
+                                                                   static_cast<const void*>(clip.floatData());
+        ok = writeZeros(file, entries[i].dataOffset - written) && std::fwrite(samples, 1, bytes, file) == bytes;
+        written = entries[i].dataOffset + bytes;
+    }
+    // 关闭失败同样意味着数据没有完整落盘
+    ok = std::fclose(file) == 0 && ok;
+    if (!ok) {
+        LOGE("Failed to write clip bank: %s", bankPath.c_str());
+        std::remove(bankPath.c_str());
+    }
+    return ok;
+}
+
+int32_t loadClipBank(const std::string& bankPath, const bool prefault) {
+    std::vector<std::shared_ptr<const AudioClip>> clips;
+    if (!openClipBank(bankPath, prefault, clips)) {
+        return -1;
+    }
+    // 重复加载同一包时，先卸下旧的注册，包里删掉的名字不会残留
+    unloadClipBank(bankPath);
+
+    std::vector<std::string> names;
+    names.reserve(clips.size());
+    for (auto& clip : clips) {
+        names.push_back(clip->path);
+        ClipCache::instance().add(names.back(), std::move(clip));
+    }
+    const auto count = static_cast<int32_t>(names.size());
+    {
+        std::lock_guard<std::mutex> lock(g_banksMutex);
+        g_banks[bankPath] = std::move(names);
+    }
+    LOGI("Loaded clip bank: %s, %d clips", bankPath.c_str(), count);
+    return count;
+}
+
+void unloadClipBank(const std::string& bankPath) {
+    std::vector<std::string> names;
+    {
+        std::lock_guard<std::mutex> lock(g_banksMutex);
+        const auto it = g_banks.find(bankPath);
+        if (it == g_banks.end()) {
+            return;
+        }
+        names = std::move(it->second);
+        g_banks.erase(it);
+    }
+    for (const auto& name : names) {
+        ClipCache::instance().evict(name);
+    }
+}
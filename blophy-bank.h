@@ -0,0 +1,78 @@
+/*
+ * blophy-bank.h - Oboe Wrapper for C#
+ * Copyright (C) 2025  MojaveHao
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "blophy-clip.h"
+
+// 片段包：一批预先解码好的PCM片段打成一个文件，关卡加载时整体映射一次，
+// 注册后各片段直接引用映射页面，不经过解码器，也不复制到堆上
+//
+// 文件布局（小端）：
+//   BankHeader
+//   BankEntry[clipCount]
+//   名字串表，UTF-8，不带结尾的0
+//   各片段的交错采样，起点按alignment对齐
+// 放进APK时需要以存储方式（不压缩）打包，AAsset_openFileDescriptor才能直接映射；
+// 压缩的包会由系统整块解压，功能不变但失去映射的好处
+struct BankHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t clipCount;
+    uint32_t alignment;
+    uint64_t namesOffset;
+    uint64_t namesSize;
+};
+
+struct BankEntry {
+    uint64_t dataOffset;
+    uint64_t totalFrames;
+    uint32_t nameOffset;
+    uint32_t nameLength;
+    uint32_t sampleRate;
+    uint16_t channels;
+    // ClipFormat，int16或float32
+    uint16_t format;
+};
+
+static_assert(sizeof(BankHeader) == 32, "BankHeader layout is part of the file format");
+static_assert(sizeof(BankEntry) == 32, "BankEntry layout is part of the file format");
+
+constexpr char kBankMagic[4] = {'B', 'L', 'B', 'K'};
+constexpr uint32_t kBankVersion = 1;
+// 片段数据按页对齐，各片段的缺页和预读互不牵连
+constexpr uint32_t kBankAlignment = 4096;
+
+// 映射并校验整个包，把其中的全部片段放入clips，片段的path即包内记录的名字；包无效时返回false
+// prefault为true时在调用线程上逐页读一遍，避免首次播放时在音频线程上缺页；否则只提示内核异步预读
+bool openClipBank(const std::string& bankPath, bool prefault, std::vector<std::shared_ptr<const AudioClip>>& clips);
+
+// 把片段写成片段包，名字取各片段的path；用于主机上的打包工具
+bool writeClipBank(const std::string& bankPath, const std::vector<std::shared_ptr<const AudioClip>>& clips);
+
+// 打开片段包并把全部片段常驻到ClipCache，之后SetClip、PreloadClip等用包内的名字直接命中
+// 同一包再次加载会先卸下旧的注册；不同包中的同名片段以后加载的为准，卸下任一个包都会解除该名字的常驻
+// 返回注册的片段数，失败返回-1
+int32_t loadClipBank(const std::string& bankPath, bool prefault);
+// 解除该包全部片段的常驻，仍在播放的片段到最后一个使用者释放时才解除映射
+void unloadClipBank(const std::string& bankPath);
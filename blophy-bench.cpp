@@ -0,0 +1,302 @@
+/*
+ * blophy-bench.cpp - Oboe Wrapper for C#
+ * Copyright (C) 2025  MojaveHao
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// 混音热路径和解码的基准程序，不依赖输出设备，可以在主机上编译运行
+// 用空输出流按固定缓冲大小反复调用混音器，等同于onAudioReady中的工作量
+//
+// 用法: blophy-bench [选项] [音频文件...]
+//   --voices 1,8,32     声部数，逗号分隔，逐个测试
+//   --channels 1,2      片段声道数，逗号分隔
+//   --buffer 96,192     每次回调的帧数，逗号分隔
+//   --rate 48000        输出采样率
+//   --clip-rate 44100   片段采样率，与输出不同时走重采样路径
+//   --format float      片段存储格式，float或int16
+//   --oneshots 0        每次回调触发的一次性音效数
+//   --seconds 10        每个组合模拟的音频时长
+// 给出的音频文件会分别测试流式解码和整段解码的吞吐量
+
+#include "blophy-clip.h"
+#include "blophy-mixer.h"
+#include "blophy-stream.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct BenchOptions {
+    std::vector<int32_t> voices{1, 8, 32};
+    std::vector<int32_t> channels{1, 2};
+    std::vector<int32_t> buffers{96, 192, 480};
+    int32_t outputRate = 48000;
+    int32_t clipRate = 48000;
+    ClipFormat format = CLIP_FORMAT_FLOAT32;
+    int32_t oneShots = 0;
+    double seconds = 10.0;
+    std::vector<std::string> files;
+};
+
+// 代替Oboe输出流：持有输出缓冲和帧计数，按AudioEngine::onAudioReady的方式驱动混音器
+class NullOutputStream {
+    public:
+        NullOutputStream(AudioMixer& mixer, const int32_t framesPerCallback, const int32_t sampleRate) :
+                m_mixer(mixer),
+                m_framesPerCallback(framesPerCallback),
+                m_sampleRate(sampleRate),
+                m_framesWritten(0),
+                m_buffer(static_cast<size_t>(framesPerCallback) * kOutputChannels) {
+        }
+
+        // 返回本次回调耗时（纳秒）
+        int64_t callback() {
+            const auto begin = Clock::now();
+            m_mixer.render(m_buffer.data(), m_framesPerCallback, kOutputChannels, m_framesWritten, 0, m_sampleRate);
+            const auto end = Clock::now();
+            m_framesWritten += m_framesPerCallback;
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count();
+        }
+
+        // 防止编译器把混音结果当作无用计算优化掉
+        float checksum() const {
+            return m_buffer[0] + m_buffer[m_buffer.size() - 1];
+        }
+
+    private:
+        static constexpr int32_t kOutputChannels = 2;
+
+        AudioMixer& m_mixer;
+        int32_t m_framesPerCallback;
+        int32_t m_sampleRate;
+        int64_t m_framesWritten;
+        std::vector<float> m_buffer;
+};
+
+std::vector<int32_t> parseList(const char* text) {
+    std::vector<int32_t> values;
+    for (const char* p = text; *p;) {
+        char* end = nullptr;
+        const long value = std::strtol(p, &end, 10);
+        if (end == p) {
+            break;
+        }
+        values.push_back(static_cast<int32_t>(value));
+        p = *end == ',' ? end + 1 : end;
+    }
+    return values;
+}
+
+bool parseOptions(const int argc, char** argv, BenchOptions& options) {
+    for (auto i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg == "--voices" && hasValue) {
+            options.voices = parseList(argv[++i]);
+        } else if (arg == "--channels" && hasValue) {
+            options.channels = parseList(argv[++i]);
+        } else if (arg == "--buffer" && hasValue) {
+            options.buffers = parseList(argv[++i]);
+        } else if (arg == "--rate" && hasValue) {
+            options.outputRate = std::atoi(argv[++i]);
+        } else if (arg == "--clip-rate" && hasValue) {
+            options.clipRate = std::atoi(argv[++i]);
+        } else if (arg == "--format" && hasValue) {
+            options.format = std::strcmp(argv[++i], "int16") == 0 ? CLIP_FORMAT_INT16 : CLIP_FORMAT_FLOAT32;
+        } else if (arg == "--oneshots" && hasValue) {
+            options.oneShots = std::atoi(argv[++i]);
+        } else if (arg == "--seconds" && hasValue) {
+            options.seconds = std::atof(argv[++i]);
+        } else if (arg.rfind("--", 0) == 0) {
+            std::fprintf(stderr, "Unknown option: %s\n", arg.c_str());
+            return false;
+        } else {
+            options.files.push_back(arg);
+        }
+    }
+    return options.outputRate > 0 && options.clipRate > 0 && options.seconds > 0.0;
+}
+
+// 合成一段测试片段，各声道频率略有不同，避免内核对全相同数据走捷径
+std::shared_ptr<const AudioClip> makeClip(const int32_t channels, const int32_t sampleRate, const ClipFormat format) {
+    auto clip = std::make_shared<AudioClip>();
+    clip->path = "bench";
+    clip->format = format;
+    clip->sampleRate = sampleRate;
+    clip->channels = channels;
+    clip->totalFrames = sampleRate * 2;
+
+    std::vector<float> samples(static_cast<size_t>(clip->totalFrames) * channels);
+    for (int64_t i = 0; i < clip->totalFrames; i++) {
+        for (auto c = 0; c < channels; c++) {
+            const double phase = 2.0 * M_PI * (440.0 + 110.0 * c) * static_cast<double>(i) / sampleRate;
+            samples[i * channels + c] = 0.25f * static_cast<float>(std::sin(phase));
+        }
+    }
+    if (format == CLIP_FORMAT_INT16) {
+        clip->samples16.resize(samples.size());
+        for (size_t i = 0; i < samples.size(); i++) {
+            clip->samples16[i] = static_cast<int16_t>(std::lrint(samples[i] * 32767.0f));
+        }
+    } else {
+        clip->samples = std::move(samples);
+    }
+    return clip;
+}
+
+void benchMix(const BenchOptions& options, const int32_t voiceCount, const int32_t channels, const int32_t frames) {
+    AudioMixer mixer;
+    const auto clip = makeClip(channels, options.clipRate, options.format);
+    std::vector<std::unique_ptr<AudioVoice>> voices;
+    for (auto i = 0; i < voiceCount; i++) {
+        auto voice = std::make_unique<AudioVoice>();
+        if (!mixer.addVoice(voice.get())) {
+            break;
+        }
+        voice->setOutputSampleRate(options.outputRate);
+        voice->setClip(clip);
+        voice->setLoop(true);
+        voice->play();
+        voices.push_back(std::move(voice));
+    }
+
+    auto oneShotClip = 0;
+    if (options.oneShots > 0) {
+        // 一次性音效要求片段已是输出采样率
+        oneShotClip = mixer.oneShots().registerClip(makeClip(channels, options.outputRate, options.format));
+    }
+    // 之后的命令和触发都交给"回调"处理，与真实运行时一致
+    mixer.setStreamActive(true);
+
+    NullOutputStream stream(mixer, frames, options.outputRate);
+    const auto callbacks = std::max<int64_t>(1, std::llround(options.seconds * options.outputRate / frames));
+    // 先跑一小段预热缓存和分支预测
+    for (auto i = 0; i < 64; i++) {
+        stream.callback();
+    }
+
+    int64_t totalNanos = 0;
+    int64_t worstNanos = 0;
+    for (int64_t i = 0; i < callbacks; i++) {
+        for (auto s = 0; s < options.oneShots; s++) {
+            mixer.oneShots().trigger(oneShotClip, 0.5f, 0.0f);
+        }
+        const int64_t nanos = stream.callback();
+        totalNanos += nanos;
+        worstNanos = std::max(worstNanos, nanos);
+    }
+
+    const double budgetNanos = 1e9 * frames / options.outputRate;
+    const double averageNanos = static_cast<double>(totalNanos) / callbacks;
+    std::printf("%6d %8d %7d %12.2f %12.2f %12.2f %8.2f%% %8.2f%%   (%g)\n",
+                static_cast<int>(voices.size()), channels, frames, averageNanos / frames, averageNanos / 1000.0,
+                worstNanos / 1000.0, 100.0 * averageNanos / budgetNanos, 100.0 * worstNanos / budgetNanos,
+                stream.checksum());
+
+    mixer.setStreamActive(false);
+    for (auto& voice : voices) {
+        mixer.removeVoice(voice.get());
+    }
+    if (oneShotClip) {
+        mixer.oneShots().unregisterClip(oneShotClip);
+    }
+}
+
+std::string extensionOf(const std::string& path) {
+    const auto dot = path.find_last_of('.');
+    return dot == std::string::npos ? std::string("?") : path.substr(dot + 1);
+}
+
+void benchDecode(const std::string& path) {
+    const auto ext = extensionOf(path);
+
+    // 流式解码：与播放时相同的块大小
+    auto file = openFileData(path);
+    if (file) {
+        const auto begin = Clock::now();
+        auto decoder = StreamDecoder::open(file, path);
+        if (decoder) {
+            std::vector<float> block(static_cast<size_t>(StreamSource::kBlockFrames) * decoder->channels());
+            int64_t frames = 0;
+            for (int32_t n; (n = decoder->read(block.data(), StreamSource::kBlockFrames)) > 0;) {
+                frames += n;
+            }
+            const double seconds = std::chrono::duration<double>(Clock::now() - begin).count();
+            std::printf("%-6s %-8s %12lld %10.3f %12.0f %10.1fx  %s\n", ext.c_str(), "stream",
+                        static_cast<long long>(frames), seconds * 1000.0, frames / seconds,
+                        frames / seconds / decoder->sampleRate(), path.c_str());
+        } else {
+            std::printf("%-6s %-8s %12s %10s %12s %10s   %s\n", ext.c_str(), "stream", "-", "-", "-", "n/a",
+                        path.c_str());
+        }
+    }
+
+    // 整段解码：优先走流式解码器，不支持的格式退回nqr
+    const auto begin = Clock::now();
+    const auto clip = decodeClip(path);
+    const double seconds = std::chrono::duration<double>(Clock::now() - begin).count();
+    if (!clip) {
+        std::printf("%-6s %-8s failed to decode %s\n", ext.c_str(), "full", path.c_str());
+        return;
+    }
+    std::printf("%-6s %-8s %12lld %10.3f %12.0f %10.1fx  %s\n", ext.c_str(), "full",
+                static_cast<long long>(clip->totalFrames), seconds * 1000.0, clip->totalFrames / seconds,
+                clip->totalFrames / seconds / clip->sampleRate, path.c_str());
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        std::fprintf(stderr, "usage: %s [--voices 1,8,32] [--channels 1,2] [--buffer 96,192] [--rate 48000] "
+                             "[--clip-rate 44100] [--format float|int16] [--oneshots N] [--seconds S] [files...]\n",
+                     argv[0]);
+        return 1;
+    }
+
+    std::printf("mix: output %d Hz, clip %d Hz %s, %d one-shots/callback, %.1f s per case\n", options.outputRate,
+                options.clipRate, options.format == CLIP_FORMAT_INT16 ? "int16" : "float", options.oneShots,
+                options.seconds);
+    std::printf("%6s %8s %7s %12s %12s %12s %9s %9s\n", "voices", "channels", "frames", "ns/frame", "avg us",
+                "worst us", "avg load", "worst");
+    for (const auto voices : options.voices) {
+        for (const auto channels : options.channels) {
+            for (const auto frames : options.buffers) {
+                if (voices > 0 && channels > 0 && frames > 0) {
+                    benchMix(options, voices, channels, frames);
+                }
+            }
+        }
+    }
+
+    if (!options.files.empty()) {
+        std::printf("\ndecode:\n%-6s %-8s %12s %10s %12s %11s\n", "format", "mode", "frames", "ms", "frames/s",
+                    "realtime");
+        for (const auto& file : options.files) {
+            benchDecode(file);
+        }
+    }
+    return 0;
+}
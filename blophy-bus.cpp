@@ -0,0 +1,226 @@
+/*
+ * blophy-bus.cpp - Oboe Wrapper for C#
+ * Copyright (C) 2025  MojaveHao
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include "blophy-bus.h"
+#include "blophy-kernels.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+// 输出流采样率未知时（如离线会话尚未设置）按48kHz计算时间常数
+constexpr int32_t kFallbackSampleRate = 48000;
+
+float dbToGain(const float db) {
+    return std::pow(10.0f, db / 20.0f);
+}
+
+// 经过durationMs后剩下1/e的每步衰减系数，steps为每步的帧数
+float smoothingCoefficient(const int32_t durationMs, const int32_t steps, const int32_t sampleRate) {
+    if (durationMs <= 0) {
+        return 0.0f;
+    }
+    return std::exp(-static_cast<float>(steps) * 1000.0f / (static_cast<float>(durationMs) * sampleRate));
+}
+
+} // namespace
+
+BusGraph::BusGraph() :
+        m_limiterEnabled(true),
+        m_limiterThreshold(dbToGain(-1.0f)),
+        m_limiterReleaseMs(100),
+        m_duckingEnabled(false),
+        m_duckingThreshold(dbToGain(-30.0f)),
+        m_duckingDepth(dbToGain(-6.0f)),
+        m_duckingAttackMs(10),
+        m_duckingReleaseMs(300),
+        m_frames(0),
+        m_channels(0),
+        m_limiterEnvelope(0.0f),
+        m_duckingGain(1.0f),
+        m_limiterGain(1.0f),
+        m_reportedDuckingGain(1.0f),
+        m_buffers() {
+    for (auto& gain : m_gains) {
+        gain.current = 1.0f;
+        gain.target.store(1.0f);
+    }
+}
+
+void BusGraph::setGain(const AudioBus bus, const float gain) {
+    if (bus < AUDIO_BUS_MUSIC || bus > AUDIO_BUS_MASTER) {
+        return;
+    }
+    m_gains[bus].target.store(std::max(0.0f, std::min(1.0f, gain)), std::memory_order_relaxed);
+}
+
+float BusGraph::getGain(const AudioBus bus) const {
+    if (bus < AUDIO_BUS_MUSIC || bus > AUDIO_BUS_MASTER) {
+        return 0.0f;
+    }
+    return m_gains[bus].target.load(std::memory_order_relaxed);
+}
+
+void BusGraph::setLimiter(const bool enabled, const float thresholdDb, const int32_t releaseMs) {
+    // 阈值高于0dBFS没有意义，输出最终还是会在系统里削波
+    m_limiterThreshold.store(dbToGain(std::min(0.0f, thresholdDb)), std::memory_order_relaxed);
+    m_limiterReleaseMs.store(std::max(1, releaseMs), std::memory_order_relaxed);
+    m_limiterEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+void BusGraph::setDucking(const bool enabled, const float thresholdDb, const float depthDb, const int32_t attackMs,
+                          const int32_t releaseMs) {
+    m_duckingThreshold.store(dbToGain(std::min(0.0f, thresholdDb)), std::memory_order_relaxed);
+    m_duckingDepth.store(dbToGain(std::min(0.0f, depthDb)), std::memory_order_relaxed);
+    m_duckingAttackMs.store(std::max(0, attackMs), std::memory_order_relaxed);
+    m_duckingReleaseMs.store(std::max(0, releaseMs), std::memory_order_relaxed);
+    m_duckingEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+float BusGraph::getLimiterGain() const {
+    return m_limiterGain.load(std::memory_order_relaxed);
+}
+
+float BusGraph::getDuckingGain() const {
+    return m_reportedDuckingGain.load(std::memory_order_relaxed);
+}
+
+int32_t BusGraph::blockFrames(const int32_t channels) {
+    return kBlockSamples / std::max(1, channels);
+}
+
+void BusGraph::beginBlock(const int32_t numFrames, const int32_t channels) {
+    m_frames = numFrames;
+    m_channels = channels;
+    for (auto& buffer : m_buffers) {
+        std::fill_n(buffer.data(), numFrames * channels, 0.0f);
+    }
+}
+
+float* BusGraph::bus(const AudioBus index) {
+    return m_buffers[std::max<int32_t>(AUDIO_BUS_MUSIC, std::min<int32_t>(index, kSourceBuses - 1))].data();
+}
+
+void BusGraph::endBlock(float* output, const int32_t sampleRate) {
+    const int32_t rate = sampleRate > 0 ? sampleRate : kFallbackSampleRate;
+    std::fill_n(output, m_frames * m_channels, 0.0f);
+
+    // 闪避增益跟在MUSIC总线增益后面一起过渡
+    const float duckFrom = m_duckingGain;
+    const float duckTo = updateDucking(rate);
+    for (auto b = 0; b < kSourceBuses; b++) {
+        SmoothedGain& gain = m_gains[b];
+        const float from = gain.current;
+        const float to = gain.target.load(std::memory_order_relaxed);
+        gain.current = to;
+        if (b == AUDIO_BUS_MUSIC) {
+            mixRamped(output, m_buffers[b].data(), m_frames, m_channels, from * duckFrom, to * duckTo);
+        } else {
+            mixRamped(output, m_buffers[b].data(), m_frames, m_channels, from, to);
+        }
+    }
+    limit(output, rate);
+}
+
+float BusGraph::updateDucking(const int32_t sampleRate) {
+    float target = 1.0f;
+    if (m_duckingEnabled.load(std::memory_order_relaxed)) {
+        float low = std::numeric_limits<float>::max();
+        float high = std::numeric_limits<float>::lowest();
+        double sumSquares = 0.0;
+        accumulatePeaks(m_buffers[AUDIO_BUS_SFX].data(), m_frames * m_channels, low, high, sumSquares);
+        // 旁链取SFX总线增益之后的电平，SFX被调小时闪避也相应减弱
+        const float peak = std::max(-low, high) * m_gains[AUDIO_BUS_SFX].target.load(std::memory_order_relaxed);
+        if (m_frames > 0 && peak > m_duckingThreshold.load(std::memory_order_relaxed)) {
+            target = m_duckingDepth.load(std::memory_order_relaxed);
+        }
+    }
+    const int32_t durationMs = target < m_duckingGain ? m_duckingAttackMs.load(std::memory_order_relaxed) :
+                               m_duckingReleaseMs.load(std::memory_order_relaxed);
+    const float coefficient = smoothingCoefficient(durationMs, m_frames, sampleRate);
+    m_duckingGain = target + (m_duckingGain - target) * coefficient;
+    m_reportedDuckingGain.store(m_duckingGain, std::memory_order_relaxed);
+    return m_duckingGain;
+}
+
+void BusGraph::limit(float* output, const int32_t sampleRate) {
+    SmoothedGain& master = m_gains[AUDIO_BUS_MASTER];
+    const float from = master.current;
+    const float to = master.target.load(std::memory_order_relaxed);
+    master.current = to;
+    const bool enabled = m_limiterEnabled.load(std::memory_order_relaxed);
+    if (!enabled) {
+        m_limiterEnvelope = 0.0f;
+        m_limiterGain.store(1.0f, std::memory_order_relaxed);
+        if (from != 1.0f || to != 1.0f) {
+            const float step = (to - from) / static_cast<float>(std::max(1, m_frames));
+            for (auto i = 0; i < m_frames; i++) {
+                const float gain = from + step * static_cast<float>(i + 1);
+                for (auto c = 0; c < m_channels; c++) {
+                    output[i * m_channels + c] *= gain;
+                }
+            }
+        }
+        return;
+    }
+
+    const float threshold = m_limiterThreshold.load(std::memory_order_relaxed);
+    const float release = smoothingCoefficient(m_limiterReleaseMs.load(std::memory_order_relaxed), 1, sampleRate);
+    const float step = (to - from) / static_cast<float>(std::max(1, m_frames));
+    float envelope = m_limiterEnvelope;
+    float minGain = 1.0f;
+    for (auto i = 0; i < m_frames; i++) {
+        float* frame = output + i * m_channels;
+        const float masterGain = from + step * static_cast<float>(i + 1);
+        float peak = 0.0f;
+        for (auto c = 0; c < m_channels; c++) {
+            frame[c] *= masterGain;
+            peak = std::max(peak, std::fabs(frame[c]));
+        }
+        // 包络立即跟上峰值，因此增益乘上去后一定不超过阈值
+        envelope = std::max(peak, envelope * release);
+        if (envelope > threshold) {
+            const float gain = threshold / envelope;
+            minGain = std::min(minGain, gain);
+            for (auto c = 0; c < m_channels; c++) {
+                frame[c] *= gain;
+            }
+        }
+    }
+    m_limiterEnvelope = envelope;
+    m_limiterGain.store(minGain, std::memory_order_relaxed);
+}
+
+void BusGraph::mixRamped(float* output, const float* src, const int32_t numFrames, const int32_t channels,
+                         const float from, const float to) {
+    if (from == to) {
+        if (from != 0.0f) {
+            mixAccumulate(output, src, numFrames * channels, from);
+        }
+        return;
+    }
+    const float step = (to - from) / static_cast<float>(std::max(1, numFrames));
+    for (auto i = 0; i < numFrames; i++) {
+        const float gain = from + step * static_cast<float>(i + 1);
+        for (auto c = 0; c < channels; c++) {
+            output[i * channels + c] += src[i * channels + c] * gain;
+        }
+    }
+}
@@ -0,0 +1,97 @@
+/*
+ * blophy-bus.h - Oboe Wrapper for C#
+ * Copyright (C) 2025  MojaveHao
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include "blophy-channels.h"
+#include "blophy-common.h"
+
+// 固定拓扑的总线图：MUSIC、SFX、UI三条总线各带增益，汇入带增益和峰值限制器的主总线
+// 可选用SFX总线的电平做旁链压低MUSIC（闪避），让击打音效盖过音乐时不必从C#端来回调音量
+// 全部按块在音频线程上处理，缓冲是成员数组，不分配内存；参数是原子量，任意线程可改，下一块生效
+class BusGraph {
+    public:
+        static constexpr int32_t kSourceBuses = AUDIO_BUS_MASTER;
+        // 每条总线的缓冲容量（采样数），更长的回调分块处理
+        static constexpr int32_t kBlockSamples = 1024;
+
+        BusGraph();
+
+        BusGraph(const BusGraph&) = delete;
+        BusGraph& operator=(const BusGraph&) = delete;
+
+        // 增益限制在0到1之间，按块线性过渡，不会产生拉链噪声
+        void setGain(AudioBus bus, float gain);
+        float getGain(AudioBus bus) const;
+
+        // 主总线的峰值限制器：没有预读，超过阈值的峰值立即压到阈值，之后按releaseMs恢复
+        void setLimiter(bool enabled, float thresholdDb, int32_t releaseMs);
+        // SFX总线的块峰值超过thresholdDb时把MUSIC压低depthDb（负值），按attackMs压下、releaseMs恢复
+        void setDucking(bool enabled, float thresholdDb, float depthDb, int32_t attackMs, int32_t releaseMs);
+        // 最近一块的限制器和闪避增益，用于调试电平
+        float getLimiterGain() const;
+        float getDuckingGain() const;
+
+        // 以下只能由音频线程调用
+        // 单块最多能处理的帧数
+        static int32_t blockFrames(int32_t channels);
+        // 清空各总线缓冲，开始一块
+        void beginBlock(int32_t numFrames, int32_t channels);
+        float* bus(AudioBus index);
+        // 按总线增益、闪避和限制器把各总线混到output（覆盖写入）
+        void endBlock(float* output, int32_t sampleRate);
+
+    private:
+        // 按块线性过渡的增益，current为上一块结束时的值
+        struct SmoothedGain {
+            float current;
+            std::atomic<float> target;
+        };
+
+        // 把src按从from到to线性变化的增益叠加到output
+        static void mixRamped(float* output, const float* src, int32_t numFrames, int32_t channels,
+                              float from, float to);
+        float updateDucking(int32_t sampleRate);
+        void limit(float* output, int32_t sampleRate);
+
+        std::array<SmoothedGain, kSourceBuses + 1> m_gains;
+
+        std::atomic<bool> m_limiterEnabled;
+        std::atomic<float> m_limiterThreshold;
+        std::atomic<int32_t> m_limiterReleaseMs;
+
+        std::atomic<bool> m_duckingEnabled;
+        std::atomic<float> m_duckingThreshold;
+        std::atomic<float> m_duckingDepth;
+        std::atomic<int32_t> m_duckingAttackMs;
+        std::atomic<int32_t> m_duckingReleaseMs;
+
+        // 音频线程一侧
+        int32_t m_frames;
+        int32_t m_channels;
+        // 限制器的峰值包络，只升不降地跟踪峰值，再按释放时间衰减
+        float m_limiterEnvelope;
+        float m_duckingGain;
+        std::atomic<float> m_limiterGain;
+        std::atomic<float> m_reportedDuckingGain;
+        alignas(16) std::array<std::array<float, kBlockSamples>, kSourceBuses> m_buffers;
+};
@@ -0,0 +1,141 @@
+/*
+ * blophy-channels.cpp - Oboe Wrapper for C#
+ * Copyright (C) 2025  MojaveHao
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include "blophy-channels.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+constexpr float kMinus3dB = 0.70710678f;
+
+// 3到8声道折叠到立体声的左右两行增益，按WAVE的声道顺序
+//   3: L R C
+//   4: L R BL BR
+//   5: L R C BL BR
+//   6: L R C LFE BL BR
+//   7: L R C LFE BC SL SR
+//   8: L R C LFE BL BR SL SR
+constexpr float kDownmixLeft[6][ChannelMatrix::kMaxChannels] = {
+        {1.0f, 0.0f, kMinus3dB},
+        {1.0f, 0.0f, kMinus3dB, 0.0f},
+        {1.0f, 0.0f, kMinus3dB, kMinus3dB, 0.0f},
+        {1.0f, 0.0f, kMinus3dB, 0.0f, kMinus3dB, 0.0f},
+        {1.0f, 0.0f, kMinus3dB, 0.0f, 0.5f, kMinus3dB, 0.0f},
+        {1.0f, 0.0f, kMinus3dB, 0.0f, kMinus3dB, 0.0f, kMinus3dB, 0.0f}
+};
+constexpr float kDownmixRight[6][ChannelMatrix::kMaxChannels] = {
+        {0.0f, 1.0f, kMinus3dB},
+        {0.0f, 1.0f, 0.0f, kMinus3dB},
+        {0.0f, 1.0f, kMinus3dB, 0.0f, kMinus3dB},
+        {0.0f, 1.0f, kMinus3dB, 0.0f, 0.0f, kMinus3dB},
+        {0.0f, 1.0f, kMinus3dB, 0.0f, 0.5f, 0.0f, kMinus3dB},
+        {0.0f, 1.0f, kMinus3dB, 0.0f, 0.0f, kMinus3dB, 0.0f, kMinus3dB}
+};
+
+// 源折叠成立体声的左右两行，已含声像或平衡
+void stereoRows(const int32_t inputs, const float pan, float* left, float* right) {
+    float leftGain = 1.0f;
+    float rightGain = 1.0f;
+    panGains(inputs, pan, leftGain, rightGain);
+    if (inputs == 1) {
+        left[0] = leftGain;
+        right[0] = rightGain;
+        return;
+    }
+    if (inputs == 2) {
+        left[0] = leftGain;
+        right[1] = rightGain;
+        return;
+    }
+
+    const float* downmixLeft = kDownmixLeft[inputs - 3];
+    const float* downmixRight = kDownmixRight[inputs - 3];
+    float leftSum = 0.0f;
+    float rightSum = 0.0f;
+    for (auto i = 0; i < inputs; i++) {
+        leftSum += downmixLeft[i];
+        rightSum += downmixRight[i];
+    }
+    const float scale = 1.0f / std::max(leftSum, rightSum);
+    for (auto i = 0; i < inputs; i++) {
+        left[i] = downmixLeft[i] * scale * leftGain;
+        right[i] = downmixRight[i] * scale * rightGain;
+    }
+}
+
+ChannelMatrix::Shape detectShape(const ChannelMatrix& matrix) {
+    if (matrix.inputs == 1 && matrix.outputs == 2) {
+        return ChannelMatrix::Shape::MonoToStereo;
+    }
+    if (matrix.inputs == 2 && matrix.outputs == 2 && matrix.gains[0][1] == 0.0f && matrix.gains[1][0] == 0.0f) {
+        return ChannelMatrix::Shape::StereoToStereo;
+    }
+    if (matrix.inputs != matrix.outputs) {
+        return ChannelMatrix::Shape::General;
+    }
+    for (auto o = 0; o < matrix.outputs; o++) {
+        for (auto i = 0; i < matrix.inputs; i++) {
+            if (matrix.gains[o][i] != (o == i ? 1.0f : 0.0f)) {
+                return ChannelMatrix::Shape::General;
+            }
+        }
+    }
+    return ChannelMatrix::Shape::Copy;
+}
+
+} // namespace
+
+void panGains(const int32_t inputs, const float pan, float& left, float& right) {
+    const float clamped = std::max(-1.0f, std::min(1.0f, pan));
+    if (inputs == 1) {
+        const float angle = (clamped + 1.0f) * static_cast<float>(M_PI) * 0.25f;
+        left = std::cos(angle);
+        right = std::sin(angle);
+    } else {
+        left = std::min(1.0f, 1.0f - clamped);
+        right = std::min(1.0f, 1.0f + clamped);
+    }
+}
+
+void buildChannelMatrix(const int32_t inputs, const int32_t outputs, const float pan, ChannelMatrix& matrix) {
+    matrix = ChannelMatrix();
+    matrix.inputs = std::max(1, std::min(inputs, ChannelMatrix::kMaxChannels));
+    matrix.outputs = std::max(1, std::min(outputs, ChannelMatrix::kMaxChannels));
+
+    if (matrix.outputs > 2 && matrix.inputs == matrix.outputs) {
+        for (auto c = 0; c < matrix.outputs; c++) {
+            matrix.gains[c][c] = 1.0f;
+        }
+    } else if (matrix.outputs == 1) {
+        if (matrix.inputs == 1) {
+            matrix.gains[0][0] = 1.0f;
+        } else {
+            float left[ChannelMatrix::kMaxChannels] = {};
+            float right[ChannelMatrix::kMaxChannels] = {};
+            stereoRows(matrix.inputs, 0.0f, left, right);
+            for (auto i = 0; i < matrix.inputs; i++) {
+                matrix.gains[0][i] = 0.5f * (left[i] + right[i]);
+            }
+        }
+    } else {
+        stereoRows(matrix.inputs, pan, matrix.gains[0], matrix.gains[1]);
+    }
+    matrix.shape = detectShape(matrix);
+}
@@ -0,0 +1,102 @@
+/*
+ * blophy-channels.h - Oboe Wrapper for C#
+ * Copyright (C) 2025  MojaveHao
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <cstdint>
+#include "blophy-kernels.h"
+
+// 声道混合矩阵：gains[o][i]为源声道i叠加到输出声道o的增益，不含声部音量
+// 多声道源按WAVE的声道顺序（L R C LFE BL BR SL SR）解释，Vorbis和Opus在解码时已重排成这个顺序
+struct ChannelMatrix {
+    static constexpr int32_t kMaxChannels = 8;
+
+    // 构建时识别出的特殊形状，混音时直接走对应的SIMD内核
+    enum class Shape : int32_t {
+        // 声道数相同且逐声道直通
+        Copy,
+        // 单声道到立体声，增益为gains[0][0]和gains[1][0]
+        MonoToStereo,
+        // 立体声到立体声，只有对角线增益
+        StereoToStereo,
+        General
+    };
+
+    int32_t inputs = 0;
+    int32_t outputs = 0;
+    Shape shape = Shape::General;
+    float gains[kMaxChannels][kMaxChannels] = {};
+};
+
+// 源声道数对应的左右声像增益：单声道为功率恒定声像，正中时左右各-3dB；多声道为平衡，正中时保持原样
+// pan取-1（左）到1（右）
+void panGains(int32_t inputs, float pan, float& left, float& right);
+
+// 按源和输出声道数构建矩阵：
+//   单声道/立体声到立体声按pan声像或平衡；3到8声道按ITU-R BS.775折叠成立体声后再平衡，LFE丢弃，
+//   并整体缩放到每路增益之和不超过1，避免叠加后削波
+//   输出单声道时取立体声折叠结果的平均，忽略pan
+//   输出超过两声道时只有声道数相同的源逐声道直通，其余只写前两个声道
+void buildChannelMatrix(int32_t inputs, int32_t outputs, float pan, ChannelMatrix& matrix);
+
+// 把一帧源数据按矩阵乘以gain后叠加到output，用于逐帧增益渐变
+inline void mixMatrixFrame(float* output, const float* src, const ChannelMatrix& matrix, const float gain) {
+    for (auto o = 0; o < matrix.outputs; o++) {
+        float sum = 0.0f;
+        for (auto i = 0; i < matrix.inputs; i++) {
+            sum += src[i] * matrix.gains[o][i];
+        }
+        output[o] += sum * gain;
+    }
+}
+
+// 常量增益下把numFrames帧源数据按矩阵叠加到output，常见形状走SIMD内核
+inline void mixMatrix(float* output, const float* src, const int32_t numFrames, const ChannelMatrix& matrix,
+                      const float gain) {
+    switch (matrix.shape) {
+        case ChannelMatrix::Shape::Copy:
+            mixAccumulate(output, src, numFrames * matrix.outputs, gain);
+            return;
+        case ChannelMatrix::Shape::MonoToStereo:
+            mixMonoToStereoPanned(output, src, numFrames, matrix.gains[0][0] * gain, matrix.gains[1][0] * gain);
+            return;
+        case ChannelMatrix::Shape::StereoToStereo:
+            mixStereoBalanced(output, src, numFrames, matrix.gains[0][0] * gain, matrix.gains[1][1] * gain);
+            return;
+        default:
+            break;
+    }
+    if (matrix.outputs == 2) {
+        switch (matrix.inputs) {
+            case 6:
+                mixDownToStereo<6>(output, src, numFrames, matrix.gains[0], matrix.gains[1], gain);
+                return;
+            case 8:
+                mixDownToStereo<8>(output, src, numFrames, matrix.gains[0], matrix.gains[1], gain);
+                return;
+            default:
+                break;
+        }
+    }
+    for (auto i = 0; i < numFrames; i++) {
+        mixMatrixFrame(output, src, matrix, gain);
+        output += matrix.outputs;
+        src += matrix.inputs;
+    }
+}
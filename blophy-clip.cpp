@@ -0,0 +1,538 @@
+/*
+ * blophy-clip.cpp - Oboe Wrapper for C#
+ * Copyright (C) 2025  MojaveHao
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "blophy-clip.h"
+#include "blophy-stream.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <type_traits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "flowgraph/resampler/MultiChannelResampler.h"
+#include "libnyquist/include/libnyquist/Common.h"
+#include "libnyquist/include/libnyquist/Decoders.h"
+
+FileData::FileData() :
+        m_data(nullptr),
+        m_size(0),
+        m_mapping(nullptr),
+        m_mappingSize(0)
+#ifdef __ANDROID__
+        , m_asset(nullptr)
+#endif
+{
+}
+
+FileData::FileData(std::vector<uint8_t>&& bytes) : FileData() {
+    m_bytes = std::move(bytes);
+    m_data = m_bytes.data();
+    m_size = m_bytes.size();
+}
+
+FileData::~FileData() {
+    if (m_mapping) {
+        munmap(m_mapping, m_mappingSize);
+    }
+#ifdef __ANDROID__
+    if (m_asset) {
+        AAsset_close(m_asset);
+    }
+#endif
+}
+
+bool FileData::mapRegion(const int fd, const int64_t offset, const size_t length) {
+    if (length == 0) {
+        return false;
+    }
+    // mmap的偏移必须按页对齐，多映射的前缀部分跳过即可
+    const auto pageSize = static_cast<int64_t>(sysconf(_SC_PAGESIZE));
+    const int64_t alignedOffset = offset - offset % pageSize;
+    const auto prefix = static_cast<size_t>(offset - alignedOffset);
+
+    void* mapping = mmap(nullptr, length + prefix, PROT_READ, MAP_PRIVATE, fd, static_cast<off_t>(alignedOffset));
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+    // 解码器按顺序读取，提示内核提前预读
+    madvise(mapping, length + prefix, MADV_SEQUENTIAL);
+
+    m_mapping = mapping;
+    m_mappingSize = length + prefix;
+    m_data = static_cast<const uint8_t*>(mapping) + prefix;
+    m_size = length;
+    return true;
+}
+
+std::shared_ptr<const FileData> FileData::mapFile(const std::string& filename) {
+    const int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return nullptr;
+    }
+
+    std::shared_ptr<FileData> file(new FileData());
+    struct stat info{};
+    const bool mapped = fstat(fd, &info) == 0 && info.st_size > 0 &&
+                        file->mapRegion(fd, 0, static_cast<size_t>(info.st_size));
+    // 映射建立后文件描述符即可关闭
+    close(fd);
+    return mapped ? file : nullptr;
+}
+
+#ifdef __ANDROID__
+std::shared_ptr<const FileData> FileData::mapAsset(AAssetManager* assetManager, const std::string& filename) {
+    AAsset* asset = AAssetManager_open(assetManager, filename.c_str(), AASSET_MODE_BUFFER);
+    if (!asset) {
+        return nullptr;
+    }
+
+    std::shared_ptr<FileData> file(new FileData());
+
+    // 以存储方式打包（未压缩）的asset可以直接映射APK中的对应区域
+    off64_t start = 0;
+    off64_t length = 0;
+    const int fd = AAsset_openFileDescriptor64(asset, &start, &length);
+    if (fd >= 0) {
+        const bool mapped = length > 0 && file->mapRegion(fd, start, static_cast<size_t>(length));
+        close(fd);
+        if (mapped) {
+            AAsset_close(asset);
+            return file;
+        }
+    }
+
+    // 压缩的asset由系统解压到它自己的缓冲区，我们直接引用而不再复制
+    const void* buffer = AAsset_getBuffer(asset);
+    const off64_t size = AAsset_getLength64(asset);
+    if (!buffer || size <= 0) {
+        AAsset_close(asset);
+        return nullptr;
+    }
+    file->m_asset = asset;
+    file->m_data = static_cast<const uint8_t*>(buffer);
+    file->m_size = static_cast<size_t>(size);
+    return file;
+}
+#endif
+
+const uint8_t* FileData::data() const {
+    return m_data;
+}
+
+size_t FileData::size() const {
+    return m_size;
+}
+
+void FileData::adviseWillNeed() const {
+    if (m_mapping) {
+        madvise(m_mapping, m_mappingSize, MADV_WILLNEED);
+    }
+}
+
+#ifdef __ANDROID__
+static AAssetManager* g_assetManager = nullptr;
+
+void setClipAssetManager(AAssetManager* assetManager) {
+    g_assetManager = assetManager;
+}
+#endif
+
+std::vector<uint8_t> loadAssetData(const std::string& filename) {
+    std::vector<uint8_t> buffer;
+
+#ifdef __ANDROID__
+    if (!g_assetManager) {
+        LOGE("AssetManager is not set!");
+        return buffer;
+    }
+
+    AAsset* asset = AAssetManager_open(g_assetManager, filename.c_str(), AASSET_MODE_UNKNOWN);
+    if (!asset) {
+        LOGE("Failed to open asset: %s", filename.c_str());
+        return buffer;
+    }
+
+    const off_t size = AAsset_getLength(asset);
+    buffer.resize(size);
+
+    const int read = AAsset_read(asset, buffer.data(), size);
+    if (read != size) {
+        LOGE("Failed to read asset: %s", filename.c_str());
+        buffer.clear();
+    }
+
+    AAsset_close(asset);
+#else
+    LOGE("Assets are only available on Android: %s", filename.c_str());
+#endif
+    return buffer;
+}
+
+std::vector<uint8_t> loadFileData(const std::string& filename) {
+    std::vector<uint8_t> buffer;
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+
+    if (!file.is_open()) {
+        LOGE("Failed to open file: %s", filename.c_str());
+        return buffer;
+    }
+
+    const std::streamsize size = file.tellg();
+    file.seekg(0, std::ios::beg);
+
+    buffer.resize(size);
+    if (!file.read(reinterpret_cast<char*>(buffer.data()), size)) {
+        LOGE("Failed to read file: %s", filename.c_str());
+        buffer.clear();
+    }
+
+    return buffer;
+}
+
+std::shared_ptr<const FileData> openFileData(const std::string& filePath) {
+    // 确定文件路径是assets中的还是文件系统中的
+    const bool isAsset = (filePath.find("assets/") == 0);
+    std::shared_ptr<const FileData> file;
+    std::vector<uint8_t> fileData;
+
+    if (isAsset) {
+        // 从assets加载
+        const std::string assetPath = filePath.substr(7); // 去掉"assets/"前缀
+#ifdef __ANDROID__
+        if (g_assetManager) {
+            file = FileData::mapAsset(g_assetManager, assetPath);
+        }
+#endif
+        if (!file) {
+            fileData = loadAssetData(assetPath);
+        }
+    } else {
+        // 从文件系统加载
+        file = FileData::mapFile(filePath);
+        if (!file) {
+            fileData = loadFileData(filePath);
+        }
+    }
+
+    if (file) {
+        return file;
+    }
+    if (fileData.empty()) {
+        LOGE("Failed to load audio file: %s", filePath.c_str());
+        return nullptr;
+    }
+    return std::make_shared<FileData>(std::move(fileData));
+}
+
+static int16_t floatToInt16(const float sample) {
+    const float scaled = std::max(-1.0f, std::min(1.0f, sample)) * 32767.0f;
+    return static_cast<int16_t>(std::lrint(scaled));
+}
+
+// 用增量解码器直接从映射区域解出全部PCM，省去libnyquist需要的那份字节拷贝
+template <typename Sample>
+static void decodeAll(StreamDecoder& decoder, std::vector<Sample>& samples, int64_t& totalFrames) {
+    static constexpr int32_t kChunkFrames = 4096;
+    const int channels = decoder.channels();
+    // int16存储时先解到这块小缓冲再转换，避免出现整段float的峰值
+    std::vector<float> scratch;
+
+    // 总帧数已知时一次分配到位，多留一块避免最后一次读取触发扩容
+    samples.reserve((static_cast<size_t>(std::max<int64_t>(0, decoder.totalFrames())) + kChunkFrames) * channels);
+
+    size_t frames = 0;
+    for (;;) {
+        samples.resize((frames + kChunkFrames) * channels);
+        Sample* dst = samples.data() + frames * channels;
+        int32_t read;
+        if constexpr (std::is_same_v<Sample, float>) {
+            read = decoder.read(dst, kChunkFrames);
+        } else {
+            scratch.resize(static_cast<size_t>(kChunkFrames) * channels);
+            read = decoder.read(scratch.data(), kChunkFrames);
+            for (auto i = 0; i < std::max(0, read) * channels; i++) {
+                dst[i] = floatToInt16(scratch[i]);
+            }
+        }
+        if (read <= 0) {
+            break;
+        }
+        frames += read;
+    }
+    samples.resize(frames * channels);
+    totalFrames = static_cast<int64_t>(frames);
+}
+
+std::shared_ptr<const AudioClip> decodeClip(const std::string& filePath, const ClipFormat format) {
+    try {
+        const auto file = openFileData(filePath);
+        if (!file) {
+            return nullptr;
+        }
+
+        std::shared_ptr<AudioClip> clip;
+        if (auto decoder = StreamDecoder::open(file, filePath)) {
+            clip = std::make_shared<AudioClip>();
+            clip->sampleRate = decoder->sampleRate();
+            clip->channels = decoder->channels();
+            if (format == CLIP_FORMAT_INT16) {
+                decodeAll(*decoder, clip->samples16, clip->totalFrames);
+            } else {
+                decodeAll(*decoder, clip->samples, clip->totalFrames);
+            }
+        } else {
+            // 其它格式交给libnyquist，它只接受vector，这里不得不复制一次
+            const std::vector<uint8_t> fileData(file->data(), file->data() + file->size());
+            nqr::AudioData audioData;
+            nqr::NyquistIO loader;
+
+            // 从内存加载并解码音频
+            loader.Load(&audioData, filePath, fileData);
+            if (audioData.channelCount > 0) {
+                clip = std::make_shared<AudioClip>();
+                clip->sampleRate = audioData.sampleRate;
+                clip->channels = audioData.channelCount;
+                clip->totalFrames = static_cast<int64_t>(audioData.samples.size() / audioData.channelCount);
+                if (format == CLIP_FORMAT_INT16) {
+                    clip->samples16.resize(audioData.samples.size());
+                    std::transform(audioData.samples.begin(), audioData.samples.end(), clip->samples16.begin(),
+                                   floatToInt16);
+                } else {
+                    clip->samples = std::move(audioData.samples);
+                }
+            }
+        }
+
+        if (!clip || clip->totalFrames <= 0) {
+            LOGE("Decoded audio is empty: %s", filePath.c_str());
+            return nullptr;
+        }
+        clip->path = filePath;
+        clip->format = format;
+
+        LOGI("Loaded audio: %s, SR: %d, Channels: %d, Frames: %lld, Format: %s",
+             filePath.c_str(), clip->sampleRate, clip->channels,
+             static_cast<long long>(clip->totalFrames), format == CLIP_FORMAT_INT16 ? "int16" : "float32");
+
+        return clip;
+    } catch (const std::exception& e) {
+        LOGE("Failed to load audio data: %s", e.what());
+        return nullptr;
+    }
+}
+
+std::shared_ptr<const AudioClip> resampleClip(const AudioClip& clip, const int outputRate,
+                                              const ResampleQuality quality) {
+    using Resampler = oboe::resampler::MultiChannelResampler;
+    const int channels = clip.channels;
+    std::unique_ptr<Resampler> resampler(Resampler::make(channels, clip.sampleRate, outputRate,
+                                                         static_cast<Resampler::Quality>(quality)));
+    if (!resampler) {
+        return nullptr;
+    }
+
+    auto result = std::make_shared<AudioClip>();
+    result->path = clip.path;
+    result->format = clip.format;
+    result->sampleRate = outputRate;
+    result->channels = channels;
+    result->totalFrames = (clip.totalFrames * outputRate + clip.sampleRate - 1) / clip.sampleRate;
+
+    const auto outputSamples = static_cast<size_t>(result->totalFrames) * channels;
+    const float* source = clip.floatData();
+    const int16_t* source16 = clip.int16Data();
+    std::vector<float> input(channels);
+    std::vector<float> output(channels);
+    if (clip.format == CLIP_FORMAT_INT16) {
+        result->samples16.reserve(outputSamples);
+    } else {
+        result->samples.reserve(outputSamples);
+    }
+
+    int64_t srcFrame = 0;
+    for (int64_t frame = 0; frame < result->totalFrames; frame++) {
+        while (resampler->isWriteNeeded()) {
+            // 输入读完后补零，把滤波器里剩下的尾巴推出来
+            for (auto c = 0; c < channels; c++) {
+                const size_t index = static_cast<size_t>(srcFrame) * channels + c;
+                if (srcFrame >= clip.totalFrames) {
+                    input[c] = 0.0f;
+                } else if (clip.format == CLIP_FORMAT_INT16) {
+                    input[c] = source16[index] * (1.0f / 32768.0f);
+                } else {
+                    input[c] = source[index];
+                }
+            }
+            srcFrame++;
+            resampler->writeNextFrame(input.data());
+        }
+        resampler->readNextFrame(output.data());
+        for (auto c = 0; c < channels; c++) {
+            if (clip.format == CLIP_FORMAT_INT16) {
+                result->samples16.push_back(floatToInt16(output[c]));
+            } else {
+                result->samples.push_back(output[c]);
+            }
+        }
+    }
+
+    LOGI("Resampled audio: %s, %d -> %d Hz", clip.path.c_str(), clip.sampleRate, outputRate);
+    return result;
+}
+
+ClipCache& ClipCache::instance() {
+    static ClipCache cache;
+    return cache;
+}
+
+ClipCache::ClipCache() : m_defaultFormat(CLIP_FORMAT_FLOAT32) {
+}
+
+void ClipCache::setFormat(const std::string& path, const ClipFormat format) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_formats[path] = format;
+}
+
+void ClipCache::setDefaultFormat(const ClipFormat format) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_defaultFormat = format;
+}
+
+ClipFormat ClipCache::formatFor(const std::string& path) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const auto it = m_formats.find(path);
+    return it != m_formats.end() ? it->second : m_defaultFormat;
+}
+
+std::shared_ptr<const AudioClip> ClipCache::find(const std::string& path) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const auto it = m_entries.find(path);
+    if (it == m_entries.end()) {
+        return nullptr;
+    }
+    if (auto clip = it->second.clip.lock()) {
+        const auto format = m_formats.find(path);
+        // 格式已被改过的旧片段不算命中，重新解码后会替换掉它
+        if (clip->format != (format != m_formats.end() ? format->second : m_defaultFormat)) {
+            return nullptr;
+        }
+        return clip;
+    }
+    // 已经没有使用者，清掉过期的条目
+    m_entries.erase(it);
+    return nullptr;
+}
+
+std::shared_ptr<const AudioClip> ClipCache::insert(const std::string& path,
+                                                   std::shared_ptr<const AudioClip> clip,
+                                                   const bool pin) {
+    // 被新格式替换下来的常驻片段放到锁外释放
+    std::shared_ptr<const AudioClip> replaced;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Entry& entry = m_entries[path];
+    // 解码在锁外进行，其它线程可能已经先放入了同一片段，以先到者为准
+    auto existing = entry.clip.lock();
+    if (existing && existing->format == clip->format) {
+        clip = existing;
+    } else {
+        entry.clip = clip;
+        if (entry.pinned) {
+            // 常驻状态随格式切换转移到新片段上
+            replaced = std::move(entry.pinned);
+            entry.pinned = clip;
+        }
+    }
+    if (pin) {
+        entry.pinned = clip;
+    }
+    return clip;
+}
+
+void ClipCache::add(const std::string& path, std::shared_ptr<const AudioClip> clip) {
+    // 被替换下来的常驻片段放到锁外释放
+    std::shared_ptr<const AudioClip> replaced;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_formats[path] = clip->format;
+    Entry& entry = m_entries[path];
+    replaced = std::move(entry.pinned);
+    entry.clip = clip;
+    entry.pinned = std::move(clip);
+}
+
+std::shared_ptr<const AudioClip> ClipCache::acquire(const std::string& path) {
+    if (auto clip = find(path)) {
+        return clip;
+    }
+
+    auto clip = decodeClip(path, formatFor(path));
+    if (!clip) {
+        return nullptr;
+    }
+    return insert(path, std::move(clip), false);
+}
+
+bool ClipCache::preload(const std::string& path) {
+    auto clip = find(path);
+    if (!clip) {
+        clip = decodeClip(path, formatFor(path));
+        if (!clip) {
+            return false;
+        }
+    }
+    insert(path, std::move(clip), true);
+    return true;
+}
+
+void ClipCache::evict(const std::string& path) {
+    std::shared_ptr<const AudioClip> released;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const auto it = m_entries.find(path);
+        if (it == m_entries.end()) {
+            return;
+        }
+        released = std::move(it->second.pinned);
+        // 除了手上这份常驻引用外已无使用者时，连同条目一起移除
+        if (it->second.clip.use_count() <= (released ? 1 : 0)) {
+            m_entries.erase(it);
+        }
+    }
+    // released在锁外析构，避免大块内存回收时阻塞其它加载
+}
+
+void ClipCache::evictAll() {
+    std::vector<std::shared_ptr<const AudioClip>> released;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto it = m_entries.begin(); it != m_entries.end();) {
+            Entry& entry = it->second;
+            const bool pinned = static_cast<bool>(entry.pinned);
+            if (pinned) {
+                released.push_back(std::move(entry.pinned));
+            }
+            // 仍在使用的片段保留弱引用，避免之后重复解码出第二份
+            if (entry.clip.use_count() <= (pinned ? 1 : 0)) {
+                it = m_entries.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+}
@@ -0,0 +1,150 @@
+/*
+ * blophy-clip.h - Oboe Wrapper for C#
+ * Copyright (C) 2025  MojaveHao
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "blophy-common.h"
+
+#ifdef __ANDROID__
+#include <android/asset_manager.h>
+#endif
+
+// 编码后的完整文件内容，解码器直接从这块内存读取
+// 能映射时直接引用文件或APK中的页面，不再复制一份到堆上
+class FileData {
+    public:
+        explicit FileData(std::vector<uint8_t>&& bytes);
+        ~FileData();
+
+        FileData(const FileData&) = delete;
+        FileData& operator=(const FileData&) = delete;
+
+        // 用mmap映射文件系统中的文件，失败时返回nullptr
+        static std::shared_ptr<const FileData> mapFile(const std::string& filename);
+#ifdef __ANDROID__
+        // 未压缩的asset通过文件描述符映射，否则使用AAsset_getBuffer，失败时返回nullptr
+        static std::shared_ptr<const FileData> mapAsset(AAssetManager* assetManager, const std::string& filename);
+#endif
+
+        const uint8_t* data() const;
+        size_t size() const;
+        // 提示内核异步预读整个映射区域，不是映射得到的数据时什么也不做
+        void adviseWillNeed() const;
+
+    private:
+        FileData();
+
+        bool mapRegion(int fd, int64_t offset, size_t length);
+
+        std::vector<uint8_t> m_bytes;
+        const uint8_t* m_data;
+        size_t m_size;
+        // mmap得到的整页区域，m_data可能位于其中某个偏移
+        void* m_mapping;
+        size_t m_mappingSize;
+#ifdef __ANDROID__
+        // 通过AAsset_getBuffer访问时，缓冲区归asset所有
+        AAsset* m_asset;
+#endif
+};
+
+// 解码完成的交错PCM，创建后不再修改，可被任意多个声部共享
+// 按format只有samples或samples16其中之一有数据；来自片段包的片段两者都为空，
+// 采样直接位于mapped指向的映射页面中，由backing保持映射有效。读取采样一律通过floatData/int16Data
+struct AudioClip {
+    std::string path;
+    ClipFormat format;
+    std::vector<float> samples;
+    std::vector<int16_t> samples16;
+    int sampleRate;
+    int channels;
+    int64_t totalFrames;
+    const void* mapped = nullptr;
+    std::shared_ptr<const FileData> backing;
+
+    const float* floatData() const {
+        return mapped ? static_cast<const float*>(mapped) : samples.data();
+    }
+    const int16_t* int16Data() const {
+        return mapped ? static_cast<const int16_t*>(mapped) : samples16.data();
+    }
+};
+
+#ifdef __ANDROID__
+// 设置加载"assets/"路径时使用的AssetManager
+void setClipAssetManager(AAssetManager* assetManager);
+#endif
+
+std::vector<uint8_t> loadAssetData(const std::string& filename);
+std::vector<uint8_t> loadFileData(const std::string& filename);
+
+// 按路径前缀从assets或文件系统读取，优先映射，映射失败时才整块读入，失败时返回nullptr
+std::shared_ptr<const FileData> openFileData(const std::string& filePath);
+
+// 读取并解码整个文件，失败时返回nullptr
+std::shared_ptr<const AudioClip> decodeClip(const std::string& filePath, ClipFormat format = CLIP_FORMAT_FLOAT32);
+
+// 离线转换到outputRate，格式保持不变；用于需要直接以输出采样率播放的场合
+std::shared_ptr<const AudioClip> resampleClip(const AudioClip& clip, int outputRate, ResampleQuality quality);
+
+// 进程内的解码缓存，以路径为键
+// 正在被使用的片段只保留一份；预加载的片段会常驻，直到被显式移除
+class ClipCache {
+    public:
+        static ClipCache& instance();
+
+        ClipCache(const ClipCache&) = delete;
+        ClipCache& operator=(const ClipCache&) = delete;
+
+        // 命中时直接返回共享的片段，否则同步解码
+        std::shared_ptr<const AudioClip> acquire(const std::string& path);
+
+        bool preload(const std::string& path);
+        // 直接放入已就绪的片段并常驻，替换同路径的旧片段；该路径的格式随之记为片段自身的格式，之后acquire直接命中
+        void add(const std::string& path, std::shared_ptr<const AudioClip> clip);
+        // 解除常驻，最后一个使用者释放后内存随之回收
+        void evict(const std::string& path);
+        void evictAll();
+
+        // 指定之后解码该路径时使用的存储格式；已解码的旧格式片段不受影响，直到被换下
+        void setFormat(const std::string& path, ClipFormat format);
+        void setDefaultFormat(ClipFormat format);
+
+    private:
+        struct Entry {
+            std::weak_ptr<const AudioClip> clip;
+            std::shared_ptr<const AudioClip> pinned;
+        };
+
+        ClipCache();
+
+        ClipFormat formatFor(const std::string& path);
+        std::shared_ptr<const AudioClip> find(const std::string& path);
+        std::shared_ptr<const AudioClip> insert(const std::string& path, std::shared_ptr<const AudioClip> clip, bool pin);
+
+        std::mutex m_mutex;
+        std::unordered_map<std::string, Entry> m_entries;
+        std::unordered_map<std::string, ClipFormat> m_formats;
+        ClipFormat m_defaultFormat;
+};
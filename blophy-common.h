@@ -0,0 +1,173 @@
+/*
+ * blophy-common.h - Oboe Wrapper for C#
+ * Copyright (C) 2025  MojaveHao
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+
+#ifdef __ANDROID__
+#include <android/log.h>
+#define LOG_TAG "UnityAudioPlayer"
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define LOGW(...) __android_log_print(ANDROID_LOG_WARN, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+#else
+#define LOGI(...) printf(__VA_ARGS__); printf("\n")
+#define LOGW(...) printf(__VA_ARGS__); printf("\n")
+#define LOGE(...) printf(__VA_ARGS__); printf("\n")
+#endif
+
+#ifdef _WIN32
+#define EXPORT __declspec(dllexport)
+#else
+#define EXPORT __attribute__((visibility("default")))
+#endif
+
+extern "C" typedef enum {
+    AUDIO_STATE_IDLE,
+    AUDIO_STATE_PLAYING,
+    AUDIO_STATE_PAUSED,
+    AUDIO_STATE_STOPPED
+} AudioState;
+
+extern "C" typedef enum {
+    LOAD_STATUS_INVALID,
+    LOAD_STATUS_PENDING,
+    LOAD_STATUS_LOADING,
+    LOAD_STATUS_DONE,
+    LOAD_STATUS_FAILED,
+    LOAD_STATUS_CANCELLED
+} LoadStatus;
+
+// 解码后片段在内存中的存储格式，int16只占float的一半，混音时再转换
+extern "C" typedef enum {
+    CLIP_FORMAT_FLOAT32,
+    CLIP_FORMAT_INT16
+} ClipFormat;
+
+// 片段采样率与输出流不同时使用的重采样质量，与Oboe重采样器的档位一一对应
+extern "C" typedef enum {
+    RESAMPLE_QUALITY_FASTEST,
+    RESAMPLE_QUALITY_LOW,
+    RESAMPLE_QUALITY_MEDIUM,
+    RESAMPLE_QUALITY_HIGH,
+    RESAMPLE_QUALITY_BEST
+} ResampleQuality;
+
+// 音量渐变的曲线，指数曲线听感上更均匀，适合淡入淡出
+extern "C" typedef enum {
+    GAIN_RAMP_LINEAR,
+    GAIN_RAMP_EXPONENTIAL
+} GainRampCurve;
+
+// 变速播放的方式
+extern "C" typedef enum {
+    // 按倍率重采样，音高随速度变化，开销最小
+    PLAYBACK_RATE_VARISPEED,
+    // WSOLA时间伸缩，音高不变，适合练习模式放慢
+    PLAYBACK_RATE_PRESERVE_PITCH
+} PlaybackRateMode;
+
+// 混音总线：各声部先混到所属总线，总线再汇入主总线
+// 音乐默认在MUSIC，一次性音效默认在SFX；MASTER只用于设置总增益，声部不能直接挂在上面
+extern "C" typedef enum {
+    AUDIO_BUS_MUSIC,
+    AUDIO_BUS_SFX,
+    AUDIO_BUS_UI,
+    AUDIO_BUS_MASTER
+} AudioBus;
+
+// 一次性音效超过复音上限时挑选被抢占的声部
+extern "C" typedef enum {
+    STEAL_OLDEST,
+    STEAL_QUIETEST
+} StealPolicy;
+
+// 输出缓冲大小策略：越小延迟越低，但负载波动时更容易欠载
+extern "C" typedef enum {
+    // 从一个burst起步，每次欠载增加一个burst
+    BUFFER_POLICY_LOWEST_LATENCY,
+    // 从两个burst起步，欠载时同样逐步增大
+    BUFFER_POLICY_BALANCED,
+    // 直接使用整个缓冲容量，不再调整
+    BUFFER_POLICY_SAFEST
+} BufferPolicy;
+
+// 回调耗时直方图的格数，每格为缓冲时长预算的1/8，最后一格包含所有超过两倍预算的回调
+#define AUDIO_STATS_LOAD_BUCKETS 16
+
+// 音频回调统计，用于遥测区分是混音开销还是设备本身导致的爆音
+extern "C" typedef struct {
+    int64_t callbackCount;
+    // 设备报告的欠载次数，跨流重开累计
+    int64_t underrunCount;
+    // 预约的起播帧在回调处理时已经过去，只能晚于预定时刻开始
+    int64_t lateCommandCount;
+    // 耗时超过缓冲时长的回调数
+    int64_t overBudgetCount;
+    int64_t worstCallbackNanos;
+    int64_t averageCallbackNanos;
+    // 最近一次回调的缓冲时长
+    int64_t budgetNanos;
+    uint32_t loadHistogram[AUDIO_STATS_LOAD_BUCKETS];
+} AudioStats;
+
+// 批量查询的单个结果，字段按宽度从大到小排列，C#端可用Sequential布局直接映射
+extern "C" typedef struct {
+    int64_t currentFrame;
+    // 经过输出延迟补偿的歌曲位置及对应的CLOCK_MONOTONIC时刻，同GetPlaybackPosition
+    double songTime;
+    int64_t clockNanos;
+    float currentTime;
+    float volume;
+    AudioState state;
+    // 句柄无效或已销毁时为0，其余字段清零
+    int32_t valid;
+} PlayerStatus;
+
+extern "C" typedef enum {
+    PLAYER_COMMAND_PLAY,
+    PLAYER_COMMAND_PAUSE,
+    PLAYER_COMMAND_UNPAUSE,
+    PLAYER_COMMAND_STOP,
+    // value为音量，durationMs大于0时按曲线渐变
+    PLAYER_COMMAND_SET_VOLUME,
+    // value为秒
+    PLAYER_COMMAND_SET_CURRENT_TIME,
+    // frame为片段帧位置
+    PLAYER_COMMAND_SET_CURRENT_FRAME,
+    // value非0表示循环
+    PLAYER_COMMAND_SET_LOOP,
+    PLAYER_COMMAND_FADE_IN,
+    PLAYER_COMMAND_FADE_OUT,
+    // frame为输出流帧位置
+    PLAYER_COMMAND_PLAY_AT_FRAME,
+    // value为声像，-1（左）到1（右）
+    PLAYER_COMMAND_SET_PAN
+} PlayerCommandType;
+
+// 批量提交的单条命令，未用到的字段忽略
+extern "C" typedef struct {
+    void* player;
+    int64_t frame;
+    PlayerCommandType type;
+    float value;
+    int32_t durationMs;
+    GainRampCurve curve;
+} PlayerCommand;
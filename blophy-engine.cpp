@@ -0,0 +1,341 @@
+/*
+ * blophy-engine.cpp - Oboe Wrapper for C#
+ * Copyright (C) 2025  MojaveHao
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "blophy-engine.h"
+#include "blophy-arena.h"
+#include "blophy-loader.h"
+#include <algorithm>
+#include <cmath>
+#include <ctime>
+
+AudioEngine& AudioEngine::instance() {
+    static AudioEngine engine;
+    return engine;
+}
+
+namespace {
+
+int64_t monotonicNanos() {
+    timespec now{};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<int64_t>(now.tv_sec) * 1000000000LL + now.tv_nsec;
+}
+
+} // namespace
+
+AudioEngine::AudioEngine() :
+        m_bufferPolicy(BUFFER_POLICY_BALANCED),
+        m_bufferPolicyPending(false),
+        m_clockSampleRate(0),
+        m_streamFrameBase(0),
+        m_nextStreamFrame(0),
+        m_lastCallbackNanos(0),
+        m_glitchStartNanos(0),
+        m_reopenStartNanos(0),
+        m_lastGlitchNanos(0),
+        m_restartCount(0) {
+    // 流式解码块池和解码线程在初始化时就准备好，播放开始后不再有大块分配和线程创建
+    StreamSource::reservePool();
+    StreamingService::instance();
+}
+
+AudioEngine::~AudioEngine() {
+    std::lock_guard<std::mutex> lock(m_streamMutex);
+    if (m_audioStream) {
+        m_audioStream->close();
+        m_latencyTuner.reset();
+        m_audioStream.reset();
+    }
+    m_mixer.setStreamActive(false);
+}
+
+bool AudioEngine::start() {
+    std::lock_guard<std::mutex> lock(m_streamMutex);
+    if (m_audioStream) {
+        return true;
+    }
+    return openStreamLocked();
+}
+
+bool AudioEngine::openStreamLocked() {
+    oboe::AudioStreamBuilder builder;
+    builder.setDirection(oboe::Direction::Output);
+    builder.setPerformanceMode(oboe::PerformanceMode::LowLatency);
+    builder.setSharingMode(oboe::SharingMode::Exclusive);
+    builder.setFormat(oboe::AudioFormat::Float);
+    builder.setChannelCount(kOutputChannels);
+    // 不指定采样率，否则系统会插入自己的重采样器并退出MMAP通路
+    builder.setCallback(this);
+
+    oboe::Result result = builder.openStream(m_audioStream);
+    if (result != oboe::Result::OK) {
+        LOGE("Failed to open audio stream: %s", oboe::convertToText(result));
+        m_audioStream.reset();
+        return false;
+    }
+
+    // 新流的欠载计数从0开始
+    m_mixer.stats().resetStreamXRuns();
+    // 调节器构造时就会把缓冲设到最小值，必须在开始回调前创建
+    m_latencyTuner = std::make_unique<oboe::LatencyTuner>(*m_audioStream);
+    m_bufferPolicyPending.store(true);
+
+    // 输出流时钟按帧计数，换了采样率后基准和所有预约位置按比例换算，预约的事件仍在原定时刻起播
+    const int sampleRate = m_audioStream->getSampleRate();
+    if (m_clockSampleRate > 0 && sampleRate != m_clockSampleRate) {
+        const double ratio = static_cast<double>(sampleRate) / m_clockSampleRate;
+        m_streamFrameBase.store(std::llround(static_cast<double>(m_streamFrameBase.load()) * ratio));
+        m_nextStreamFrame.store(std::llround(static_cast<double>(m_nextStreamFrame.load()) * ratio));
+        m_mixer.rescaleStreamClock(m_clockSampleRate, sampleRate);
+    }
+    m_clockSampleRate = sampleRate;
+
+    // 新设备的采样率可能不同，开始回调前让所有声部换好重采样器
+    m_mixer.setOutputSampleRate(sampleRate);
+    // 回调开始后命令改由音频线程处理
+    m_mixer.setStreamActive(true);
+    result = m_audioStream->requestStart();
+    if (result != oboe::Result::OK) {
+        LOGE("Failed to start audio stream: %s", oboe::convertToText(result));
+        m_audioStream->close();
+        m_latencyTuner.reset();
+        m_audioStream.reset();
+        m_mixer.setStreamActive(false);
+        return false;
+    }
+
+    LOGI("Opened shared stream, SR: %d, Channels: %d, Burst: %d, Buffer: %d/%d",
+         m_audioStream->getSampleRate(), m_audioStream->getChannelCount(),
+         m_audioStream->getFramesPerBurst(), m_audioStream->getBufferSizeInFrames(),
+         m_audioStream->getBufferCapacityInFrames());
+    return true;
+}
+
+void AudioEngine::applyBufferPolicy(oboe::AudioStream* audioStream) {
+    const int32_t burst = audioStream->getFramesPerBurst();
+    switch (m_bufferPolicy.load(std::memory_order_relaxed)) {
+        case BUFFER_POLICY_LOWEST_LATENCY:
+            // 最小值在调节器下一次reset时生效，紧接着的tune()就会执行reset
+            m_latencyTuner->setMinimumBufferSize(burst);
+            m_latencyTuner->requestReset();
+            break;
+        case BUFFER_POLICY_BALANCED:
+            m_latencyTuner->setMinimumBufferSize(burst * 2);
+            m_latencyTuner->requestReset();
+            break;
+        case BUFFER_POLICY_SAFEST:
+            audioStream->setBufferSizeInFrames(audioStream->getBufferCapacityInFrames());
+            break;
+    }
+}
+
+void AudioEngine::setBufferPolicy(const BufferPolicy policy) {
+    // 调节器不是线程安全的，这里只记下策略，由回调线程在tune()之前应用
+    m_bufferPolicy.store(policy);
+    m_bufferPolicyPending.store(true);
+}
+
+BufferPolicy AudioEngine::getBufferPolicy() const {
+    return m_bufferPolicy.load();
+}
+
+int32_t AudioEngine::getBufferSizeInFrames() const {
+    std::lock_guard<std::mutex> lock(m_streamMutex);
+    return m_audioStream ? m_audioStream->getBufferSizeInFrames() : -1;
+}
+
+int32_t AudioEngine::getFramesPerBurst() const {
+    std::lock_guard<std::mutex> lock(m_streamMutex);
+    return m_audioStream ? m_audioStream->getFramesPerBurst() : -1;
+}
+
+int32_t AudioEngine::getXRunCount() const {
+    std::lock_guard<std::mutex> lock(m_streamMutex);
+    if (!m_audioStream) {
+        return -1;
+    }
+    const auto xruns = m_audioStream->getXRunCount();
+    return xruns ? xruns.value() : -1;
+}
+
+int AudioEngine::getSampleRate() const {
+    std::lock_guard<std::mutex> lock(m_streamMutex);
+    return m_audioStream ? m_audioStream->getSampleRate() : 0;
+}
+
+bool AudioEngine::getPresentedFrame(const int64_t nowNanos, double& presentedFrame, int& sampleRate) const {
+    std::lock_guard<std::mutex> lock(m_streamMutex);
+    if (!m_audioStream) {
+        return false;
+    }
+    sampleRate = m_audioStream->getSampleRate();
+
+    // 优先使用硬件时间戳，外推到当前时刻
+    const auto timestamp = m_audioStream->getTimestamp(CLOCK_MONOTONIC);
+    if (timestamp) {
+        const auto elapsedNanos = static_cast<double>(nowNanos - timestamp.value().timestamp);
+        presentedFrame = static_cast<double>(m_streamFrameBase.load() + timestamp.value().position) +
+                         elapsedNanos * sampleRate / 1e9;
+        return true;
+    }
+
+    // 时间戳不可用时（如刚启动），用已写入帧数减去估算延迟
+    const auto latency = m_audioStream->calculateLatencyMillis();
+    const double latencyFrames = latency ? latency.value() * sampleRate / 1000.0 : 0.0;
+    presentedFrame = static_cast<double>(m_streamFrameBase.load() + m_audioStream->getFramesWritten()) - latencyFrames;
+    return true;
+}
+
+bool AudioEngine::getStreamFrame(int64_t& streamFrame, int& sampleRate) const {
+    std::lock_guard<std::mutex> lock(m_streamMutex);
+    if (!m_audioStream) {
+        return false;
+    }
+    sampleRate = m_audioStream->getSampleRate();
+    // 重开流后第一次回调之前，下一帧就是新的基准（已计入中断时长）
+    streamFrame = std::max(m_nextStreamFrame.load(std::memory_order_relaxed),
+                           m_streamFrameBase.load(std::memory_order_relaxed));
+    return true;
+}
+
+AudioMixer& AudioEngine::mixer() {
+    return m_mixer;
+}
+
+oboe::DataCallbackResult AudioEngine::onAudioReady(
+    oboe::AudioStream *audioStream,
+    void *audioData,
+    const int32_t numFrames) {
+
+    // 调试构建中回调内的任何分配都会中止进程
+    const RealtimeScope realtime;
+    // 回调里不取硬件时间戳（可能加锁），用尚未播放的缓冲帧数估算本缓冲第一帧被听到的时刻
+    const int64_t nowNanos = monotonicNanos();
+    const int32_t sampleRate = audioStream->getSampleRate();
+    const int64_t framesWritten = audioStream->getFramesWritten();
+    const int64_t queuedFrames = std::max<int64_t>(0, framesWritten - audioStream->getFramesRead());
+    const int64_t presentNanos = nowNanos + queuedFrames * 1000000000LL / std::max(1, sampleRate);
+
+    // 重开后的第一次回调，记录从上一条流最后一次回调到现在的中断时长
+    const int64_t glitchStart = m_glitchStartNanos.load(std::memory_order_relaxed);
+    if (glitchStart != 0) {
+        m_lastGlitchNanos.store(nowNanos - glitchStart, std::memory_order_relaxed);
+        m_glitchStartNanos.store(0, std::memory_order_relaxed);
+        // 打开和启动新流（可能长达数十毫秒）期间的时间按新采样率计入时钟基准
+        const int64_t reopenNanos = std::max<int64_t>(0, nowNanos - m_reopenStartNanos.load(std::memory_order_relaxed));
+        m_streamFrameBase.fetch_add(reopenNanos * std::max(1, sampleRate) / 1000000000LL, std::memory_order_relaxed);
+    }
+
+    if (m_bufferPolicyPending.exchange(false, std::memory_order_acquire)) {
+        applyBufferPolicy(audioStream);
+    }
+    // 欠载次数增加时调节器会多加一个burst，SAFEST策略下缓冲已是最大
+    if (m_bufferPolicy.load(std::memory_order_relaxed) != BUFFER_POLICY_SAFEST) {
+        m_latencyTuner->tune();
+    }
+
+    // 新流的帧计数从0开始，加上基准后输出流时钟在重开前后保持连续
+    const int64_t streamFrame = m_streamFrameBase.load(std::memory_order_relaxed) + framesWritten;
+    m_mixer.render(static_cast<float*>(audioData), numFrames, audioStream->getChannelCount(),
+                   streamFrame, presentNanos, sampleRate);
+    m_nextStreamFrame.store(streamFrame + numFrames, std::memory_order_relaxed);
+    m_lastCallbackNanos.store(nowNanos, std::memory_order_relaxed);
+
+    // 调节器本来就在每次回调读取，这里的查询同样不加锁
+    const auto xruns = audioStream->getXRunCount();
+    if (xruns) {
+        m_mixer.stats().recordXRuns(xruns.value());
+    }
+    m_mixer.stats().record(monotonicNanos() - nowNanos, static_cast<int64_t>(numFrames) * 1000000000LL /
+                                                         std::max(1, sampleRate));
+    return oboe::DataCallbackResult::Continue;
+}
+
+void AudioEngine::onErrorAfterClose(oboe::AudioStream *audioStream, const oboe::Result error) {
+    // Oboe在独立线程上调用这里，可以直接重开流；声部、播放头和预约事件都原样保留
+    LOGE("Audio stream error: %s", oboe::convertToText(error));
+    std::lock_guard<std::mutex> lock(m_streamMutex);
+    if (m_audioStream.get() != audioStream) {
+        return;
+    }
+    const int oldSampleRate = audioStream->getSampleRate();
+    m_latencyTuner.reset();
+    m_audioStream.reset();
+    // 重开期间命令由提交线程直接应用，一次性音效暂不接受触发
+    m_mixer.setStreamActive(false);
+
+    const int64_t nowNanos = monotonicNanos();
+    int64_t lastCallback = m_lastCallbackNanos.load(std::memory_order_relaxed);
+    if (lastCallback == 0) {
+        lastCallback = nowNanos;
+    }
+    // 中断期间的时间也计入输出流时钟，预约在中断之后的事件仍按原定时刻起播
+    const int64_t gapFrames = (nowNanos - lastCallback) * std::max(1, oldSampleRate) / 1000000000LL;
+    m_streamFrameBase.store(m_nextStreamFrame.load(std::memory_order_relaxed) + gapFrames);
+    m_reopenStartNanos.store(nowNanos, std::memory_order_relaxed);
+    m_glitchStartNanos.store(lastCallback, std::memory_order_relaxed);
+
+    if (!openStreamLocked()) {
+        // 新设备也打不开时退回旧行为：全部停止，之后Play会再次尝试开流
+        m_glitchStartNanos.store(0, std::memory_order_relaxed);
+        m_mixer.stopAll();
+        return;
+    }
+    m_restartCount.fetch_add(1);
+    if (m_audioStream->getSampleRate() != oldSampleRate) {
+        // 一次性音效在注册时已转换到旧采样率，在解码线程上重新转换，换好之前音高会略有偏差
+        LOGW("Output sample rate changed from %d to %d after restart", oldSampleRate,
+             m_audioStream->getSampleRate());
+        ClipLoader::instance().post([this] { resampleOneShotClips(); });
+    }
+}
+
+void AudioEngine::resampleOneShotClips() {
+    const int outputRate = getSampleRate();
+    if (outputRate <= 0) {
+        return;
+    }
+    OneShotPool& pool = m_mixer.oneShots();
+    for (const auto& entry : pool.registeredClips()) {
+        const auto& previous = entry.second;
+        if (previous->sampleRate == outputRate) {
+            continue;
+        }
+        // 优先从缓存取原始片段，避免在已转换过的数据上再转换一次
+        auto source = ClipCache::instance().acquire(previous->path);
+        if (!source) {
+            source = previous;
+        }
+        auto clip = source->sampleRate == outputRate ? source : resampleClip(*source, outputRate,
+                                                                             RESAMPLE_QUALITY_HIGH);
+        if (!clip) {
+            LOGW("Failed to resample one-shot clip %d: %s", entry.first, previous->path.c_str());
+            continue;
+        }
+        pool.replaceClip(entry.first, previous.get(), std::move(clip));
+    }
+    LOGI("Resampled one-shot clips to %d Hz", outputRate);
+}
+
+int32_t AudioEngine::getRestartCount() const {
+    return m_restartCount.load();
+}
+
+double AudioEngine::getLastGlitchMillis() const {
+    return static_cast<double>(m_lastGlitchNanos.load()) / 1e6;
+}
@@ -0,0 +1,102 @@
+/*
+ * blophy-engine.h - Oboe Wrapper for C#
+ * Copyright (C) 2025  MojaveHao
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include "oboe/Oboe.h"
+#include "blophy-mixer.h"
+
+// 进程内唯一的输出引擎，持有一条独占低延迟流，所有播放器作为声部在其回调中混合
+class AudioEngine final : public oboe::AudioStreamCallback {
+    public:
+        static constexpr int32_t kOutputChannels = 2;
+
+        static AudioEngine& instance();
+
+        AudioEngine(const AudioEngine&) = delete;
+        AudioEngine& operator=(const AudioEngine&) = delete;
+
+        // 按需打开并启动共享输出流，已在运行时直接返回
+        // 流使用设备原生采样率以保持在快速通路上，片段由各声部自行重采样
+        bool start();
+        int getSampleRate() const;
+
+        // 估算nowNanos（CLOCK_MONOTONIC）时刻正在被听到的输出流帧位置
+        bool getPresentedFrame(int64_t nowNanos, double& presentedFrame, int& sampleRate) const;
+        // 预约起播的时钟：下一次回调将要写入的第一帧，与回调中的streamFrame同一计数
+        // 这一帧要再经过输出延迟才被听到，正在被听到的位置见getPresentedFrame
+        bool getStreamFrame(int64_t& streamFrame, int& sampleRate) const;
+
+        AudioMixer& mixer();
+
+        // 缓冲策略随时可以切换，下次开流时同样生效
+        void setBufferPolicy(BufferPolicy policy);
+        BufferPolicy getBufferPolicy() const;
+        // 流未运行时返回-1
+        int32_t getBufferSizeInFrames() const;
+        int32_t getFramesPerBurst() const;
+        int32_t getXRunCount() const;
+
+        // 设备断开或路由切换后自动重开的次数，以及最近一次从断流到恢复出声的时长
+        int32_t getRestartCount() const;
+        double getLastGlitchMillis() const;
+
+        // Oboe回调接口
+        oboe::DataCallbackResult onAudioReady(
+            oboe::AudioStream* audioStream,
+            void* audioData,
+            int32_t numFrames
+        ) override;
+
+        void onErrorAfterClose(oboe::AudioStream* audioStream, oboe::Result error) override;
+
+    private:
+        AudioEngine();
+        ~AudioEngine() override;
+
+        bool openStreamLocked();
+        // 在回调线程上按当前策略设置缓冲，调节器的tune()也在这里运行，两者不会交错
+        void applyBufferPolicy(oboe::AudioStream* audioStream);
+        // 输出采样率改变后把已注册的一次性音效重新转换到新采样率，在后台线程调用
+        void resampleOneShotClips();
+
+        mutable std::mutex m_streamMutex;
+        std::shared_ptr<oboe::AudioStream> m_audioStream;
+        // 在回调中根据欠载次数逐步增大缓冲，与m_audioStream同生同灭
+        std::unique_ptr<oboe::LatencyTuner> m_latencyTuner;
+        std::atomic<BufferPolicy> m_bufferPolicy;
+        // 策略改变或新开流后置位，由下一次回调取走并应用
+        std::atomic<bool> m_bufferPolicyPending;
+        AudioMixer m_mixer;
+
+        // 输出流时钟计数所用的采样率，重开后采样率不同时按比例换算时钟
+        int m_clockSampleRate;
+        // 输出流时钟 = 基准 + 当前流的已写入帧数，重开流时更新基准
+        std::atomic<int64_t> m_streamFrameBase;
+        std::atomic<int64_t> m_nextStreamFrame;
+        std::atomic<int64_t> m_lastCallbackNanos;
+        // 非0表示正在从断流中恢复，记录断流开始的时刻
+        std::atomic<int64_t> m_glitchStartNanos;
+        // 开始重开流的时刻，基准只计到这里，重开花费的时间由新流的第一次回调补上
+        std::atomic<int64_t> m_reopenStartNanos;
+        std::atomic<int64_t> m_lastGlitchNanos;
+        std::atomic<int32_t> m_restartCount;
+};
@@ -0,0 +1,170 @@
+/*
+ * blophy-handle.h - Oboe Wrapper for C#
+ * Copyright (C) 2025  MojaveHao
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// 导出给C#的句柄表：句柄低位是槽位序号，高位是槽位的代数
+// 查找只是一次范围检查和代数比较，不加锁；槽位被复用后旧句柄的代数对不上，不会指向新对象
+// 创建和销毁在互斥锁内进行，销毁会等到正在使用该对象的调用全部返回后才释放
+template <typename T, uint32_t IndexBits = 10>
+class HandleTable {
+    public:
+        // 序号0留作空句柄
+        static constexpr uint32_t kCapacity = (1u << IndexBits) - 1;
+
+        // 持有期间对象不会被销毁，只在一次导出调用内使用
+        class Ref {
+            public:
+                Ref() : m_object(nullptr), m_users(nullptr) {}
+                Ref(T* object, std::atomic<uint32_t>* users) : m_object(object), m_users(users) {}
+                Ref(Ref&& other) noexcept : m_object(other.m_object), m_users(other.m_users) {
+                    other.m_object = nullptr;
+                    other.m_users = nullptr;
+                }
+                Ref(const Ref&) = delete;
+                Ref& operator=(const Ref&) = delete;
+                Ref& operator=(Ref&&) = delete;
+                ~Ref() {
+                    if (m_users) {
+                        m_users->fetch_sub(1, std::memory_order_release);
+                    }
+                }
+
+                explicit operator bool() const { return m_object != nullptr; }
+                T* operator->() const { return m_object; }
+                T& operator*() const { return *m_object; }
+
+            private:
+                T* m_object;
+                std::atomic<uint32_t>* m_users;
+        };
+
+        HandleTable() : m_slots() {
+            m_freeSlots.reserve(kCapacity);
+            for (auto i = kCapacity; i > 0; i--) {
+                m_freeSlots.push_back(i - 1);
+            }
+        }
+
+        HandleTable(const HandleTable&) = delete;
+        HandleTable& operator=(const HandleTable&) = delete;
+
+        // 表满时返回nullptr，对象仍归调用方所有
+        void* insert(std::unique_ptr<T>& object) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_freeSlots.empty()) {
+                return nullptr;
+            }
+            const uint32_t index = m_freeSlots.back();
+            m_freeSlots.pop_back();
+
+            Slot& slot = m_slots[index];
+            slot.object = object.release();
+            // 奇数代数表示槽位已占用
+            const uint32_t generation = slot.generation.load(std::memory_order_relaxed) + 1;
+            slot.generation.store(generation, std::memory_order_release);
+            return encode(index, generation);
+        }
+
+        Ref acquire(void* handle) {
+            uint32_t index = 0;
+            uint32_t generation = 0;
+            if (!decode(handle, index, generation)) {
+                return {};
+            }
+            Slot& slot = m_slots[index];
+            // 先登记使用者再检查代数，与erase的先改代数再等使用者配对
+            slot.users.fetch_add(1);
+            if ((slot.generation.load() & kGenerationMask) != generation) {
+                slot.users.fetch_sub(1, std::memory_order_release);
+                return {};
+            }
+            return {slot.object, &slot.users};
+        }
+
+        // 过期或无效的句柄返回false；返回时对象已被销毁
+        bool erase(void* handle) {
+            uint32_t index = 0;
+            uint32_t generation = 0;
+            if (!decode(handle, index, generation)) {
+                return false;
+            }
+
+            std::unique_ptr<T> object;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                Slot& slot = m_slots[index];
+                const uint32_t current = slot.generation.load(std::memory_order_relaxed);
+                if ((current & kGenerationMask) != generation) {
+                    return false;
+                }
+                // 代数变为偶数后新的查找都会失败，再等正在进行的调用结束
+                slot.generation.store(current + 1);
+                while (slot.users.load(std::memory_order_acquire) != 0) {
+                    std::this_thread::yield();
+                }
+                object.reset(slot.object);
+                slot.object = nullptr;
+                m_freeSlots.push_back(index);
+            }
+            return true;
+        }
+
+    private:
+        static constexpr uint32_t kIndexMask = (1u << IndexBits) - 1;
+        // 句柄去掉序号位后剩余的位数；32位平台上较少，但同一槽位要复用上百万次才会回绕
+        static constexpr uint32_t kHandleBits = static_cast<uint32_t>(sizeof(uintptr_t) * 8);
+        static constexpr uint32_t kGenerationBits = kHandleBits - IndexBits > 32 ? 32 : kHandleBits - IndexBits;
+        static constexpr uint32_t kGenerationMask = kGenerationBits >= 32 ? 0xFFFFFFFFu : (1u << kGenerationBits) - 1;
+
+        struct Slot {
+            std::atomic<uint32_t> generation;
+            std::atomic<uint32_t> users;
+            T* object;
+        };
+
+        static void* encode(const uint32_t index, const uint32_t generation) {
+            // 序号从1开始编码，保证句柄不为空指针
+            const uintptr_t value = (static_cast<uintptr_t>(generation & kGenerationMask) << IndexBits) | (index + 1);
+            return reinterpret_cast<void*>(value);
+        }
+
+        static bool decode(void* handle, uint32_t& index, uint32_t& generation) {
+            const auto value = reinterpret_cast<uintptr_t>(handle);
+            const auto slot = static_cast<uint32_t>(value & kIndexMask);
+            generation = static_cast<uint32_t>(value >> IndexBits) & kGenerationMask;
+            // 序号0是空句柄，偶数代数是空槽位
+            if (slot == 0 || (generation & 1) == 0) {
+                return false;
+            }
+            index = slot - 1;
+            return true;
+        }
+
+        std::array<Slot, kCapacity> m_slots;
+        std::mutex m_mutex;
+        std::vector<uint32_t> m_freeSlots;
+};
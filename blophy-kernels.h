@@ -0,0 +1,298 @@
+/*
+ * blophy-kernels.h - Oboe Wrapper for C#
+ * Copyright (C) 2025  MojaveHao
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define BLOPHY_NEON 1
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define BLOPHY_SSE 1
+#endif
+
+// 混音内核：真机走NEON，x86模拟器走SSE，其它平台退回标量循环
+// 所有函数都是累加到output，不会覆盖已有内容
+
+// output[i] += src[i] * gain，声道数相同时的多声部叠加
+inline void mixAccumulate(float* output, const float* src, const int32_t numSamples, const float gain) {
+    int32_t i = 0;
+#if defined(BLOPHY_NEON)
+    const float32x4_t g = vdupq_n_f32(gain);
+    for (; i + 8 <= numSamples; i += 8) {
+        const float32x4_t a = vmlaq_f32(vld1q_f32(output + i), vld1q_f32(src + i), g);
+        const float32x4_t b = vmlaq_f32(vld1q_f32(output + i + 4), vld1q_f32(src + i + 4), g);
+        vst1q_f32(output + i, a);
+        vst1q_f32(output + i + 4, b);
+    }
+#elif defined(BLOPHY_SSE)
+    const __m128 g = _mm_set1_ps(gain);
+    for (; i + 8 <= numSamples; i += 8) {
+        const __m128 a = _mm_add_ps(_mm_loadu_ps(output + i), _mm_mul_ps(_mm_loadu_ps(src + i), g));
+        const __m128 b = _mm_add_ps(_mm_loadu_ps(output + i + 4), _mm_mul_ps(_mm_loadu_ps(src + i + 4), g));
+        _mm_storeu_ps(output + i, a);
+        _mm_storeu_ps(output + i + 4, b);
+    }
+#endif
+    for (; i < numSamples; i++) {
+        output[i] += src[i] * gain;
+    }
+}
+
+// 单声道源按左右各自的增益声像到立体声输出
+inline void mixMonoToStereoPanned(float* output, const float* src, const int32_t numFrames,
+                                  const float leftGain, const float rightGain) {
+    int32_t i = 0;
+#if defined(BLOPHY_NEON)
+    const float32x4_t left = vdupq_n_f32(leftGain);
+    const float32x4_t right = vdupq_n_f32(rightGain);
+    for (; i + 4 <= numFrames; i += 4) {
+        const float32x4_t mono = vld1q_f32(src + i);
+        float32x4x2_t frames = vld2q_f32(output + i * 2);
+        frames.val[0] = vmlaq_f32(frames.val[0], mono, left);
+        frames.val[1] = vmlaq_f32(frames.val[1], mono, right);
+        vst2q_f32(output + i * 2, frames);
+    }
+#elif defined(BLOPHY_SSE)
+    const __m128 gains = _mm_setr_ps(leftGain, rightGain, leftGain, rightGain);
+    for (; i + 4 <= numFrames; i += 4) {
+        const __m128 mono = _mm_loadu_ps(src + i);
+        const __m128 low = _mm_mul_ps(_mm_unpacklo_ps(mono, mono), gains);
+        const __m128 high = _mm_mul_ps(_mm_unpackhi_ps(mono, mono), gains);
+        _mm_storeu_ps(output + i * 2, _mm_add_ps(_mm_loadu_ps(output + i * 2), low));
+        _mm_storeu_ps(output + i * 2 + 4, _mm_add_ps(_mm_loadu_ps(output + i * 2 + 4), high));
+    }
+#endif
+    for (; i < numFrames; i++) {
+        output[i * 2] += src[i] * leftGain;
+        output[i * 2 + 1] += src[i] * rightGain;
+    }
+}
+
+// 立体声源按左右增益做平衡后叠加到立体声输出
+inline void mixStereoBalanced(float* output, const float* src, const int32_t numFrames,
+                              const float leftGain, const float rightGain) {
+    int32_t i = 0;
+#if defined(BLOPHY_NEON)
+    const float32x4_t gains = {leftGain, rightGain, leftGain, rightGain};
+    for (; i + 2 <= numFrames; i += 2) {
+        vst1q_f32(output + i * 2, vmlaq_f32(vld1q_f32(output + i * 2), vld1q_f32(src + i * 2), gains));
+    }
+#elif defined(BLOPHY_SSE)
+    const __m128 gains = _mm_setr_ps(leftGain, rightGain, leftGain, rightGain);
+    for (; i + 2 <= numFrames; i += 2) {
+        const __m128 scaled = _mm_mul_ps(_mm_loadu_ps(src + i * 2), gains);
+        _mm_storeu_ps(output + i * 2, _mm_add_ps(_mm_loadu_ps(output + i * 2), scaled));
+    }
+#endif
+    for (; i < numFrames; i++) {
+        output[i * 2] += src[i * 2] * leftGain;
+        output[i * 2 + 1] += src[i * 2 + 1] * rightGain;
+    }
+}
+
+// 6或8声道源按左右两行增益折叠后叠加到立体声输出，每帧两次点积
+template <int Inputs>
+inline void mixDownToStereo(float* output, const float* src, const int32_t numFrames, const float* leftGains,
+                            const float* rightGains, const float gain) {
+    static_assert(Inputs == 6 || Inputs == 8, "only 5.1 and 7.1 have a dedicated downmix kernel");
+    // 预乘音量，不足8路的部分补零
+    alignas(16) float left[8] = {};
+    alignas(16) float right[8] = {};
+    for (auto c = 0; c < Inputs; c++) {
+        left[c] = leftGains[c] * gain;
+        right[c] = rightGains[c] * gain;
+    }
+    int32_t i = 0;
+#if defined(BLOPHY_NEON)
+    const float32x4_t left0 = vld1q_f32(left);
+    const float32x4_t left1 = vld1q_f32(left + 4);
+    const float32x4_t right0 = vld1q_f32(right);
+    const float32x4_t right1 = vld1q_f32(right + 4);
+    for (; i < numFrames; i++) {
+        const float* frame = src + i * Inputs;
+        const float32x4_t low = vld1q_f32(frame);
+        // 6声道时后半只读两路，不越过本帧
+        const float32x4_t high = Inputs == 8 ? vld1q_f32(frame + 4) : vcombine_f32(vld1_f32(frame + 4), vdup_n_f32(0.0f));
+        const float32x4_t l = vmlaq_f32(vmulq_f32(low, left0), high, left1);
+        const float32x4_t r = vmlaq_f32(vmulq_f32(low, right0), high, right1);
+        const float32x2_t sums = vpadd_f32(vadd_f32(vget_low_f32(l), vget_high_f32(l)),
+                                           vadd_f32(vget_low_f32(r), vget_high_f32(r)));
+        vst1_f32(output + i * 2, vadd_f32(vld1_f32(output + i * 2), sums));
+    }
+#elif defined(BLOPHY_SSE)
+    const __m128 left0 = _mm_load_ps(left);
+    const __m128 left1 = _mm_load_ps(left + 4);
+    const __m128 right0 = _mm_load_ps(right);
+    const __m128 right1 = _mm_load_ps(right + 4);
+    for (; i < numFrames; i++) {
+        const float* frame = src + i * Inputs;
+        const __m128 low = _mm_loadu_ps(frame);
+        const __m128 high = Inputs == 8 ? _mm_loadu_ps(frame + 4) :
+                            _mm_loadl_pi(_mm_setzero_ps(), reinterpret_cast<const __m64*>(frame + 4));
+        const __m128 l = _mm_add_ps(_mm_mul_ps(low, left0), _mm_mul_ps(high, left1));
+        const __m128 r = _mm_add_ps(_mm_mul_ps(low, right0), _mm_mul_ps(high, right1));
+        // 先交错成[l0+l2, r0+r2, l1+l3, r1+r3]，再把高低两半相加得到左右两路的和
+        const __m128 pairs = _mm_add_ps(_mm_unpacklo_ps(l, r), _mm_unpackhi_ps(l, r));
+        const __m128 sums = _mm_add_ps(pairs, _mm_movehl_ps(pairs, pairs));
+        float* out = output + i * 2;
+        const __m128 mixed = _mm_add_ps(_mm_loadl_pi(_mm_setzero_ps(), reinterpret_cast<const __m64*>(out)), sums);
+        _mm_storel_pi(reinterpret_cast<__m64*>(out), mixed);
+    }
+#endif
+    for (; i < numFrames; i++) {
+        const float* frame = src + i * Inputs;
+        float l = 0.0f;
+        float r = 0.0f;
+        for (auto c = 0; c < Inputs; c++) {
+            l += frame[c] * left[c];
+            r += frame[c] * right[c];
+        }
+        output[i * 2] += l;
+        output[i * 2 + 1] += r;
+    }
+}
+
+// int16转float，乘以1/32768
+inline void convertInt16ToFloat(float* output, const int16_t* src, const int32_t numSamples) {
+    static constexpr float kScale = 1.0f / 32768.0f;
+    int32_t i = 0;
+#if defined(BLOPHY_NEON)
+    for (; i + 8 <= numSamples; i += 8) {
+        const int16x8_t samples = vld1q_s16(src + i);
+        vst1q_f32(output + i, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(samples))), kScale));
+        vst1q_f32(output + i + 4, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(samples))), kScale));
+    }
+#elif defined(BLOPHY_SSE)
+    const __m128 scale = _mm_set1_ps(kScale);
+    for (; i + 8 <= numSamples; i += 8) {
+        const __m128i samples = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        // 把16位放到高半部分再算术右移，完成符号扩展
+        const __m128i low = _mm_srai_epi32(_mm_unpacklo_epi16(samples, samples), 16);
+        const __m128i high = _mm_srai_epi32(_mm_unpackhi_epi16(samples, samples), 16);
+        _mm_storeu_ps(output + i, _mm_mul_ps(_mm_cvtepi32_ps(low), scale));
+        _mm_storeu_ps(output + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(high), scale));
+    }
+#endif
+    for (; i < numSamples; i++) {
+        output[i] = static_cast<float>(src[i]) * kScale;
+    }
+}
+
+// 统计一段采样的最小值、最大值和平方和，用于生成波形包络
+inline void accumulatePeaks(const float* src, const int32_t numSamples, float& minValue, float& maxValue,
+                            double& sumSquares) {
+    int32_t i = 0;
+    float low = minValue;
+    float high = maxValue;
+    float squares = 0.0f;
+#if defined(BLOPHY_NEON)
+    if (numSamples >= 4) {
+        float32x4_t lows = vdupq_n_f32(low);
+        float32x4_t highs = vdupq_n_f32(high);
+        float32x4_t sums = vdupq_n_f32(0.0f);
+        for (; i + 4 <= numSamples; i += 4) {
+            const float32x4_t samples = vld1q_f32(src + i);
+            lows = vminq_f32(lows, samples);
+            highs = vmaxq_f32(highs, samples);
+            sums = vmlaq_f32(sums, samples, samples);
+        }
+        const float32x2_t lowPair = vpmin_f32(vget_low_f32(lows), vget_high_f32(lows));
+        const float32x2_t highPair = vpmax_f32(vget_low_f32(highs), vget_high_f32(highs));
+        low = vget_lane_f32(vpmin_f32(lowPair, lowPair), 0);
+        high = vget_lane_f32(vpmax_f32(highPair, highPair), 0);
+        const float32x2_t sumPair = vadd_f32(vget_low_f32(sums), vget_high_f32(sums));
+        squares = vget_lane_f32(vpadd_f32(sumPair, sumPair), 0);
+    }
+#elif defined(BLOPHY_SSE)
+    if (numSamples >= 4) {
+        __m128 lows = _mm_set1_ps(low);
+        __m128 highs = _mm_set1_ps(high);
+        __m128 sums = _mm_setzero_ps();
+        for (; i + 4 <= numSamples; i += 4) {
+            const __m128 samples = _mm_loadu_ps(src + i);
+            lows = _mm_min_ps(lows, samples);
+            highs = _mm_max_ps(highs, samples);
+            sums = _mm_add_ps(sums, _mm_mul_ps(samples, samples));
+        }
+        alignas(16) float lanes[4];
+        _mm_store_ps(lanes, lows);
+        low = std::min(std::min(lanes[0], lanes[1]), std::min(lanes[2], lanes[3]));
+        _mm_store_ps(lanes, highs);
+        high = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+        _mm_store_ps(lanes, sums);
+        squares = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    }
+#endif
+    for (; i < numSamples; i++) {
+        low = std::min(low, src[i]);
+        high = std::max(high, src[i]);
+        squares += src[i] * src[i];
+    }
+    minValue = low;
+    maxValue = high;
+    sumSquares += squares;
+}
+
+// dot为a与b的内积，energy为b的平方和，用于时间伸缩的波形相似度搜索
+inline void correlate(const float* a, const float* b, const int32_t numSamples, float& dot, float& energy) {
+    int32_t i = 0;
+    float products = 0.0f;
+    float squares = 0.0f;
+#if defined(BLOPHY_NEON)
+    if (numSamples >= 4) {
+        float32x4_t dots = vdupq_n_f32(0.0f);
+        float32x4_t sums = vdupq_n_f32(0.0f);
+        for (; i + 4 <= numSamples; i += 4) {
+            const float32x4_t x = vld1q_f32(a + i);
+            const float32x4_t y = vld1q_f32(b + i);
+            dots = vmlaq_f32(dots, x, y);
+            sums = vmlaq_f32(sums, y, y);
+        }
+        const float32x2_t dotPair = vadd_f32(vget_low_f32(dots), vget_high_f32(dots));
+        products = vget_lane_f32(vpadd_f32(dotPair, dotPair), 0);
+        const float32x2_t sumPair = vadd_f32(vget_low_f32(sums), vget_high_f32(sums));
+        squares = vget_lane_f32(vpadd_f32(sumPair, sumPair), 0);
+    }
+#elif defined(BLOPHY_SSE)
+    if (numSamples >= 4) {
+        __m128 dots = _mm_setzero_ps();
+        __m128 sums = _mm_setzero_ps();
+        for (; i + 4 <= numSamples; i += 4) {
+            const __m128 x = _mm_loadu_ps(a + i);
+            const __m128 y = _mm_loadu_ps(b + i);
+            dots = _mm_add_ps(dots, _mm_mul_ps(x, y));
+            sums = _mm_add_ps(sums, _mm_mul_ps(y, y));
+        }
+        alignas(16) float lanes[4];
+        _mm_store_ps(lanes, dots);
+        products = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+        _mm_store_ps(lanes, sums);
+        squares = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    }
+#endif
+    for (; i < numSamples; i++) {
+        products += a[i] * b[i];
+        squares += b[i] * b[i];
+    }
+    dot = products;
+    energy = squares;
+}
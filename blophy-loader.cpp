@@ -0,0 +1,184 @@
+/*
+ * blophy-loader.cpp - Oboe Wrapper for C#
+ * Copyright (C) 2025  MojaveHao
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "blophy-loader.h"
+#include <algorithm>
+
+ClipLoader& ClipLoader::instance() {
+    static ClipLoader loader;
+    return loader;
+}
+
+ClipLoader::ClipLoader() :
+        m_stopping(false),
+        m_nextTicket(1),
+        m_callback(nullptr) {
+    // 先构造缓存，保证退出时它晚于工作线程析构
+    ClipCache::instance();
+}
+
+ClipLoader::~ClipLoader() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_condition.notify_all();
+    for (auto& worker : m_workers) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+}
+
+void ClipLoader::startWorkersLocked() {
+    if (!m_workers.empty()) {
+        return;
+    }
+    // 给游戏线程和音频线程留出核心，低端机上最多两个解码线程
+    const unsigned hardware = std::thread::hardware_concurrency();
+    const unsigned count = std::max(1u, std::min(2u, hardware > 2 ? hardware - 2 : 1u));
+    for (unsigned i = 0; i < count; i++) {
+        m_workers.emplace_back(&ClipLoader::workerLoop, this);
+    }
+}
+
+int32_t ClipLoader::load(const std::string& path, const void* owner, Completion onLoaded) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    startWorkersLocked();
+
+    const int32_t ticket = m_nextTicket++;
+    if (m_nextTicket <= 0) {
+        m_nextTicket = 1;
+    }
+    m_status[ticket] = LOAD_STATUS_PENDING;
+    if (owner) {
+        // 排队中的旧任务直接作废，已在解码的会在完成时发现票据过期
+        for (auto it = m_jobs.begin(); it != m_jobs.end();) {
+            if (it->owner == owner) {
+                finishLocked(it->ticket, LOAD_STATUS_CANCELLED);
+                it = m_jobs.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        m_latestTicket[owner] = ticket;
+    }
+    m_jobs.push_back({ticket, path, owner, std::move(onLoaded), nullptr});
+    m_condition.notify_one();
+    return ticket;
+}
+
+void ClipLoader::post(std::function<void()> task) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    startWorkersLocked();
+    m_jobs.push_back({0, std::string(), nullptr, nullptr, std::move(task)});
+    m_condition.notify_one();
+}
+
+void ClipLoader::cancel(const void* owner) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_latestTicket.erase(owner);
+        for (auto it = m_jobs.begin(); it != m_jobs.end();) {
+            if (it->owner == owner) {
+                finishLocked(it->ticket, LOAD_STATUS_CANCELLED);
+                it = m_jobs.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    // 等待可能正在执行的onLoaded退出
+    std::lock_guard<std::mutex> completion(m_completionMutex);
+}
+
+LoadStatus ClipLoader::getStatus(const int32_t ticket) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const auto it = m_status.find(ticket);
+    return it != m_status.end() ? it->second : LOAD_STATUS_INVALID;
+}
+
+void ClipLoader::setCallback(const LoadCallback callback) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_callback = callback;
+}
+
+void ClipLoader::finishLocked(const int32_t ticket, const LoadStatus status) {
+    m_status[ticket] = status;
+    m_finished.push_back(ticket);
+    while (m_finished.size() > kMaxFinishedTickets) {
+        m_status.erase(m_finished.front());
+        m_finished.pop_front();
+    }
+}
+
+void ClipLoader::workerLoop() {
+    for (;;) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [this] { return m_stopping || !m_jobs.empty(); });
+            if (m_stopping) {
+                return;
+            }
+            job = std::move(m_jobs.front());
+            m_jobs.pop_front();
+            if (!job.task) {
+                m_status[job.ticket] = LOAD_STATUS_LOADING;
+            }
+        }
+        if (job.task) {
+            job.task();
+            continue;
+        }
+
+        // 经由缓存解码，多个播放器同时加载同一文件时也只保留一份
+        auto clip = ClipCache::instance().acquire(job.path);
+
+        LoadStatus status = clip ? LOAD_STATUS_DONE : LOAD_STATUS_FAILED;
+        LoadCallback callback = nullptr;
+        {
+            std::lock_guard<std::mutex> completion(m_completionMutex);
+            bool current = true;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (job.owner) {
+                    const auto it = m_latestTicket.find(job.owner);
+                    current = it != m_latestTicket.end() && it->second == job.ticket;
+                    if (current) {
+                        m_latestTicket.erase(it);
+                    }
+                }
+            }
+
+            if (!current) {
+                status = LOAD_STATUS_CANCELLED;
+            } else if (clip && job.onLoaded) {
+                job.onLoaded(std::move(clip));
+            }
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            finishLocked(job.ticket, status);
+            callback = m_callback;
+        }
+
+        if (callback) {
+            callback(job.ticket, status);
+        }
+    }
+}
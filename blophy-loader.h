@@ -0,0 +1,92 @@
+/*
+ * blophy-loader.h - Oboe Wrapper for C#
+ * Copyright (C) 2025  MojaveHao
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "blophy-clip.h"
+#include "blophy-common.h"
+
+extern "C" typedef void (*LoadCallback)(int32_t ticket, LoadStatus status);
+
+// 后台解码线程池，文件读取和解码都不占用游戏线程
+class ClipLoader {
+    public:
+        using Completion = std::function<void(std::shared_ptr<const AudioClip>)>;
+
+        // 完成的票据最多保留这么多条状态，更早的会被遗忘
+        static constexpr size_t kMaxFinishedTickets = 1024;
+
+        static ClipLoader& instance();
+
+        ClipLoader(const ClipLoader&) = delete;
+        ClipLoader& operator=(const ClipLoader&) = delete;
+
+        // 提交加载任务并返回票据；同一owner的新任务会取消它尚未完成的旧任务
+        // onLoaded在工作线程上调用，只在解码成功且未被取消时执行
+        int32_t load(const std::string& path, const void* owner, Completion onLoaded);
+
+        // 取消owner的全部任务，返回时保证不会再有它的onLoaded在执行
+        void cancel(const void* owner);
+        // 在工作线程上执行一个不属于任何票据的后台任务，不产生加载状态，也不触发回调
+        void post(std::function<void()> task);
+
+        LoadStatus getStatus(int32_t ticket);
+        void setCallback(LoadCallback callback);
+
+    private:
+        struct Job {
+            int32_t ticket;
+            std::string path;
+            const void* owner;
+            Completion onLoaded;
+            // 非空时这是post提交的任务，其它字段不使用
+            std::function<void()> task;
+        };
+
+        ClipLoader();
+        ~ClipLoader();
+
+        void startWorkersLocked();
+        void workerLoop();
+        void finishLocked(int32_t ticket, LoadStatus status);
+
+        std::mutex m_mutex;
+        std::condition_variable m_condition;
+        std::deque<Job> m_jobs;
+        std::vector<std::thread> m_workers;
+        bool m_stopping;
+        int32_t m_nextTicket;
+        std::unordered_map<int32_t, LoadStatus> m_status;
+        std::deque<int32_t> m_finished;
+        // 每个owner当前有效的票据，旧票据完成时发现不一致即视为已取消
+        std::unordered_map<const void*, int32_t> m_latestTicket;
+        LoadCallback m_callback;
+
+        // 执行onLoaded期间持有，cancel借此等待正在执行的回调结束
+        std::mutex m_completionMutex;
+};
@@ -0,0 +1,1370 @@
+/*
+ * blophy-mixer.cpp - Oboe Wrapper for C#
+ * Copyright (C) 2025  MojaveHao
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "blophy-mixer.h"
+#include "blophy-kernels.h"
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+namespace {
+
+// 从片段的frame帧起读取samples个采样，int16片段顺带转换成float
+void readClipSamples(const AudioClip* clip, const int64_t frame, const int32_t samples, float* output) {
+    const size_t offset = static_cast<size_t>(frame) * clip->channels;
+    if (clip->format == CLIP_FORMAT_INT16) {
+        convertInt16ToFloat(output, clip->int16Data() + offset, samples);
+    } else {
+        std::copy_n(clip->floatData() + offset, samples, output);
+    }
+}
+
+} // namespace
+
+void GainRamp::reset(const float gain) {
+    value = gain;
+    target = gain;
+    step = 0.0f;
+    remaining = 0;
+}
+
+void GainRamp::start(const float targetGain, const int32_t frames, const GainRampCurve rampCurve) {
+    // 指数曲线到不了0，两端在约-80dB处截断，结束时再落到精确目标
+    static constexpr float kMinGain = 1e-4f;
+
+    target = targetGain;
+    curve = rampCurve;
+    if (frames <= 0 || value == target) {
+        reset(targetGain);
+        return;
+    }
+    remaining = frames;
+    if (curve == GAIN_RAMP_EXPONENTIAL) {
+        value = std::max(value, kMinGain);
+        step = std::pow(std::max(target, kMinGain) / value, 1.0f / static_cast<float>(frames));
+    } else {
+        step = (target - value) / static_cast<float>(frames);
+    }
+}
+
+float GainRamp::next() {
+    if (remaining <= 0) {
+        return value;
+    }
+    value = curve == GAIN_RAMP_EXPONENTIAL ? value * step : value + step;
+    if (--remaining == 0) {
+        value = target;
+    }
+    return value;
+}
+
+AudioVoice::AudioVoice() :
+        m_mixer(nullptr),
+        m_controlVolume(1.0f),
+        m_controlPan(0.0f),
+        m_controlBus(AUDIO_BUS_MUSIC),
+        m_controlLoop(false),
+        m_controlLoopStart(0),
+        m_controlLoopEnd(0),
+        m_pendingState(AUDIO_STATE_IDLE),
+        m_pendingSeekFrame(0),
+        m_seekCommand(0),
+        m_submittedCommands(0),
+        m_controlRate(1.0f),
+        m_controlRateMode(PLAYBACK_RATE_VARISPEED),
+        m_channels(0),
+        m_outputSampleRate(0),
+        m_resampleQuality(RESAMPLE_QUALITY_MEDIUM),
+        m_resamplerInputRate(0),
+        m_sampleRate(48000),
+        m_totalFrames(0),
+        m_appliedCommands(0),
+        m_state(AUDIO_STATE_IDLE),
+        m_playheadFrame(0),
+        m_volumeRamp{1.0f, 1.0f, 0.0f, 0, GAIN_RAMP_LINEAR},
+        m_fadeRamp{1.0f, 1.0f, 0.0f, 0, GAIN_RAMP_LINEAR},
+        m_pan(0.0f),
+        m_matrix(),
+        m_bus(AUDIO_BUS_MUSIC),
+        m_stopAfterFade(false),
+        m_scheduled(false),
+        m_scheduledFrame(0),
+        m_loop(false),
+        m_loopStart(0),
+        m_loopEnd(0),
+        m_loopCrossfade(0),
+        m_clip(nullptr),
+        m_stream(nullptr),
+        m_resampler(nullptr),
+        m_stretcher(nullptr),
+        m_playbackRate(1.0f),
+        m_stretchFrame(0),
+        m_stretchRestart(false),
+        m_timelineVersion(0),
+        m_anchorSeq(0),
+        m_anchorStreamFrame(0),
+        m_anchorVoiceFrame(0),
+        m_anchorVersion(0),
+        m_anchorPlaying(false),
+        m_anchorRate(1.0f) {
+}
+
+AudioVoice::~AudioVoice() {
+    // 此时声部已离开混音器，流式音轨可以直接交还解码线程
+    if (m_streamRef) {
+        StreamingService::instance().remove(m_streamRef.get());
+    }
+    for (const auto& retired : m_retiredSources) {
+        if (retired.stream) {
+            StreamingService::instance().remove(retired.stream.get());
+        }
+    }
+}
+
+void AudioVoice::setClip(std::shared_ptr<const AudioClip> clip) {
+    std::lock_guard<std::mutex> lock(m_controlMutex);
+    if (clip == m_clipRef && !m_streamRef) {
+        return;
+    }
+    replaceSourceLocked(std::move(clip), nullptr);
+}
+
+void AudioVoice::setStream(std::shared_ptr<StreamSource> stream) {
+    std::lock_guard<std::mutex> lock(m_controlMutex);
+    if (stream == m_streamRef) {
+        return;
+    }
+    if (stream) {
+        StreamingService::instance().add(stream);
+    }
+    replaceSourceLocked(nullptr, std::move(stream));
+}
+
+void AudioVoice::replaceSourceLocked(std::shared_ptr<const AudioClip> clip, std::shared_ptr<StreamSource> stream) {
+    const int sampleRate = clip ? clip->sampleRate : (stream ? stream->sampleRate() : 48000);
+    const int channels = clip ? clip->channels : (stream ? stream->channels() : 0);
+    // 重采样器和时间伸缩器随片段一起切换，音频线程不会看到声道数不匹配的组合
+    auto resampler = makeResamplerLocked(sampleRate, channels);
+    auto stretcher = makeStretcherLocked(sampleRate, channels);
+
+    m_pendingState.store(getState());
+    const uint32_t index = submitLocked({VoiceCommandType::SetClip, 0, 0.0f, clip.get(), stream.get(),
+                                         resampler.get(), GAIN_RAMP_LINEAR, 0, stretcher.get()});
+    if (index == 0) {
+        if (stream) {
+            StreamingService::instance().remove(stream.get());
+        }
+        return;
+    }
+
+    m_sampleRate.store(sampleRate);
+    m_totalFrames.store(clip ? clip->totalFrames : (stream ? stream->totalFrames() : 0));
+    m_channels = channels;
+    m_resamplerInputRate = resampler ? effectiveInputRateLocked(sampleRate) : 0;
+    if (m_clipRef || m_streamRef || m_resamplerRef || m_stretcherRef) {
+        m_retiredSources.push_back({index, std::move(m_clipRef), std::move(m_streamRef), std::move(m_resamplerRef),
+                                    std::move(m_stretcherRef)});
+    }
+    m_clipRef = std::move(clip);
+    m_streamRef = std::move(stream);
+    m_resamplerRef = std::move(resampler);
+    m_stretcherRef = std::move(stretcher);
+    releaseRetiredSourcesLocked();
+}
+
+int AudioVoice::effectiveInputRateLocked(const int inputRate) const {
+    // 变速模式把片段当作以倍率后的采样率录制，由重采样器一并完成变速
+    if (m_controlRateMode.load() != PLAYBACK_RATE_VARISPEED) {
+        return inputRate;
+    }
+    return static_cast<int>(std::lround(static_cast<double>(inputRate) * m_controlRate.load()));
+}
+
+std::unique_ptr<Resampler> AudioVoice::makeResamplerLocked(const int inputRate, const int channels) const {
+    const int rate = effectiveInputRateLocked(inputRate);
+    if (m_outputSampleRate <= 0 || rate == m_outputSampleRate || channels <= 0) {
+        return nullptr;
+    }
+    if (channels > kMaxResampleChannels) {
+        LOGW("Cannot resample %d channels, playing at %d Hz without conversion", channels, inputRate);
+        return nullptr;
+    }
+    const auto quality = static_cast<Resampler::Quality>(m_resampleQuality.load());
+    return std::unique_ptr<Resampler>(Resampler::make(channels, rate, m_outputSampleRate, quality));
+}
+
+std::unique_ptr<TimeStretcher> AudioVoice::makeStretcherLocked(const int inputRate, const int channels) const {
+    const float rate = m_controlRate.load();
+    if (m_controlRateMode.load() != PLAYBACK_RATE_PRESERVE_PITCH || rate == 1.0f || channels <= 0 || inputRate <= 0) {
+        return nullptr;
+    }
+    if (channels > TimeStretcher::kMaxChannels) {
+        LOGW("Cannot time-stretch %d channels, playing at normal speed", channels);
+        return nullptr;
+    }
+    return std::make_unique<TimeStretcher>(channels, inputRate, rate);
+}
+
+void AudioVoice::updateResamplerLocked() {
+    const int inputRate = m_sampleRate.load();
+    auto resampler = makeResamplerLocked(inputRate, m_channels);
+    if (!resampler && !m_resamplerRef) {
+        return;
+    }
+    m_pendingState.store(getState());
+    const uint32_t index = submitLocked({VoiceCommandType::SetResampler, 0, 0.0f, nullptr, nullptr, resampler.get()});
+    if (index == 0) {
+        return;
+    }
+    m_resamplerInputRate = resampler ? effectiveInputRateLocked(inputRate) : 0;
+    if (m_resamplerRef) {
+        m_retiredSources.push_back({index, nullptr, nullptr, std::move(m_resamplerRef)});
+    }
+    m_resamplerRef = std::move(resampler);
+    releaseRetiredSourcesLocked();
+}
+
+void AudioVoice::setOutputSampleRate(const int sampleRate) {
+    std::lock_guard<std::mutex> lock(m_controlMutex);
+    if (sampleRate == m_outputSampleRate) {
+        return;
+    }
+    m_outputSampleRate = sampleRate;
+    updateResamplerLocked();
+}
+
+void AudioVoice::setResampleQuality(const ResampleQuality quality) {
+    std::lock_guard<std::mutex> lock(m_controlMutex);
+    if (quality == m_resampleQuality.load()) {
+        return;
+    }
+    m_resampleQuality.store(quality);
+    if (m_resamplerRef) {
+        updateResamplerLocked();
+    }
+}
+
+ResampleQuality AudioVoice::getResampleQuality() const {
+    return m_resampleQuality.load();
+}
+
+void AudioVoice::setPlaybackRate(const float rate, const PlaybackRateMode mode) {
+    const float clamped = std::max(TimeStretcher::kMinTempo, std::min(rate, TimeStretcher::kMaxTempo));
+    std::lock_guard<std::mutex> lock(m_controlMutex);
+    if (clamped == m_controlRate.load() && mode == m_controlRateMode.load()) {
+        return;
+    }
+    m_controlRate.store(clamped);
+    m_controlRateMode.store(mode);
+
+    // 等效输入采样率不变时沿用原重采样器，只有变速模式下改倍率才需要重建
+    const int inputRate = m_sampleRate.load();
+    const int effectiveRate = effectiveInputRateLocked(inputRate);
+    std::unique_ptr<Resampler> resampler;
+    Resampler* nextResampler = m_resamplerRef.get();
+    if (m_resamplerRef ? m_resamplerInputRate != effectiveRate : effectiveRate != m_outputSampleRate) {
+        resampler = makeResamplerLocked(inputRate, m_channels);
+        nextResampler = resampler.get();
+    }
+    // 保持音高模式下改倍率复用已有的伸缩器，音频线程只更新速度
+    std::unique_ptr<TimeStretcher> stretcher;
+    TimeStretcher* nextStretcher = nullptr;
+    if (mode == PLAYBACK_RATE_PRESERVE_PITCH && clamped != 1.0f) {
+        if (!m_stretcherRef) {
+            stretcher = makeStretcherLocked(inputRate, m_channels);
+        }
+        nextStretcher = stretcher ? stretcher.get() : m_stretcherRef.get();
+    }
+
+    m_pendingState.store(getState());
+    const uint32_t index = submitLocked({VoiceCommandType::SetRate, 0, clamped, nullptr, nullptr, nextResampler,
+                                         GAIN_RAMP_LINEAR, 0, nextStretcher});
+    if (index == 0) {
+        return;
+    }
+    std::unique_ptr<Resampler> oldResampler;
+    if (nextResampler != m_resamplerRef.get()) {
+        m_resamplerInputRate = nextResampler ? effectiveRate : 0;
+        oldResampler = std::move(m_resamplerRef);
+        m_resamplerRef = std::move(resampler);
+    }
+    std::unique_ptr<TimeStretcher> oldStretcher;
+    if (nextStretcher != m_stretcherRef.get()) {
+        oldStretcher = std::move(m_stretcherRef);
+        m_stretcherRef = std::move(stretcher);
+    }
+    if (oldResampler || oldStretcher) {
+        m_retiredSources.push_back({index, nullptr, nullptr, std::move(oldResampler), std::move(oldStretcher)});
+    }
+    releaseRetiredSourcesLocked();
+}
+
+float AudioVoice::getPlaybackRate() const {
+    return m_controlRate.load();
+}
+
+PlaybackRateMode AudioVoice::getPlaybackRateMode() const {
+    return m_controlRateMode.load();
+}
+
+void AudioVoice::releaseRetiredSourcesLocked() {
+    const uint32_t applied = m_appliedCommands.load(std::memory_order_acquire);
+    m_retiredSources.erase(
+        std::remove_if(m_retiredSources.begin(), m_retiredSources.end(),
+                       [applied](const RetiredSource& retired) {
+                           if (static_cast<int32_t>(applied - retired.command) < 0) {
+                               return false;
+                           }
+                           if (retired.stream) {
+                               StreamingService::instance().remove(retired.stream.get());
+                           }
+                           return true;
+                       }),
+        m_retiredSources.end());
+}
+
+AudioState AudioVoice::nextState(const AudioState state, const VoiceCommandType type) {
+    switch (type) {
+        case VoiceCommandType::Play:
+            return AUDIO_STATE_PLAYING;
+        case VoiceCommandType::Pause:
+            return state == AUDIO_STATE_PLAYING ? AUDIO_STATE_PAUSED : state;
+        case VoiceCommandType::Unpause:
+            return state == AUDIO_STATE_PAUSED ? AUDIO_STATE_PLAYING : state;
+        case VoiceCommandType::Stop:
+            return state == AUDIO_STATE_IDLE ? state : AUDIO_STATE_STOPPED;
+        case VoiceCommandType::FadeIn:
+        case VoiceCommandType::PlayAt:
+            return AUDIO_STATE_PLAYING;
+        case VoiceCommandType::FadeOut:
+            // 播放中要等淡出结束才停止
+            if (state == AUDIO_STATE_PLAYING) {
+                return state;
+            }
+            return state == AUDIO_STATE_IDLE ? state : AUDIO_STATE_STOPPED;
+        default:
+            return state;
+    }
+}
+
+uint32_t AudioVoice::submitLocked(const VoiceCommand& command) {
+    // 先计数再入队，保证已应用数永远不超过已提交数
+    const uint32_t index = m_submittedCommands.fetch_add(1) + 1;
+    if (!m_commands.push(command)) {
+        m_submittedCommands.fetch_sub(1);
+        LOGW("Voice command queue full, dropped command %d", static_cast<int>(command.type));
+        return 0;
+    }
+
+    if (AudioMixer* mixer = m_mixer.load()) {
+        mixer->flushIfIdle();
+    } else {
+        // 没有加入混音器时不存在音频线程，直接在此应用
+        drainCommands();
+    }
+    if (!m_retiredSources.empty()) {
+        releaseRetiredSourcesLocked();
+    }
+    return index;
+}
+
+void AudioVoice::play() {
+    std::lock_guard<std::mutex> lock(m_controlMutex);
+    m_pendingState.store(nextState(getState(), VoiceCommandType::Play));
+    submitLocked({VoiceCommandType::Play, 0, 0.0f});
+}
+
+void AudioVoice::playAtFrame(const int64_t streamFrame) {
+    std::lock_guard<std::mutex> lock(m_controlMutex);
+    m_pendingState.store(nextState(getState(), VoiceCommandType::PlayAt));
+    submitLocked({VoiceCommandType::PlayAt, streamFrame, 0.0f});
+}
+
+void AudioVoice::pause() {
+    std::lock_guard<std::mutex> lock(m_controlMutex);
+    m_pendingState.store(nextState(getState(), VoiceCommandType::Pause));
+    submitLocked({VoiceCommandType::Pause, 0, 0.0f});
+}
+
+void AudioVoice::stop() {
+    std::lock_guard<std::mutex> lock(m_controlMutex);
+    const AudioState state = nextState(getState(), VoiceCommandType::Stop);
+    m_pendingState.store(state);
+    if (state != AUDIO_STATE_STOPPED) {
+        submitLocked({VoiceCommandType::Stop, 0, 0.0f});
+        return;
+    }
+    // 停止会把播放头归零，按一次跳转处理
+    m_pendingSeekFrame.store(0);
+    if (const uint32_t index = submitLocked({VoiceCommandType::Stop, 0, 0.0f})) {
+        m_seekCommand.store(index);
+    }
+}
+
+void AudioVoice::unpause() {
+    std::lock_guard<std::mutex> lock(m_controlMutex);
+    m_pendingState.store(nextState(getState(), VoiceCommandType::Unpause));
+    submitLocked({VoiceCommandType::Unpause, 0, 0.0f});
+}
+
+void AudioVoice::markStopped() {
+    m_state.store(AUDIO_STATE_STOPPED, std::memory_order_release);
+}
+
+void AudioVoice::rescaleStreamClock(const double ratio) {
+    if (m_scheduled) {
+        m_scheduledFrame = std::llround(static_cast<double>(m_scheduledFrame) * ratio);
+    }
+    // 锚点要到新流的第一次回调才会重新发布，在此之前的位置查询也要落在新的时钟上
+    TimelineAnchor anchor{};
+    if (readAnchor(anchor) && anchor.timelineVersion == m_timelineVersion.load(std::memory_order_relaxed)) {
+        publishAnchor(std::llround(static_cast<double>(anchor.streamFrame) * ratio), anchor.voiceFrame,
+                      anchor.playing);
+    }
+}
+
+float AudioVoice::getCurrentTime() const {
+    return static_cast<float>(static_cast<double>(getCurrentFrame()) / m_sampleRate.load());
+}
+
+void AudioVoice::setCurrentTime(const float time) {
+    setCurrentFrame(std::llround(static_cast<double>(time) * m_sampleRate.load()));
+}
+
+int64_t AudioVoice::getCurrentFrame() const {
+    if (isSeekPending()) {
+        return m_pendingSeekFrame.load();
+    }
+    return m_playheadFrame.load(std::memory_order_acquire);
+}
+
+void AudioVoice::setCurrentFrame(const int64_t frame) {
+    std::lock_guard<std::mutex> lock(m_controlMutex);
+    const int64_t target = std::max<int64_t>(0, std::min(frame, m_totalFrames.load()));
+    m_pendingState.store(getState());
+    m_pendingSeekFrame.store(target);
+    if (const uint32_t index = submitLocked({VoiceCommandType::Seek, target, 0.0f})) {
+        m_seekCommand.store(index);
+    }
+}
+
+bool AudioVoice::isSeekPending() const {
+    return static_cast<int32_t>(m_appliedCommands.load(std::memory_order_acquire) - m_seekCommand.load()) < 0;
+}
+
+void AudioVoice::setVolume(const float volume) {
+    rampVolume(volume, kVolumeSmoothingMs, GAIN_RAMP_LINEAR);
+}
+
+void AudioVoice::rampVolume(const float volume, const int32_t durationMs, const GainRampCurve curve) {
+    std::lock_guard<std::mutex> lock(m_controlMutex);
+    const float clamped = std::max(0.0f, std::min(1.0f, volume));
+    m_controlVolume.store(clamped);
+    m_pendingState.store(getState());
+    submitLocked({VoiceCommandType::SetVolume, msToFramesLocked(durationMs), clamped, nullptr, nullptr, nullptr, curve});
+}
+
+void AudioVoice::fadeIn(const int32_t durationMs) {
+    std::lock_guard<std::mutex> lock(m_controlMutex);
+    m_pendingState.store(nextState(getState(), VoiceCommandType::FadeIn));
+    submitLocked({VoiceCommandType::FadeIn, msToFramesLocked(durationMs), 1.0f, nullptr, nullptr, nullptr,
+                  GAIN_RAMP_EXPONENTIAL});
+}
+
+void AudioVoice::fadeOut(const int32_t durationMs) {
+    std::lock_guard<std::mutex> lock(m_controlMutex);
+    const AudioState state = nextState(getState(), VoiceCommandType::FadeOut);
+    m_pendingState.store(state);
+    const uint32_t index = submitLocked({VoiceCommandType::FadeOut, msToFramesLocked(durationMs), 0.0f, nullptr,
+                                         nullptr, nullptr, GAIN_RAMP_EXPONENTIAL});
+    if (index != 0 && state == AUDIO_STATE_STOPPED) {
+        // 没有在播放时淡出立即停止并归零，和stop一样按跳转处理
+        m_pendingSeekFrame.store(0);
+        m_seekCommand.store(index);
+    }
+}
+
+int32_t AudioVoice::msToFramesLocked(const int32_t durationMs) const {
+    // 渐变按输出帧推进，输出采样率未知时退回片段采样率
+    const int rate = m_outputSampleRate > 0 ? m_outputSampleRate : m_sampleRate.load();
+    const int64_t frames = static_cast<int64_t>(std::max(0, durationMs)) * rate / 1000;
+    return static_cast<int32_t>(std::min<int64_t>(frames, INT32_MAX));
+}
+
+float AudioVoice::getVolume() const {
+    return m_controlVolume.load();
+}
+
+void AudioVoice::setPan(const float pan) {
+    std::lock_guard<std::mutex> lock(m_controlMutex);
+    const float clamped = std::max(-1.0f, std::min(1.0f, pan));
+    m_controlPan.store(clamped);
+    m_pendingState.store(getState());
+    submitLocked({VoiceCommandType::SetPan, 0, clamped});
+}
+
+float AudioVoice::getPan() const {
+    return m_controlPan.load();
+}
+
+void AudioVoice::setBus(const AudioBus bus) {
+    if (bus < AUDIO_BUS_MUSIC || bus >= AUDIO_BUS_MASTER) {
+        LOGW("Voices can only be routed to the music, SFX or UI bus, got %d", static_cast<int>(bus));
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_controlMutex);
+    m_controlBus.store(bus);
+    m_pendingState.store(getState());
+    submitLocked({VoiceCommandType::SetBus, bus});
+}
+
+AudioBus AudioVoice::getBus() const {
+    return m_controlBus.load();
+}
+
+void AudioVoice::setLoop(const bool loop) {
+    std::lock_guard<std::mutex> lock(m_controlMutex);
+    m_controlLoop.store(loop);
+    m_pendingState.store(getState());
+    submitLocked({VoiceCommandType::SetLoop, 0, loop ? 1.0f : 0.0f});
+}
+
+bool AudioVoice::getLoop() const {
+    return m_controlLoop.load();
+}
+
+void AudioVoice::setLoopRegion(const int64_t startFrame, const int64_t endFrame, const int32_t crossfadeMs) {
+    const int64_t start = std::max<int64_t>(0, startFrame);
+    const int64_t end = std::max<int64_t>(0, endFrame);
+    if (end > 0 && end <= start) {
+        LOGW("Invalid loop region [%lld, %lld)", static_cast<long long>(start), static_cast<long long>(end));
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_controlMutex);
+    m_controlLoopStart.store(start);
+    m_controlLoopEnd.store(end);
+    // 交叉淡化在片段帧上进行，按片段采样率换算
+    const int64_t crossfade = static_cast<int64_t>(std::max(0, crossfadeMs)) * m_sampleRate.load() / 1000;
+    m_pendingState.store(getState());
+    submitLocked({VoiceCommandType::SetLoopRegion, start, static_cast<float>(crossfade), nullptr, nullptr, nullptr,
+                  GAIN_RAMP_LINEAR, end});
+}
+
+int64_t AudioVoice::getLoopStartFrame() const {
+    return m_controlLoopStart.load();
+}
+
+int64_t AudioVoice::getLoopEndFrame() const {
+    return m_controlLoopEnd.load();
+}
+
+AudioState AudioVoice::getState() const {
+    if (m_appliedCommands.load(std::memory_order_acquire) != m_submittedCommands.load()) {
+        return m_pendingState.load();
+    }
+    return m_state.load(std::memory_order_acquire);
+}
+
+int AudioVoice::getSampleRate() const {
+    return m_sampleRate.load();
+}
+
+float AudioVoice::getMusicLength() const {
+    return static_cast<float>(static_cast<double>(m_totalFrames.load()) / m_sampleRate.load());
+}
+
+uint32_t AudioVoice::getTimelineVersion() const {
+    return m_timelineVersion.load();
+}
+
+bool AudioVoice::readAnchor(TimelineAnchor& anchor) const {
+    for (auto attempt = 0; attempt < 16; attempt++) {
+        const uint32_t seq = m_anchorSeq.load(std::memory_order_acquire);
+        if (seq == 0) {
+            // 还没有发布过锚点
+            return false;
+        }
+        if (seq & 1u) {
+            // 正在写入，重试
+            continue;
+        }
+        anchor.streamFrame = m_anchorStreamFrame.load(std::memory_order_relaxed);
+        anchor.voiceFrame = m_anchorVoiceFrame.load(std::memory_order_relaxed);
+        anchor.timelineVersion = m_anchorVersion.load(std::memory_order_relaxed);
+        anchor.playing = m_anchorPlaying.load(std::memory_order_relaxed);
+        anchor.playbackRate = m_anchorRate.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (m_anchorSeq.load(std::memory_order_relaxed) == seq) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void AudioVoice::publishAnchor(const int64_t streamFrame, const int64_t voiceFrame, const bool playing) {
+    m_anchorSeq.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    m_anchorStreamFrame.store(streamFrame, std::memory_order_relaxed);
+    m_anchorVoiceFrame.store(voiceFrame, std::memory_order_relaxed);
+    m_anchorVersion.store(m_timelineVersion.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    m_anchorPlaying.store(playing, std::memory_order_relaxed);
+    m_anchorRate.store(m_playbackRate, std::memory_order_relaxed);
+    m_anchorSeq.fetch_add(1, std::memory_order_release);
+}
+
+void AudioVoice::drainCommands() {
+    VoiceCommand command{};
+    while (m_commands.pop(command)) {
+        applyCommand(command);
+        m_appliedCommands.fetch_add(1, std::memory_order_release);
+    }
+}
+
+void AudioVoice::applyCommand(const VoiceCommand& command) {
+    const AudioState state = m_state.load(std::memory_order_relaxed);
+    switch (command.type) {
+        case VoiceCommandType::Play:
+        case VoiceCommandType::FadeIn:
+        case VoiceCommandType::PlayAt:
+            // 预约起播在回调中按帧对齐；普通播放会取消尚未到达的预约
+            m_scheduled = command.type == VoiceCommandType::PlayAt;
+            m_scheduledFrame = command.frame;
+            // 自然播完后再次播放从头开始，便于快速重试，无需先Stop
+            if (state == AUDIO_STATE_STOPPED && sourceFinished()) {
+                m_playheadFrame.store(0, std::memory_order_release);
+                m_timelineVersion.fetch_add(1, std::memory_order_relaxed);
+                m_stretchRestart = true;
+                if (m_stream) {
+                    m_stream->requestSeek(0);
+                }
+            }
+            if (command.type == VoiceCommandType::FadeIn) {
+                // 正在播放时从当前增益继续淡入，避免先跳到静音
+                if (state != AUDIO_STATE_PLAYING) {
+                    m_fadeRamp.reset(0.0f);
+                }
+                m_fadeRamp.start(1.0f, static_cast<int32_t>(command.frame), command.curve);
+                m_stopAfterFade = false;
+            } else if (m_stopAfterFade) {
+                // 淡出途中重新播放：取消淡出，直接恢复原音量
+                m_stopAfterFade = false;
+                m_fadeRamp.reset(1.0f);
+            }
+            break;
+        case VoiceCommandType::FadeOut:
+            if (state == AUDIO_STATE_PLAYING) {
+                m_fadeRamp.start(0.0f, static_cast<int32_t>(command.frame), command.curve);
+                m_stopAfterFade = true;
+            } else if (state != AUDIO_STATE_IDLE) {
+                applyStop();
+            }
+            break;
+        case VoiceCommandType::Pause:
+            m_scheduled = false;
+            break;
+        case VoiceCommandType::Stop:
+            if (state != AUDIO_STATE_IDLE) {
+                applyStop();
+            }
+            break;
+        case VoiceCommandType::Seek:
+            m_playheadFrame.store(command.frame, std::memory_order_release);
+            m_timelineVersion.fetch_add(1, std::memory_order_relaxed);
+            m_stretchRestart = true;
+            if (m_stream) {
+                m_stream->requestSeek(command.frame);
+            }
+            break;
+        case VoiceCommandType::SetVolume:
+            m_volumeRamp.start(command.value, static_cast<int32_t>(command.frame), command.curve);
+            break;
+        case VoiceCommandType::SetPan:
+            m_pan = command.value;
+            // 下次混音时按新的声像重建矩阵
+            m_matrix.inputs = 0;
+            break;
+        case VoiceCommandType::SetBus:
+            m_bus = static_cast<AudioBus>(command.frame);
+            break;
+        case VoiceCommandType::SetLoop:
+            m_loop = command.value != 0.0f;
+            if (m_stream) {
+                m_stream->setLoop(m_loop);
+            }
+            break;
+        case VoiceCommandType::SetLoopRegion:
+            m_loopStart = command.frame;
+            m_loopEnd = command.endFrame;
+            m_loopCrossfade = static_cast<int64_t>(command.value);
+            if (m_stream) {
+                m_stream->setLoopRegion(m_loopStart, m_loopEnd);
+            }
+            break;
+        case VoiceCommandType::SetClip: {
+            // 换片段后播放头保持原位，但不能越过新片段的结尾
+            m_clip = command.clip;
+            m_stream = command.stream;
+            const int64_t frames = m_clip ? m_clip->totalFrames : (m_stream ? m_stream->totalFrames() : 0);
+            const int64_t frame = std::min(m_playheadFrame.load(std::memory_order_relaxed), frames);
+            m_playheadFrame.store(frame, std::memory_order_release);
+            m_timelineVersion.fetch_add(1, std::memory_order_relaxed);
+            m_resampler = command.resampler;
+            m_stretcher = command.stretcher;
+            m_stretchRestart = true;
+            if (m_stream) {
+                m_stream->setLoop(m_loop);
+                m_stream->setLoopRegion(m_loopStart, m_loopEnd);
+                if (frame > 0) {
+                    m_stream->requestSeek(frame);
+                }
+            }
+            break;
+        }
+        case VoiceCommandType::SetResampler:
+            m_resampler = command.resampler;
+            break;
+        case VoiceCommandType::SetRate:
+            m_playbackRate = command.value;
+            m_resampler = command.resampler;
+            if (command.stretcher != m_stretcher) {
+                // 换用或停用伸缩器时从上报的播放头接着读，预读的部分丢弃
+                m_stretcher = command.stretcher;
+                m_stretchRestart = true;
+            }
+            if (m_stretcher) {
+                m_stretcher->setTempo(command.value);
+            }
+            break;
+        default:
+            break;
+    }
+    m_state.store(nextState(state, command.type), std::memory_order_release);
+}
+
+void AudioVoice::applyStop() {
+    m_scheduled = false;
+    m_playheadFrame.store(0, std::memory_order_release);
+    m_timelineVersion.fetch_add(1, std::memory_order_relaxed);
+    m_stretchRestart = true;
+    if (m_stream) {
+        m_stream->requestSeek(0);
+    }
+    m_stopAfterFade = false;
+    m_fadeRamp.reset(1.0f);
+}
+
+bool AudioVoice::sourceFinished() const {
+    if (m_stream) {
+        return m_stream->isFinished();
+    }
+    return m_clip && m_playheadFrame.load(std::memory_order_relaxed) >= m_clip->totalFrames;
+}
+
+AudioVoice::LoopSpan AudioVoice::loopSpan(const int64_t frame, const int64_t totalFrames) const {
+    LoopSpan span{0, totalFrames, 0};
+    if (!m_loop) {
+        return span;
+    }
+    if (m_loopStart < totalFrames) {
+        span.start = m_loopStart;
+    }
+    if (m_loopEnd > span.start && m_loopEnd < totalFrames && frame <= m_loopEnd) {
+        span.end = m_loopEnd;
+    }
+    // 淡化区不超过区间的一半，跳回后的位置不会再落进淡化区之后
+    span.crossfade = std::min(m_loopCrossfade, (span.end - span.start) / 2);
+    return span;
+}
+
+void AudioVoice::render(float* output, int32_t numFrames, const int32_t outputChannels, int64_t streamFrame) {
+    int64_t frame = m_playheadFrame.load(std::memory_order_relaxed);
+    const AudioClip* clip = m_clip;
+    const bool playing = m_state.load(std::memory_order_relaxed) == AUDIO_STATE_PLAYING &&
+                         ((clip && clip->totalFrames > 0) || m_stream);
+    if (playing && m_scheduled) {
+        const int64_t offset = m_scheduledFrame - streamFrame;
+        if (offset >= numFrames) {
+            // 还没到起播帧：锚点直接指向起播时刻，位置查询在此之前会得到负值并被截到0
+            publishAnchor(m_scheduledFrame, frame, true);
+            return;
+        }
+        m_scheduled = false;
+        if (offset < 0) {
+            if (AudioMixer* mixer = m_mixer.load(std::memory_order_relaxed)) {
+                mixer->stats().recordLateCommand();
+            }
+        } else if (offset > 0) {
+            // 起播帧落在本缓冲中间，前面的部分保持静音
+            output += offset * outputChannels;
+            numFrames -= static_cast<int32_t>(offset);
+            streamFrame += offset;
+        }
+    }
+    publishAnchor(streamFrame, frame, playing);
+    if (!playing) {
+        return;
+    }
+
+    if (m_stretcher) {
+        renderStretched(output, numFrames, outputChannels);
+    } else if (m_resampler) {
+        renderResampled(output, numFrames, outputChannels, frame);
+    } else if (m_stream) {
+        renderStream(output, numFrames, outputChannels, frame);
+    } else {
+        renderClip(output, numFrames, outputChannels, frame);
+    }
+
+    if (m_stopAfterFade && !m_fadeRamp.active()) {
+        // 淡出已经到零，停止并回到开头
+        applyStop();
+        m_state.store(AUDIO_STATE_STOPPED, std::memory_order_release);
+    }
+}
+
+void AudioVoice::renderClip(float* output, const int32_t numFrames, const int32_t outputChannels, int64_t frame) {
+    const AudioClip* clip = m_clip;
+    int32_t written = 0;
+
+    // 按循环边界和淡化区把缓冲切成整段处理，不逐采样判断回绕
+    const int64_t totalFrames = clip->totalFrames;
+    while (written < numFrames) {
+        LoopSpan span = loopSpan(frame, totalFrames);
+        if (frame >= span.end) {
+            if (!m_loop) {
+                // 非循环：剩余部分保持静音，播放完毕
+                frame = totalFrames;
+                m_state.store(AUDIO_STATE_STOPPED, std::memory_order_release);
+                break;
+            }
+            // 循环播放：跳回区间起点无缝继续，交叉淡化时起点后的一段已经在淡化区里播过
+            frame = span.start + span.crossfade;
+            m_timelineVersion.fetch_add(1, std::memory_order_relaxed);
+            span = loopSpan(frame, totalFrames);
+        }
+
+        const int64_t fadeBegin = span.end - span.crossfade;
+        int32_t frames = 0;
+        if (span.crossfade > 0 && frame >= fadeBegin) {
+            frames = static_cast<int32_t>(std::min<int64_t>(numFrames - written, span.end - frame));
+            mixCrossfade(output + written * outputChannels, clip, span, frame, frames, outputChannels);
+        } else {
+            frames = static_cast<int32_t>(std::min<int64_t>(numFrames - written, fadeBegin - frame));
+            if (clip->format == CLIP_FORMAT_INT16) {
+                mixFrames(output + written * outputChannels, clip->int16Data() + frame * clip->channels,
+                          clip->channels, frames, outputChannels);
+            } else {
+                mixFrames(output + written * outputChannels, clip->floatData() + frame * clip->channels,
+                          clip->channels, frames, outputChannels);
+            }
+        }
+        written += frames;
+        frame += frames;
+    }
+
+    m_playheadFrame.store(frame, std::memory_order_release);
+}
+
+void AudioVoice::mixCrossfade(float* output, const AudioClip* clip, const LoopSpan& span, int64_t tailFrame,
+                              const int32_t numFrames, const int32_t outputChannels) {
+    // 片段自身的首尾高度相关，按等幅线性加权即可保持响度
+    static constexpr int32_t kCrossfadeSamples = 512;
+    alignas(16) float tail[kCrossfadeSamples];
+    alignas(16) float head[kCrossfadeSamples];
+    const int32_t channels = clip->channels;
+    const int32_t chunkFrames = std::max(1, kCrossfadeSamples / channels);
+    const float step = 1.0f / static_cast<float>(span.crossfade);
+    int64_t position = tailFrame - (span.end - span.crossfade);
+
+    for (auto done = 0; done < numFrames;) {
+        const int32_t frames = std::min(chunkFrames, numFrames - done);
+        const int32_t samples = frames * channels;
+        readClipSamples(clip, tailFrame, samples, tail);
+        readClipSamples(clip, span.start + position, samples, head);
+        for (auto i = 0; i < frames; i++) {
+            const float weight = static_cast<float>(position + i) * step;
+            float* frame = tail + i * channels;
+            const float* headFrame = head + i * channels;
+            for (auto c = 0; c < channels; c++) {
+                frame[c] += (headFrame[c] - frame[c]) * weight;
+            }
+        }
+        mixFrames(output, tail, channels, frames, outputChannels);
+        output += frames * outputChannels;
+        tailFrame += frames;
+        position += frames;
+        done += frames;
+    }
+}
+
+void AudioVoice::renderStream(float* output, const int32_t numFrames, const int32_t outputChannels,
+                              int64_t frame) {
+    int32_t written = 0;
+    while (written < numFrames) {
+        int32_t frames = 0;
+        int64_t startFrame = 0;
+        const float* src = m_stream->acquireFrames(numFrames - written, frames, startFrame);
+        if (!src) {
+            if (m_stream->isFinished()) {
+                m_state.store(AUDIO_STATE_STOPPED, std::memory_order_release);
+            }
+            // 欠载：剩余部分静音，播放头停在已播出的位置，等解码线程追上
+            break;
+        }
+        if (startFrame < frame) {
+            if (!m_loop) {
+                // 解码线程在关闭循环前已经回绕，按播放结束处理
+                m_state.store(AUDIO_STATE_STOPPED, std::memory_order_release);
+                break;
+            }
+            m_timelineVersion.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        mixFrames(output + written * outputChannels, src, m_stream->channels(), frames, outputChannels);
+        m_stream->releaseFrames(frames);
+        written += frames;
+        frame = startFrame + frames;
+    }
+
+    m_playheadFrame.store(frame, std::memory_order_release);
+}
+
+void AudioVoice::renderResampled(float* output, const int32_t numFrames, const int32_t outputChannels,
+                                 int64_t frame) {
+    const int channels = m_resampler->getChannelCount();
+    float input[kMaxResampleChannels];
+    float resampled[kMaxResampleChannels];
+
+    for (auto i = 0; i < numFrames; i++) {
+        // 重采样器按需索取输入帧，每输出一帧可能消耗零帧或多帧源数据
+        while (m_resampler->isWriteNeeded()) {
+            bool ended = false;
+            if (!pullSourceFrame(frame, input, ended)) {
+                if (ended) {
+                    m_state.store(AUDIO_STATE_STOPPED, std::memory_order_release);
+                }
+                m_playheadFrame.store(frame, std::memory_order_release);
+                return;
+            }
+            m_resampler->writeNextFrame(input);
+        }
+        m_resampler->readNextFrame(resampled);
+        mixFrames(output + i * outputChannels, resampled, channels, 1, outputChannels);
+    }
+
+    m_playheadFrame.store(frame, std::memory_order_release);
+}
+
+void AudioVoice::renderStretched(float* output, const int32_t numFrames, const int32_t outputChannels) {
+    if (m_stretchRestart) {
+        m_stretchRestart = false;
+        m_stretcher->reset();
+        m_stretchFrame = m_playheadFrame.load(std::memory_order_relaxed);
+    }
+    // 伸缩器按需从读取位置取源数据，循环回绕和流式欠载都由pullSourceFrame处理
+    const auto pull = [this](int64_t& frame, float* samples) {
+        bool ended = false;
+        if (!pullSourceFrame(m_stretchFrame, samples, ended)) {
+            if (ended) {
+                // 缓冲里还有一段源数据没有输出，补静音把它放完再停止
+                m_stretcher->finish();
+            }
+            return false;
+        }
+        frame = m_stretchFrame - 1;
+        return true;
+    };
+    const int32_t channels = m_stretcher->channels();
+
+    if (m_resampler) {
+        float input[kMaxResampleChannels];
+        float resampled[kMaxResampleChannels];
+        bool starved = false;
+        for (auto i = 0; i < numFrames && !starved; i++) {
+            while (m_resampler->isWriteNeeded()) {
+                if (m_stretcher->process(input, 1, pull) == 0) {
+                    starved = true;
+                    break;
+                }
+                m_resampler->writeNextFrame(input);
+            }
+            if (!starved) {
+                m_resampler->readNextFrame(resampled);
+                mixFrames(output + i * outputChannels, resampled, channels, 1, outputChannels);
+            }
+        }
+    } else {
+        // 伸缩器整段输出到栈上的缓冲，再走SIMD混音内核
+        static constexpr int32_t kChunkSamples = 512;
+        alignas(16) float chunk[kChunkSamples];
+        const int32_t chunkFrames = std::max(1, kChunkSamples / channels);
+        for (auto done = 0; done < numFrames;) {
+            const int32_t wanted = std::min(chunkFrames, numFrames - done);
+            const int32_t frames = m_stretcher->process(chunk, wanted, pull);
+            mixFrames(output + done * outputChannels, chunk, channels, frames, outputChannels);
+            done += frames;
+            if (frames < wanted) {
+                break;
+            }
+        }
+    }
+
+    if (m_stretcher->drained()) {
+        m_state.store(AUDIO_STATE_STOPPED, std::memory_order_release);
+    }
+    // 上报的是正在输出的歌曲位置；播完时落在读取位置，再次播放才会从头开始
+    const int64_t heard = m_stretcher->sourceFrame();
+    const bool stopped = m_state.load(std::memory_order_relaxed) == AUDIO_STATE_STOPPED;
+    m_playheadFrame.store(stopped || heard < 0 ? m_stretchFrame : heard, std::memory_order_release);
+}
+
+bool AudioVoice::pullSourceFrame(int64_t& frame, float* output, bool& ended) {
+    ended = false;
+    if (m_stream) {
+        int32_t frames = 0;
+        int64_t startFrame = 0;
+        const float* src = m_stream->acquireFrames(1, frames, startFrame);
+        if (!src) {
+            ended = m_stream->isFinished();
+            return false;
+        }
+        if (startFrame < frame) {
+            if (!m_loop) {
+                ended = true;
+                return false;
+            }
+            m_timelineVersion.fetch_add(1, std::memory_order_relaxed);
+        }
+        const int channels = m_stream->channels();
+        for (auto c = 0; c < channels; c++) {
+            output[c] = src[c];
+        }
+        m_stream->releaseFrames(1);
+        frame = startFrame + 1;
+        return true;
+    }
+
+    const AudioClip* clip = m_clip;
+    LoopSpan span = loopSpan(frame, clip->totalFrames);
+    if (frame >= span.end) {
+        if (!m_loop) {
+            frame = clip->totalFrames;
+            ended = true;
+            return false;
+        }
+        frame = span.start + span.crossfade;
+        m_timelineVersion.fetch_add(1, std::memory_order_relaxed);
+        span = loopSpan(frame, clip->totalFrames);
+    }
+    const int channels = clip->channels;
+    readClipSamples(clip, frame, channels, output);
+    const int64_t position = frame - (span.end - span.crossfade);
+    if (span.crossfade > 0 && position >= 0) {
+        float head[kMaxResampleChannels];
+        readClipSamples(clip, span.start + position, channels, head);
+        const float weight = static_cast<float>(position) / static_cast<float>(span.crossfade);
+        for (auto c = 0; c < channels; c++) {
+            output[c] += (head[c] - output[c]) * weight;
+        }
+    }
+    frame++;
+    return true;
+}
+
+const ChannelMatrix& AudioVoice::channelMatrix(const int32_t srcChannels, const int32_t outputChannels) {
+    if (m_matrix.inputs != srcChannels || m_matrix.outputs != outputChannels) {
+        buildChannelMatrix(srcChannels, outputChannels, m_pan, m_matrix);
+    }
+    return m_matrix;
+}
+
+void AudioVoice::mixFrames(float* output, const float* src, const int32_t srcChannels, const int32_t numFrames,
+                           const int32_t outputChannels) {
+    if (m_volumeRamp.active() || m_fadeRamp.active()) {
+        mixFramesRamped(output, src, srcChannels, numFrames, outputChannels);
+        return;
+    }
+
+    const float gain = m_volumeRamp.value * m_fadeRamp.value;
+    if (gain == 0.0f) {
+        return;
+    }
+    mixMatrix(output, src, numFrames, channelMatrix(srcChannels, outputChannels), gain);
+}
+
+void AudioVoice::mixFramesRamped(float* output, const float* src, const int32_t srcChannels,
+                                 const int32_t numFrames, const int32_t outputChannels) {
+    const ChannelMatrix& matrix = channelMatrix(srcChannels, outputChannels);
+    for (auto i = 0; i < numFrames; i++) {
+        const float gain = m_volumeRamp.next() * m_fadeRamp.next();
+        mixMatrixFrame(output, src, matrix, gain);
+        output += outputChannels;
+        src += srcChannels;
+    }
+}
+
+void AudioVoice::mixFrames(float* output, const int16_t* src, const int32_t srcChannels, const int32_t numFrames,
+                           const int32_t outputChannels) {
+    // 栈上的转换缓冲，回调中不分配内存
+    static constexpr int32_t kConvertSamples = 512;
+    alignas(16) float converted[kConvertSamples];
+    const int32_t chunkFrames = std::max(1, kConvertSamples / srcChannels);
+
+    for (auto done = 0; done < numFrames;) {
+        const int32_t frames = std::min(chunkFrames, numFrames - done);
+        const int32_t samples = frames * srcChannels;
+        convertInt16ToFloat(converted, src, samples);
+        mixFrames(output, converted, srcChannels, frames, outputChannels);
+        src += samples;
+        output += frames * outputChannels;
+        done += frames;
+    }
+}
+
+void AudioVoice::generateSineWave(float* buffer, const int32_t numFrames, const int32_t channels, const float frequency) const {
+    for (auto i = 0; i < numFrames; i++) {
+        const float sample = 0.5f * sin(2.0f * M_PI * frequency * (getCurrentTime() + i / static_cast<float>(getSampleRate())));
+        for (auto c = 0; c < channels; c++) {
+            buffer[i * channels + c] = sample * m_volumeRamp.value;
+        }
+    }
+}
+
+AudioMixer::AudioMixer() :
+        m_streamActive(false),
+        m_rendering(false),
+        m_oneShots(*this),
+        m_outputSampleRate(0),
+        m_status() {
+    for (auto& slot : m_voices) {
+        slot.store(nullptr);
+    }
+    m_status.header.version = kStatusBlockVersion;
+    m_status.header.voiceCount = kMaxVoices;
+}
+
+bool AudioMixer::addVoice(AudioVoice* voice) {
+    for (auto& slot : m_voices) {
+        AudioVoice* expected = nullptr;
+        if (slot.compare_exchange_strong(expected, voice)) {
+            voice->m_mixer.store(this);
+            return true;
+        }
+    }
+    return false;
+}
+
+void AudioMixer::removeVoice(AudioVoice* voice) {
+    for (auto& slot : m_voices) {
+        AudioVoice* expected = voice;
+        if (slot.compare_exchange_strong(expected, nullptr)) {
+            break;
+        }
+    }
+
+    // 等待正在进行的一次渲染结束，之后的渲染已经看不到该声部
+    while (m_rendering.load()) {
+        std::this_thread::yield();
+    }
+    voice->m_mixer.store(nullptr);
+}
+
+void AudioMixer::setStreamActive(const bool active) {
+    m_streamActive.store(active);
+    flushIfIdle();
+}
+
+bool AudioMixer::isStreamActive() const {
+    return m_streamActive.load();
+}
+
+void AudioMixer::flushIfIdle() {
+    if (m_streamActive.load() || m_rendering.exchange(true)) {
+        return;
+    }
+    for (auto& slot : m_voices) {
+        if (AudioVoice* voice = slot.load()) {
+            voice->drainCommands();
+        }
+    }
+    m_oneShots.drainEvents();
+    m_rendering.store(false, std::memory_order_release);
+}
+
+void AudioMixer::setOutputSampleRate(const int sampleRate) {
+    m_outputSampleRate.store(sampleRate, std::memory_order_relaxed);
+    // 持有渲染权期间声部不会被移除；命令暂存在队列里，释放后再统一应用
+    acquireRenderToken();
+    for (auto& slot : m_voices) {
+        if (AudioVoice* voice = slot.load()) {
+            voice->setOutputSampleRate(sampleRate);
+        }
+    }
+    m_rendering.store(false, std::memory_order_release);
+    flushIfIdle();
+}
+
+void AudioMixer::rescaleStreamClock(const int fromRate, const int toRate) {
+    if (fromRate <= 0 || toRate <= 0 || fromRate == toRate) {
+        return;
+    }
+    const double ratio = static_cast<double>(toRate) / fromRate;
+    // 先把排队中的命令和事件应用掉，它们带的帧位置同样是旧时钟
+    acquireRenderToken();
+    for (auto& slot : m_voices) {
+        if (AudioVoice* voice = slot.load()) {
+            voice->drainCommands();
+            voice->rescaleStreamClock(ratio);
+        }
+    }
+    m_oneShots.drainEvents();
+    m_oneShots.rescaleStreamClock(ratio);
+    m_rendering.store(false, std::memory_order_release);
+}
+
+BusGraph& AudioMixer::buses() {
+    return m_buses;
+}
+
+OneShotPool& AudioMixer::oneShots() {
+    return m_oneShots;
+}
+
+CallbackStats& AudioMixer::stats() {
+    return m_stats;
+}
+
+const CallbackStats& AudioMixer::stats() const {
+    return m_stats;
+}
+
+const StatusBlock* AudioMixer::statusBlock() const {
+    return &m_status;
+}
+
+int32_t AudioMixer::slotOf(const AudioVoice* voice) const {
+    for (auto i = 0; i < kMaxVoices; i++) {
+        if (m_voices[i].load() == voice) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void AudioMixer::acquireRenderToken() {
+    while (m_rendering.exchange(true)) {
+        std::this_thread::yield();
+    }
+}
+
+void AudioMixer::stopAll() {
+    acquireRenderToken();
+    for (auto& slot : m_voices) {
+        if (AudioVoice* voice = slot.load()) {
+            voice->markStopped();
+        }
+    }
+    m_oneShots.silenceAll();
+    m_rendering.store(false, std::memory_order_release);
+}
+
+void AudioMixer::render(float* output, const int32_t numFrames, const int32_t channels,
+                        const int64_t streamFrame, const int64_t presentNanos, const int32_t sampleRate) {
+    generateSilence(output, numFrames, channels);
+    if (m_rendering.exchange(true)) {
+        // 控制线程正在代为应用命令（只会发生在流刚启动时），本次输出静音
+        return;
+    }
+
+    // 先在缓冲边界应用所有命令，再混合
+    for (auto& slot : m_voices) {
+        if (AudioVoice* voice = slot.load()) {
+            voice->drainCommands();
+        }
+    }
+    m_oneShots.drainEvents();
+    // 声部先混到各自的总线，总线缓冲容量有限，长回调分块处理
+    const int32_t busRate = sampleRate > 0 ? sampleRate : m_outputSampleRate.load(std::memory_order_relaxed);
+    const int32_t blockFrames = BusGraph::blockFrames(channels);
+    for (auto done = 0; done < numFrames;) {
+        const int32_t frames = std::min(blockFrames, numFrames - done);
+        const int64_t blockStart = streamFrame + done;
+        m_buses.beginBlock(frames, channels);
+        for (auto& slot : m_voices) {
+            if (AudioVoice* voice = slot.load()) {
+                voice->render(m_buses.bus(voice->m_bus), frames, channels, blockStart);
+            }
+        }
+        m_oneShots.render(m_buses, frames, channels, blockStart);
+        m_buses.endBlock(output + static_cast<int64_t>(done) * channels, busRate);
+        done += frames;
+    }
+    if (sampleRate > 0) {
+        publishStatus(streamFrame, presentNanos, sampleRate);
+    }
+    m_rendering.store(false, std::memory_order_release);
+}
+
+void AudioMixer::publishStatus(const int64_t streamFrame, const int64_t presentNanos, const int32_t sampleRate) {
+    StatusHeader& header = m_status.header;
+    header.sequence.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    header.sampleRate.store(sampleRate, std::memory_order_relaxed);
+    header.streamFrame.store(streamFrame, std::memory_order_relaxed);
+    header.presentNanos.store(presentNanos, std::memory_order_relaxed);
+    header.callbackCount.store(header.callbackCount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    header.sequence.fetch_add(1, std::memory_order_release);
+
+    for (auto i = 0; i < kMaxVoices; i++) {
+        const AudioVoice* voice = m_voices[i].load(std::memory_order_relaxed);
+        VoiceStatus& status = m_status.voices[i];
+        if (!voice && status.active.load(std::memory_order_relaxed) == 0) {
+            continue;
+        }
+
+        status.sequence.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        status.active.store(voice ? 1 : 0, std::memory_order_relaxed);
+        if (voice) {
+            // 锚点是本线程刚发布的，直接读取不必走顺序锁
+            const int voiceRate = voice->m_sampleRate.load(std::memory_order_relaxed);
+            const int64_t anchorStream = voice->m_anchorStreamFrame.load(std::memory_order_relaxed);
+            const int64_t anchorVoice = voice->m_anchorVoiceFrame.load(std::memory_order_relaxed);
+            status.state.store(voice->m_state.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            status.timelineVersion.store(voice->m_anchorVersion.load(std::memory_order_relaxed),
+                                         std::memory_order_relaxed);
+            status.playheadFrame.store(voice->m_playheadFrame.load(std::memory_order_relaxed),
+                                       std::memory_order_relaxed);
+            status.songTime.store(voiceRate > 0 ? static_cast<double>(anchorVoice) / voiceRate : 0.0,
+                                  std::memory_order_relaxed);
+            status.clockNanos.store(presentNanos + (anchorStream - streamFrame) * 1000000000LL / sampleRate,
+                                    std::memory_order_relaxed);
+            status.sampleRate.store(voiceRate, std::memory_order_relaxed);
+            status.playing.store(voice->m_anchorPlaying.load(std::memory_order_relaxed) ? 1 : 0,
+                                 std::memory_order_relaxed);
+            status.playbackRate.store(voice->m_anchorRate.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        }
+        status.sequence.fetch_add(1, std::memory_order_release);
+    }
+}
+
+void AudioMixer::generateSilence(float* buffer, const int32_t numFrames, const int32_t channels) {
+    for (auto i = 0; i < numFrames * channels; i++) {
+        buffer[i] = 0.0f;
+    }
+}
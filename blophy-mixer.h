@@ -0,0 +1,376 @@
+/*
+ * blophy-mixer.h - Oboe Wrapper for C#
+ * Copyright (C) 2025  MojaveHao
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include "blophy-bus.h"
+#include "blophy-channels.h"
+#include "blophy-clip.h"
+#include "blophy-common.h"
+#include "blophy-oneshot.h"
+#include "blophy-queue.h"
+#include "blophy-stats.h"
+#include "blophy-status.h"
+#include "blophy-stream.h"
+#include "blophy-stretch.h"
+#include "flowgraph/resampler/MultiChannelResampler.h"
+
+class AudioMixer;
+
+using Resampler = oboe::resampler::MultiChannelResampler;
+
+enum class VoiceCommandType : int32_t {
+    Play,
+    Pause,
+    Unpause,
+    Stop,
+    Seek,
+    SetVolume,
+    SetLoop,
+    SetClip,
+    SetResampler,
+    FadeIn,
+    FadeOut,
+    PlayAt,
+    SetLoopRegion,
+    SetRate,
+    SetPan,
+    SetBus
+};
+
+// 控制线程发往音频线程的命令，在回调开头统一应用
+struct VoiceCommand {
+    VoiceCommandType type;
+    int64_t frame;
+    float value;
+    const AudioClip* clip;
+    StreamSource* stream;
+    Resampler* resampler;
+    GainRampCurve curve;
+    // 循环区间的结束帧，只有SetLoopRegion使用
+    int64_t endFrame;
+    TimeStretcher* stretcher;
+};
+
+// 逐帧推进的增益渐变，只在音频线程使用
+struct GainRamp {
+    float value;
+    float target;
+    // 线性时为每帧增量，指数时为每帧乘数
+    float step;
+    int32_t remaining;
+    GainRampCurve curve;
+
+    void reset(float gain);
+    void start(float targetGain, int32_t frames, GainRampCurve rampCurve);
+    bool active() const { return remaining > 0; }
+    float next();
+};
+
+// 混音器中的一个声部，每个UnityAudioPlayer持有一个
+// 除Oboe自带的重采样器外只依赖标准库，不涉及输出流，便于离线驱动
+// 控制接口可在任意非音频线程调用，所有修改都经命令队列交给音频线程
+class AudioVoice {
+    public:
+        static constexpr size_t kCommandQueueSize = 128;
+        // 超过这个声道数的片段不做重采样
+        static constexpr int32_t kMaxResampleChannels = 8;
+        // setVolume默认的平滑时间，消除拖动滑条时的拉链噪声
+        static constexpr int32_t kVolumeSmoothingMs = 10;
+
+        // 某次回调开始时输出流帧位置与声部播放头的对应关系
+        struct TimelineAnchor {
+            int64_t streamFrame;
+            int64_t voiceFrame;
+            uint32_t timelineVersion;
+            bool playing;
+            // 锚点之后每输出一秒歌曲前进的秒数
+            float playbackRate;
+        };
+
+        AudioVoice();
+        ~AudioVoice();
+
+        // 替换播放的片段；旧片段在音频线程确认不再使用后才会释放
+        void setClip(std::shared_ptr<const AudioClip> clip);
+        // 改为流式播放，数据由后台解码线程边播边解
+        void setStream(std::shared_ptr<StreamSource> stream);
+
+        void play();
+        // 在输出流的第streamFrame帧开始播放，精确到采样；已过去的帧位置会立即开始
+        void playAtFrame(int64_t streamFrame);
+        void pause();
+        void stop();
+        void unpause();
+
+        // 播放位置以帧计数为准，时间由帧数换算
+        float getCurrentTime() const;
+        void setCurrentTime(float time);
+        int64_t getCurrentFrame() const;
+        void setCurrentFrame(int64_t frame);
+        bool isSeekPending() const;
+
+        void setVolume(float volume);
+        // 在durationMs内按曲线渐变到volume；返回的getVolume是目标值
+        void rampVolume(float volume, int32_t durationMs, GainRampCurve curve);
+        float getVolume() const;
+
+        // 声像，-1（左）到1（右）；单声道为功率恒定声像，立体声为平衡，多声道先折叠成立体声再平衡
+        // 声道映射矩阵在音频线程上按源和输出声道数预先算好，混音时不再逐采样换算声道
+        void setPan(float pan);
+        float getPan() const;
+        // 所属总线，默认AUDIO_BUS_MUSIC；AUDIO_BUS_MASTER无效
+        void setBus(AudioBus bus);
+        AudioBus getBus() const;
+
+        // 淡入会从静音开始播放；淡出结束后等同于stop
+        void fadeIn(int32_t durationMs);
+        void fadeOut(int32_t durationMs);
+
+        void setLoop(bool loop);
+        bool getLoop() const;
+        // 循环区间[startFrame, endFrame)，以片段帧计；endFrame不大于0表示到片段结尾
+        // 开启循环后播放到endFrame时无缝跳回startFrame，区间前的部分（如前奏）只播一次
+        // crossfadeMs大于0时把区间末尾与开头交叉淡化，流式音轨不支持交叉淡化
+        void setLoopRegion(int64_t startFrame, int64_t endFrame, int32_t crossfadeMs);
+        int64_t getLoopStartFrame() const;
+        int64_t getLoopEndFrame() const;
+
+        // 播放倍率，限制在TimeStretcher::kMinTempo到kMaxTempo之间；播放头始终是歌曲中的帧位置
+        void setPlaybackRate(float rate, PlaybackRateMode mode);
+        float getPlaybackRate() const;
+        PlaybackRateMode getPlaybackRateMode() const;
+
+        // 输出流的采样率，与片段不同时在回调中实时重采样；0表示尚未确定
+        void setOutputSampleRate(int sampleRate);
+        void setResampleQuality(ResampleQuality quality);
+        ResampleQuality getResampleQuality() const;
+
+        // 有未应用的命令时返回命令生效后的预期状态
+        AudioState getState() const;
+        int getSampleRate() const;
+        float getMusicLength() const;
+
+        // 每次跳转、停止或循环回绕都会递增，用于判断锚点是否仍然有效
+        uint32_t getTimelineVersion() const;
+        bool readAnchor(TimelineAnchor& anchor) const;
+
+        // 以下只能由当前的命令消费者（通常是音频线程）调用
+        void drainCommands();
+        void markStopped();
+        // 输出流时钟换了采样率，预约起播帧和锚点按比例换算
+        void rescaleStreamClock(double ratio);
+        // 将本声部叠加到output；streamFrame为本缓冲第一帧在输出流中的位置
+        void render(float* output, int32_t numFrames, int32_t outputChannels, int64_t streamFrame);
+
+        void generateSineWave(float* buffer, int32_t numFrames, int32_t channels, float frequency = 440.0f) const;
+
+    private:
+        friend class AudioMixer;
+
+        // 已被替换但音频线程可能仍在读取的数据源，附带对应SetClip命令的序号
+        struct RetiredSource {
+            uint32_t command;
+            std::shared_ptr<const AudioClip> clip;
+            std::shared_ptr<StreamSource> stream;
+            std::unique_ptr<Resampler> resampler;
+            std::unique_ptr<TimeStretcher> stretcher;
+        };
+
+        // 以片段帧计的当前循环区间，crossfade已按区间长度截断
+        struct LoopSpan {
+            int64_t start;
+            int64_t end;
+            int64_t crossfade;
+        };
+
+        static AudioState nextState(AudioState state, VoiceCommandType type);
+
+        // 返回命令序号，队列已满时返回0
+        uint32_t submitLocked(const VoiceCommand& command);
+        void replaceSourceLocked(std::shared_ptr<const AudioClip> clip, std::shared_ptr<StreamSource> stream);
+        // 按当前片段和输出采样率创建重采样器，不需要时返回nullptr
+        std::unique_ptr<Resampler> makeResamplerLocked(int inputRate, int channels) const;
+        // 变速模式下交给重采样器的等效输入采样率
+        int effectiveInputRateLocked(int inputRate) const;
+        void updateResamplerLocked();
+        // 保持音高的变速需要时间伸缩器，其余情况返回nullptr
+        std::unique_ptr<TimeStretcher> makeStretcherLocked(int inputRate, int channels) const;
+        int32_t msToFramesLocked(int32_t durationMs) const;
+        void releaseRetiredSourcesLocked();
+        void applyCommand(const VoiceCommand& command);
+        bool sourceFinished() const;
+        // 播放头还没越过循环结束帧时以它为界，否则播到片段结尾后再跳回起点
+        LoopSpan loopSpan(int64_t frame, int64_t totalFrames) const;
+        // 交叉淡化区内把区间末尾的tailFrame起与开头对应位置的数据按位置加权后混合
+        void mixCrossfade(float* output, const AudioClip* clip, const LoopSpan& span, int64_t tailFrame,
+                          int32_t numFrames, int32_t outputChannels);
+        void renderClip(float* output, int32_t numFrames, int32_t outputChannels, int64_t frame);
+        void renderStream(float* output, int32_t numFrames, int32_t outputChannels, int64_t frame);
+        void renderResampled(float* output, int32_t numFrames, int32_t outputChannels, int64_t frame);
+        void renderStretched(float* output, int32_t numFrames, int32_t outputChannels);
+        // 取出下一帧源数据并推进frame，播放结束或欠载时返回false；结束时ended为true，由调用方决定何时停止
+        bool pullSourceFrame(int64_t& frame, float* output, bool& ended);
+        // 增益渐变期间逐帧计算增益，否则走常量增益的SIMD内核
+        void mixFrames(float* output, const float* src, int32_t srcChannels, int32_t numFrames,
+                       int32_t outputChannels);
+        // int16片段分块转换成float后再混合
+        void mixFrames(float* output, const int16_t* src, int32_t srcChannels, int32_t numFrames,
+                       int32_t outputChannels);
+        void mixFramesRamped(float* output, const float* src, int32_t srcChannels, int32_t numFrames,
+                             int32_t outputChannels);
+        // 源或输出声道数变化、声像改变后重建映射矩阵
+        const ChannelMatrix& channelMatrix(int32_t srcChannels, int32_t outputChannels);
+        void applyStop();
+        void publishAnchor(int64_t streamFrame, int64_t voiceFrame, bool playing);
+
+        // 控制线程一侧
+        std::mutex m_controlMutex;
+        std::atomic<AudioMixer*> m_mixer;
+        std::atomic<float> m_controlVolume;
+        std::atomic<float> m_controlPan;
+        std::atomic<AudioBus> m_controlBus;
+        std::atomic<bool> m_controlLoop;
+        std::atomic<int64_t> m_controlLoopStart;
+        std::atomic<int64_t> m_controlLoopEnd;
+        std::atomic<AudioState> m_pendingState;
+        std::atomic<int64_t> m_pendingSeekFrame;
+        std::atomic<uint32_t> m_seekCommand;
+        std::atomic<uint32_t> m_submittedCommands;
+        SpscQueue<VoiceCommand, kCommandQueueSize> m_commands;
+        std::shared_ptr<const AudioClip> m_clipRef;
+        std::shared_ptr<StreamSource> m_streamRef;
+        std::unique_ptr<Resampler> m_resamplerRef;
+        std::unique_ptr<TimeStretcher> m_stretcherRef;
+        std::atomic<float> m_controlRate;
+        std::atomic<PlaybackRateMode> m_controlRateMode;
+        std::vector<RetiredSource> m_retiredSources;
+        int m_channels;
+        int m_outputSampleRate;
+        std::atomic<ResampleQuality> m_resampleQuality;
+        // m_resamplerRef对应的输入采样率，用于判断是否需要重建
+        int m_resamplerInputRate;
+        std::atomic<int> m_sampleRate;
+        std::atomic<int64_t> m_totalFrames;
+
+        // 音频线程一侧
+        std::atomic<uint32_t> m_appliedCommands;
+        std::atomic<AudioState> m_state;
+        // 仅由音频线程推进的64位帧计数播放头
+        std::atomic<int64_t> m_playheadFrame;
+        GainRamp m_volumeRamp;
+        GainRamp m_fadeRamp;
+        float m_pan;
+        ChannelMatrix m_matrix;
+        AudioBus m_bus;
+        // 淡出到零后自动停止
+        bool m_stopAfterFade;
+        // 等待到达的预定起播帧
+        bool m_scheduled;
+        int64_t m_scheduledFrame;
+        bool m_loop;
+        int64_t m_loopStart;
+        // 0表示片段结尾
+        int64_t m_loopEnd;
+        int64_t m_loopCrossfade;
+        const AudioClip* m_clip;
+        StreamSource* m_stream;
+        Resampler* m_resampler;
+        TimeStretcher* m_stretcher;
+        float m_playbackRate;
+        // 时间伸缩器预读到的源位置，领先于上报的播放头
+        int64_t m_stretchFrame;
+        // 跳转、停止或换片段后要从新的播放头重新读取
+        bool m_stretchRestart;
+
+        std::atomic<uint32_t> m_timelineVersion;
+        // 顺序锁保护的锚点，音频线程写，其它线程读
+        std::atomic<uint32_t> m_anchorSeq;
+        std::atomic<int64_t> m_anchorStreamFrame;
+        std::atomic<int64_t> m_anchorVoiceFrame;
+        std::atomic<uint32_t> m_anchorVersion;
+        std::atomic<bool> m_anchorPlaying;
+        std::atomic<float> m_anchorRate;
+};
+
+// 软件混音器：所有声部共用一条输出流，在同一个回调中混合
+class AudioMixer {
+    public:
+        static constexpr int32_t kMaxVoices = 64;
+
+        AudioMixer();
+
+        bool addVoice(AudioVoice* voice);
+        // 返回后保证音频线程不再访问该声部
+        void removeVoice(AudioVoice* voice);
+
+        // 引擎在输出流启动和关闭时调用；流未运行时命令由提交线程直接应用
+        void setStreamActive(bool active);
+        bool isStreamActive() const;
+        void flushIfIdle();
+        // 输出流（重新）打开后调用，所有声部按新采样率重建重采样器
+        void setOutputSampleRate(int sampleRate);
+        // 流未运行时调用：输出流时钟从fromRate换到toRate，所有以输出流帧计的预约位置按比例换算，保持原定的起播时刻
+        void rescaleStreamClock(int fromRate, int toRate);
+
+        OneShotPool& oneShots();
+        // 总线增益、主总线限制器和闪避设置，任意线程可调用
+        BusGraph& buses();
+
+        // 回调统计，音频线程写入
+        CallbackStats& stats();
+        const CallbackStats& stats() const;
+
+        // 共享状态块，指针在进程生命周期内不变
+        const StatusBlock* statusBlock() const;
+        // 声部在状态块中的条目序号，未加入时返回-1
+        int32_t slotOf(const AudioVoice* voice) const;
+
+        void stopAll();
+
+        // 在音频线程调用，output会被完整覆盖
+        // sampleRate大于0时在渲染结束后更新状态块，presentNanos为第一帧预计被听到的时刻
+        void render(float* output, int32_t numFrames, int32_t channels, int64_t streamFrame,
+                    int64_t presentNanos = 0, int32_t sampleRate = 0);
+
+        static void generateSilence(float* buffer, int32_t numFrames, int32_t channels);
+
+    private:
+        void acquireRenderToken();
+        void publishStatus(int64_t streamFrame, int64_t presentNanos, int32_t sampleRate);
+
+        std::array<std::atomic<AudioVoice*>, kMaxVoices> m_voices;
+        std::atomic<bool> m_streamActive;
+        // 持有者是唯一的命令消费者，通常是音频线程，流未运行时也可能是控制线程
+        std::atomic<bool> m_rendering;
+        OneShotPool m_oneShots;
+        BusGraph m_buses;
+        // 输出流采样率，render没有给出时用于总线处理的时间常数
+        std::atomic<int32_t> m_outputSampleRate;
+        StatusBlock m_status;
+        CallbackStats m_stats;
+};
+
+static_assert(kStatusBlockVoices == AudioMixer::kMaxVoices, "status block needs one entry per mixer voice");
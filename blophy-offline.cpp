@@ -0,0 +1,158 @@
+/*
+ * blophy-offline.cpp - Oboe Wrapper for C#
+ * Copyright (C) 2025  MojaveHao
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "blophy-offline.h"
+#include "blophy-kernels.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+OfflineSession::OfflineSession(const int32_t sampleRate, const int32_t channels) :
+        m_sampleRate(sampleRate),
+        m_channels(channels),
+        m_position(0) {
+    // 总线的平滑和限制器按这个采样率计算时间常数
+    m_mixer.setOutputSampleRate(sampleRate);
+}
+
+OfflineSession::~OfflineSession() {
+    for (auto& voice : m_voices) {
+        m_mixer.removeVoice(voice.get());
+    }
+}
+
+bool OfflineSession::isValid() const {
+    return m_sampleRate > 0 && (m_channels == 1 || m_channels == 2);
+}
+
+int32_t OfflineSession::addClip(const std::string& clipPath, const int64_t startFrame, const double clipOffset,
+                                const float volume) {
+    auto clip = ClipCache::instance().acquire(clipPath);
+    if (!clip) {
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto voice = std::make_unique<AudioVoice>();
+    if (!m_mixer.addVoice(voice.get())) {
+        LOGE("Offline session supports at most %d clips", AudioMixer::kMaxVoices);
+        return -1;
+    }
+    // 混音器没有输出流，命令都在这里同步应用
+    voice->setOutputSampleRate(m_sampleRate);
+    voice->setClip(std::move(clip));
+    voice->setCurrentTime(static_cast<float>(std::max(0.0, clipOffset)));
+    // 离线渲染没有拖动滑条的问题，直接生效不做平滑
+    voice->rampVolume(volume, 0, GAIN_RAMP_LINEAR);
+    voice->playAtFrame(startFrame);
+    m_voices.push_back(std::move(voice));
+    return static_cast<int32_t>(m_voices.size()) - 1;
+}
+
+int32_t OfflineSession::render(float* output, const int32_t numFrames) {
+    if (!output || numFrames <= 0) {
+        return 0;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto done = 0; done < numFrames;) {
+        const int32_t frames = std::min(kBlockFrames, numFrames - done);
+        const int64_t position = m_position.load(std::memory_order_relaxed);
+        m_mixer.render(output + static_cast<int64_t>(done) * m_channels, frames, m_channels, position);
+        m_position.store(position + frames, std::memory_order_relaxed);
+        done += frames;
+    }
+    return numFrames;
+}
+
+int64_t OfflineSession::getPosition() const {
+    return m_position.load(std::memory_order_relaxed);
+}
+
+namespace {
+
+int32_t peakCount(const int64_t frames, const int32_t framesPerPeak) {
+    return static_cast<int32_t>((frames + framesPerPeak - 1) / framesPerPeak);
+}
+
+void storePeak(const int32_t index, const float low, const float high, const double sumSquares,
+               const int64_t samples, float* mins, float* maxs, float* rms) {
+    mins[index] = low;
+    maxs[index] = high;
+    rms[index] = samples > 0 ? static_cast<float>(std::sqrt(sumSquares / static_cast<double>(samples))) : 0.0f;
+}
+
+} // namespace
+
+int32_t computePeaks(const float* samples, const int64_t frames, const int32_t channels,
+                     const int32_t framesPerPeak, float* mins, float* maxs, float* rms, const int32_t maxPeaks) {
+    if (!samples || frames <= 0 || channels <= 0 || framesPerPeak <= 0) {
+        return 0;
+    }
+    const int32_t count = peakCount(frames, framesPerPeak);
+    if (!mins || !maxs || !rms) {
+        return count;
+    }
+
+    const int32_t peaks = std::max(0, std::min(count, maxPeaks));
+    for (auto p = 0; p < peaks; p++) {
+        const int64_t begin = static_cast<int64_t>(p) * framesPerPeak;
+        const int64_t length = std::min<int64_t>(framesPerPeak, frames - begin) * channels;
+        float low = std::numeric_limits<float>::max();
+        float high = std::numeric_limits<float>::lowest();
+        double sumSquares = 0.0;
+        accumulatePeaks(samples + begin * channels, static_cast<int32_t>(length), low, high, sumSquares);
+        storePeak(p, low, high, sumSquares, length, mins, maxs, rms);
+    }
+    return peaks;
+}
+
+int32_t computeClipPeaks(const AudioClip& clip, const int32_t framesPerPeak, float* mins, float* maxs, float* rms,
+                         const int32_t maxPeaks) {
+    if (clip.format != CLIP_FORMAT_INT16) {
+        return computePeaks(clip.floatData(), clip.totalFrames, clip.channels, framesPerPeak, mins, maxs, rms,
+                            maxPeaks);
+    }
+    if (clip.totalFrames <= 0 || clip.channels <= 0 || framesPerPeak <= 0) {
+        return 0;
+    }
+    const int32_t count = peakCount(clip.totalFrames, framesPerPeak);
+    if (!mins || !maxs || !rms) {
+        return count;
+    }
+
+    // int16片段分块转换后再统计
+    static constexpr int32_t kConvertSamples = 4096;
+    std::vector<float> converted(kConvertSamples);
+    const int32_t peaks = std::max(0, std::min(count, maxPeaks));
+    for (auto p = 0; p < peaks; p++) {
+        const int64_t beginFrame = static_cast<int64_t>(p) * framesPerPeak;
+        const int64_t begin = beginFrame * clip.channels;
+        const int64_t length = std::min<int64_t>(framesPerPeak, clip.totalFrames - beginFrame) * clip.channels;
+        float low = std::numeric_limits<float>::max();
+        float high = std::numeric_limits<float>::lowest();
+        double sumSquares = 0.0;
+        for (int64_t done = 0; done < length;) {
+            const auto n = static_cast<int32_t>(std::min<int64_t>(kConvertSamples, length - done));
+            convertInt16ToFloat(converted.data(), clip.int16Data() + begin + done, n);
+            accumulatePeaks(converted.data(), n, low, high, sumSquares);
+            done += n;
+        }
+        storePeak(p, low, high, sumSquares, length, mins, maxs, rms);
+    }
+    return peaks;
+}
@@ -0,0 +1,67 @@
+/*
+ * blophy-offline.h - Oboe Wrapper for C#
+ * Copyright (C) 2025  MojaveHao
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "blophy-clip.h"
+#include "blophy-mixer.h"
+
+// 离线渲染：用独立的混音器在调用线程上以任意速度渲染，不经过输出流
+// 声部、重采样和增益与实时播放走同一套代码，片段从ClipCache取，不会重复解码
+class OfflineSession {
+    public:
+        // 离线混音只支持单声道和立体声输出
+        OfflineSession(int32_t sampleRate, int32_t channels);
+        ~OfflineSession();
+
+        OfflineSession(const OfflineSession&) = delete;
+        OfflineSession& operator=(const OfflineSession&) = delete;
+
+        bool isValid() const;
+
+        // startFrame为本会话输出中的起播帧，clipOffset为从片段的第几秒开始；返回声部序号，失败返回-1
+        int32_t addClip(const std::string& clipPath, int64_t startFrame, double clipOffset, float volume);
+        // 把接下来的numFrames帧渲染到output（交错，会被完整覆盖），返回渲染的帧数
+        int32_t render(float* output, int32_t numFrames);
+        int64_t getPosition() const;
+
+    private:
+        // 与实时回调相近的块大小，预约起播和音量渐变的粒度保持一致
+        static constexpr int32_t kBlockFrames = 1024;
+
+        std::mutex m_mutex;
+        int32_t m_sampleRate;
+        int32_t m_channels;
+        // 渲染时在m_mutex内推进，getPosition不加锁读取，渲染很长时也不会阻塞查询
+        std::atomic<int64_t> m_position;
+        AudioMixer m_mixer;
+        std::vector<std::unique_ptr<AudioVoice>> m_voices;
+};
+
+// 按每framesPerPeak帧一格统计最小值、最大值和RMS，多声道合并统计
+// 任一输出数组为空时只返回所需的格数
+int32_t computePeaks(const float* samples, int64_t frames, int32_t channels, int32_t framesPerPeak,
+                     float* mins, float* maxs, float* rms, int32_t maxPeaks);
+int32_t computeClipPeaks(const AudioClip& clip, int32_t framesPerPeak, float* mins, float* maxs, float* rms,
+                         int32_t maxPeaks);
@@ -0,0 +1,441 @@
+/*
+ * blophy-oneshot.cpp - Oboe Wrapper for C#
+ * Copyright (C) 2025  MojaveHao
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "blophy-oneshot.h"
+#include "blophy-kernels.h"
+#include "blophy-mixer.h"
+#include <algorithm>
+#include <cmath>
+
+OneShotPool::OneShotPool(AudioMixer& mixer) :
+        m_mixer(mixer),
+        m_releasesSubmitted(0),
+        m_releasesApplied(0),
+        m_pendingReconcile(0),
+        m_pendingStopAll(false),
+        m_polyphony(32),
+        m_stealPolicy(STEAL_OLDEST),
+        m_voices(),
+        m_nextOrder(0) {
+    for (auto& clip : m_clips) {
+        clip.store(nullptr);
+    }
+}
+
+int32_t OneShotPool::registerClip(std::shared_ptr<const AudioClip> clip) {
+    if (!clip || clip->totalFrames <= 0) {
+        return 0;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    releaseRetiredClipsLocked();
+    for (auto i = 0; i < kMaxClips; i++) {
+        if (m_clipRefs[i]) {
+            continue;
+        }
+        const bool retired = std::any_of(m_retiredClips.begin(), m_retiredClips.end(),
+                                         [i](const RetiredClip& r) { return r.clipId == i + 1; });
+        if (retired) {
+            continue;
+        }
+        m_clips[i].store(clip.get(), std::memory_order_release);
+        m_clipRefs[i] = std::move(clip);
+        return i + 1;
+    }
+    LOGE("Too many one-shot clips, at most %d can be registered", kMaxClips);
+    return 0;
+}
+
+void OneShotPool::unregisterClip(const int32_t clipId) {
+    if (clipId <= 0 || clipId > kMaxClips) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const int32_t index = clipId - 1;
+    if (!m_clipRefs[index]) {
+        return;
+    }
+    // 先置空，之后处理的触发事件都会被忽略；Release事件再停掉已经在播放的声部
+    m_clips[index].store(nullptr, std::memory_order_release);
+    const uint32_t release = ++m_releasesSubmitted;
+    submitReleaseLocked(EventType::Release, clipId, release);
+    m_retiredClips.push_back({release, clipId, std::move(m_clipRefs[index])});
+    releaseRetiredClipsLocked();
+}
+
+bool OneShotPool::replaceClip(const int32_t clipId, const AudioClip* previous,
+                              std::shared_ptr<const AudioClip> clip) {
+    if (!clip || clip->totalFrames <= 0 || clipId <= 0 || clipId > kMaxClips) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const int32_t index = clipId - 1;
+    if (!previous || m_clipRefs[index].get() != previous) {
+        return false;
+    }
+    // 之后的触发直接用新片段；Replace事件把已经在播放的声部换过去，确认后旧片段才释放
+    m_clips[index].store(clip.get(), std::memory_order_release);
+    const uint32_t release = ++m_releasesSubmitted;
+    submitReleaseLocked(EventType::Replace, clipId, release);
+    m_retiredClips.push_back({release, clipId, std::move(m_clipRefs[index])});
+    m_clipRefs[index] = std::move(clip);
+    releaseRetiredClipsLocked();
+    return true;
+}
+
+std::vector<std::pair<int32_t, std::shared_ptr<const AudioClip>>> OneShotPool::registeredClips() {
+    std::vector<std::pair<int32_t, std::shared_ptr<const AudioClip>>> clips;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto i = 0; i < kMaxClips; i++) {
+        if (m_clipRefs[i]) {
+            clips.emplace_back(i + 1, m_clipRefs[i]);
+        }
+    }
+    return clips;
+}
+
+void OneShotPool::releaseRetiredClipsLocked() {
+    const uint32_t applied = m_releasesApplied.load(std::memory_order_acquire);
+    m_retiredClips.erase(std::remove_if(m_retiredClips.begin(), m_retiredClips.end(),
+                                        [applied](const RetiredClip& retired) {
+                                            return static_cast<int32_t>(applied - retired.release) >= 0;
+                                        }),
+                         m_retiredClips.end());
+}
+
+void OneShotPool::submitReleaseLocked(const EventType type, const int32_t clipId, const uint32_t release) {
+    if (pushEvent({type, clipId, 0.0f, 0.0f, 0, AUDIO_BUS_SFX, release})) {
+        return;
+    }
+    // 队列满：改为请求一次全量核对，它同时覆盖此前所有尚未处理的注销和替换
+    LOGW("One-shot event queue full, reconciling clip %d on the next drain", clipId);
+    m_pendingReconcile.store(release, std::memory_order_release);
+    m_mixer.flushIfIdle();
+}
+
+void OneShotPool::acknowledgeRelease(const uint32_t release) {
+    // 核对请求先于之后提交的事件写入，这里一定能看到；不先核对的话确认序号会越过它，片段被提前释放
+    const uint32_t reconcile = m_pendingReconcile.exchange(0, std::memory_order_acquire);
+    if (reconcile != 0) {
+        reconcileVoices();
+        advanceReleasesApplied(reconcile);
+    }
+    if (release != 0) {
+        advanceReleasesApplied(release);
+    }
+}
+
+void OneShotPool::advanceReleasesApplied(const uint32_t release) {
+    // 核对可能先于队列中更早的事件完成，确认序号只前进不后退
+    const uint32_t applied = m_releasesApplied.load(std::memory_order_relaxed);
+    if (static_cast<int32_t>(release - applied) > 0) {
+        m_releasesApplied.store(release, std::memory_order_release);
+    }
+}
+
+bool OneShotPool::pushEvent(const Event& event) {
+    const bool pushed = m_events.push(event);
+    // 流没有运行时由提交线程代为处理
+    m_mixer.flushIfIdle();
+    return pushed;
+}
+
+bool OneShotPool::trigger(const int32_t clipId, const float gain, const float pan, const int64_t startFrame,
+                          const AudioBus bus) {
+    if (clipId <= 0 || clipId > kMaxClips || !m_clips[clipId - 1].load(std::memory_order_relaxed)) {
+        return false;
+    }
+    // 流没在跑时不排队，否则开流后会一次性放出所有积压的音效
+    if (!m_mixer.isStreamActive()) {
+        return false;
+    }
+    if (bus < AUDIO_BUS_MUSIC || bus >= AUDIO_BUS_MASTER) {
+        return false;
+    }
+    if (!m_events.push({EventType::Trigger, clipId, gain, pan, startFrame, bus})) {
+        LOGW("One-shot event queue full, dropped clip %d", clipId);
+        return false;
+    }
+    return true;
+}
+
+void OneShotPool::stopAll() {
+    if (!pushEvent({EventType::StopAll, 0, 0.0f, 0.0f})) {
+        m_pendingStopAll.store(true, std::memory_order_release);
+        m_mixer.flushIfIdle();
+    }
+}
+
+void OneShotPool::setPolyphony(const int32_t maxVoices) {
+    m_polyphony.store(std::max(1, std::min(maxVoices, kMaxVoices)));
+}
+
+int32_t OneShotPool::getPolyphony() const {
+    return m_polyphony.load();
+}
+
+void OneShotPool::setStealPolicy(const StealPolicy policy) {
+    m_stealPolicy.store(policy);
+}
+
+void OneShotPool::drainEvents() {
+    Event event{};
+    while (m_events.pop(event)) {
+        switch (event.type) {
+            case EventType::Trigger:
+                startVoice(event);
+                break;
+            case EventType::Release:
+                for (auto& voice : m_voices) {
+                    if (voice.active && voice.clipId == event.clipId) {
+                        voice.active = false;
+                    }
+                }
+                acknowledgeRelease(event.release);
+                break;
+            case EventType::Replace: {
+                // 编号随后又被注销时新片段为空，旧片段确认后就会释放，声部只能停下
+                const AudioClip* clip = m_clips[event.clipId - 1].load(std::memory_order_acquire);
+                for (auto& voice : m_voices) {
+                    if (!voice.active || voice.clipId != event.clipId || voice.clip == clip) {
+                        continue;
+                    }
+                    if (!clip) {
+                        voice.active = false;
+                        continue;
+                    }
+                    voice.frame = std::min(clip->totalFrames, voice.frame * clip->totalFrames / voice.clip->totalFrames);
+                    voice.clip = clip;
+                }
+                acknowledgeRelease(event.release);
+                break;
+            }
+            case EventType::StopAll:
+                for (auto& voice : m_voices) {
+                    if (voice.active && voice.releaseFrames == 0) {
+                        voice.releaseFrames = kStealFadeFrames;
+                    }
+                }
+                break;
+        }
+    }
+
+    acknowledgeRelease(0);
+    // 没能入队的停止全部晚于队列中已有的触发，放在最后处理
+    if (m_pendingStopAll.exchange(false, std::memory_order_acquire)) {
+        for (auto& voice : m_voices) {
+            if (voice.active && voice.releaseFrames == 0) {
+                voice.releaseFrames = kStealFadeFrames;
+            }
+        }
+    }
+}
+
+void OneShotPool::reconcileVoices() {
+    for (auto& voice : m_voices) {
+        if (!voice.active) {
+            continue;
+        }
+        const AudioClip* clip = m_clips[voice.clipId - 1].load(std::memory_order_acquire);
+        if (!clip) {
+            voice.active = false;
+        } else if (clip != voice.clip) {
+            voice.frame = std::min(clip->totalFrames, voice.frame * clip->totalFrames / voice.clip->totalFrames);
+            voice.clip = clip;
+        }
+    }
+}
+
+void OneShotPool::silenceAll() {
+    for (auto& voice : m_voices) {
+        voice.active = false;
+    }
+}
+
+void OneShotPool::rescaleStreamClock(const double ratio) {
+    for (auto& voice : m_voices) {
+        if (voice.active && voice.startFrame > 0) {
+            voice.startFrame = std::llround(static_cast<double>(voice.startFrame) * ratio);
+        }
+    }
+}
+
+void OneShotPool::startVoice(const Event& event) {
+    const AudioClip* clip = m_clips[event.clipId - 1].load(std::memory_order_acquire);
+    if (!clip) {
+        return;
+    }
+
+    auto playing = 0;
+    Voice* slot = nullptr;
+    Voice* releasing = nullptr;
+    for (auto& voice : m_voices) {
+        if (!voice.active) {
+            slot = slot ? slot : &voice;
+        } else if (voice.releaseFrames > 0) {
+            releasing = releasing ? releasing : &voice;
+        } else {
+            playing++;
+        }
+    }
+
+    if (playing >= m_polyphony.load(std::memory_order_relaxed)) {
+        Voice* victim = stealVoice();
+        if (victim) {
+            victim->releaseFrames = kStealFadeFrames;
+            // 物理声部都被占满时只好直接复用被抢占的声部
+            slot = slot ? slot : victim;
+        }
+    }
+    if (!slot) {
+        // 只剩正在淡出的声部，直接截断其中一个
+        slot = releasing;
+    }
+    if (!slot) {
+        return;
+    }
+
+    slot->clip = clip;
+    slot->clipId = event.clipId;
+    slot->frame = 0;
+    // 单声道为功率恒定声像，立体声和多声道为平衡，矩阵在第一次混音时按输出声道数构建
+    slot->gain = std::max(0.0f, event.gain);
+    slot->pan = std::max(-1.0f, std::min(1.0f, event.pan));
+    slot->matrix.inputs = 0;
+    slot->order = m_nextOrder++;
+    slot->active = true;
+    slot->releaseFrames = 0;
+    slot->startFrame = event.startFrame;
+    slot->bus = event.bus;
+}
+
+OneShotPool::Voice* OneShotPool::stealVoice() {
+    const StealPolicy policy = m_stealPolicy.load(std::memory_order_relaxed);
+    Voice* victim = nullptr;
+    for (auto& voice : m_voices) {
+        if (!voice.active || voice.releaseFrames > 0) {
+            continue;
+        }
+        if (!victim) {
+            victim = &voice;
+        } else if (policy == STEAL_QUIETEST) {
+            if (voice.gain < victim->gain) {
+                victim = &voice;
+            }
+        } else if (voice.order < victim->order) {
+            victim = &voice;
+        }
+    }
+    return victim;
+}
+
+void OneShotPool::render(BusGraph& buses, const int32_t numFrames, const int32_t channels, const int64_t streamFrame) {
+    for (auto& voice : m_voices) {
+        if (voice.active) {
+            renderVoice(voice, buses.bus(voice.bus), numFrames, channels, streamFrame);
+        }
+    }
+}
+
+void OneShotPool::renderVoice(Voice& voice, float* output, int32_t numFrames, const int32_t channels,
+                              const int64_t streamFrame) {
+    const int64_t offset = voice.startFrame - streamFrame;
+    if (offset > 0) {
+        if (voice.releaseFrames > 0) {
+            // 还没开始就被抢占或停止，直接放弃，不必淡出
+            voice.active = false;
+            return;
+        }
+        if (offset >= numFrames) {
+            return;
+        }
+        // 起播帧落在本缓冲中间
+        output += offset * channels;
+        numFrames -= static_cast<int32_t>(offset);
+        voice.startFrame = 0;
+    } else if (voice.startFrame > 0) {
+        if (offset < 0) {
+            // 预约的帧位置已经过去，只能立即开始
+            m_mixer.stats().recordLateCommand();
+        }
+        voice.startFrame = 0;
+    }
+
+    const AudioClip* clip = voice.clip;
+    auto frames = static_cast<int32_t>(std::min<int64_t>(numFrames, clip->totalFrames - voice.frame));
+    float fade = 1.0f;
+    float fadeStep = 0.0f;
+    if (voice.releaseFrames > 0) {
+        frames = std::min(frames, voice.releaseFrames);
+        fade = static_cast<float>(voice.releaseFrames) / kStealFadeFrames;
+        fadeStep = -1.0f / kStealFadeFrames;
+    }
+
+    const int srcChannels = clip->channels;
+    if (clip->format == CLIP_FORMAT_INT16) {
+        // 栈上的转换缓冲，回调中不分配内存
+        static constexpr int32_t kConvertSamples = 512;
+        alignas(16) float converted[kConvertSamples];
+        const int32_t chunkFrames = std::max(1, kConvertSamples / srcChannels);
+        const int16_t* src = clip->int16Data() + voice.frame * srcChannels;
+        float* out = output;
+        for (auto done = 0; done < frames;) {
+            const int32_t n = std::min(chunkFrames, frames - done);
+            convertInt16ToFloat(converted, src, n * srcChannels);
+            mixSource(voice, converted, out, n, channels, fade, fadeStep);
+            fade += fadeStep * n;
+            src += n * srcChannels;
+            out += n * channels;
+            done += n;
+        }
+    } else {
+        mixSource(voice, clip->floatData() + voice.frame * srcChannels, output, frames, channels, fade, fadeStep);
+    }
+
+    voice.frame += frames;
+    if (voice.releaseFrames > 0) {
+        voice.releaseFrames -= frames;
+        if (voice.releaseFrames <= 0) {
+            voice.active = false;
+        }
+    }
+    if (voice.frame >= clip->totalFrames) {
+        voice.active = false;
+    }
+}
+
+void OneShotPool::mixSource(Voice& voice, const float* src, float* output, const int32_t numFrames,
+                            const int32_t channels, float fade, const float fadeStep) {
+    const int srcChannels = voice.clip->channels;
+    if (voice.matrix.inputs != srcChannels || voice.matrix.outputs != channels) {
+        buildChannelMatrix(srcChannels, channels, voice.pan, voice.matrix);
+    }
+    if (fadeStep == 0.0f) {
+        mixMatrix(output, src, numFrames, voice.matrix, voice.gain * fade);
+        return;
+    }
+
+    for (auto i = 0; i < numFrames; i++) {
+        mixMatrixFrame(output, src, voice.matrix, voice.gain * fade);
+        output += channels;
+        src += srcChannels;
+        fade += fadeStep;
+    }
+}
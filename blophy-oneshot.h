@@ -0,0 +1,160 @@
+/*
+ * blophy-oneshot.h - Oboe Wrapper for C#
+ * Copyright (C) 2025  MojaveHao
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "blophy-bus.h"
+#include "blophy-channels.h"
+#include "blophy-clip.h"
+#include "blophy-common.h"
+#include "blophy-queue.h"
+
+class AudioMixer;
+
+// 击打音效等一次性声音的预分配声部池，挂在共享混音器里
+// 触发只是一次无锁入队，可在任意线程调用
+class OneShotPool {
+    public:
+        static constexpr int32_t kMaxVoices = 64;
+        static constexpr int32_t kMaxClips = 256;
+        static constexpr size_t kEventQueueSize = 256;
+        // 被抢占的声部用这么多帧淡出，避免直接截断产生爆音
+        static constexpr int32_t kStealFadeFrames = 64;
+
+        explicit OneShotPool(AudioMixer& mixer);
+
+        OneShotPool(const OneShotPool&) = delete;
+        OneShotPool& operator=(const OneShotPool&) = delete;
+
+        // 片段需已是输出采样率，返回1起的编号，失败返回0
+        int32_t registerClip(std::shared_ptr<const AudioClip> clip);
+        // 正在播放该片段的声部会被停止，片段在音频线程确认后释放
+        void unregisterClip(int32_t clipId);
+        // 把编号clipId从previous换成同一内容的新片段（如转换到新的输出采样率），编号不变
+        // previous已不是该编号当前的片段时什么也不做并返回false；正在播放的声部按长度比例换到新片段的对应位置
+        bool replaceClip(int32_t clipId, const AudioClip* previous, std::shared_ptr<const AudioClip> clip);
+        // 当前注册的全部片段及其编号
+        std::vector<std::pair<int32_t, std::shared_ptr<const AudioClip>>> registeredClips();
+
+        // pan取-1（左）到1（右），功率恒定声像；流未运行或队列已满时返回false
+        // startFrame为输出流帧位置，在该帧精确起播；0或已过去的位置立即播放
+        // 等待中的声部同样占用复音数，只宜提前一两个缓冲的量预约
+        // bus为混入的总线，默认AUDIO_BUS_SFX，界面音效可改用AUDIO_BUS_UI
+        bool trigger(int32_t clipId, float gain, float pan, int64_t startFrame = 0, AudioBus bus = AUDIO_BUS_SFX);
+        void stopAll();
+
+        void setPolyphony(int32_t maxVoices);
+        int32_t getPolyphony() const;
+        void setStealPolicy(StealPolicy policy);
+
+        // 以下只能由混音器的命令消费者调用
+        void drainEvents();
+        // 引擎出错关流时调用，立即清空所有声部
+        void silenceAll();
+        // 输出流时钟换了采样率，等待中的预约起播帧按比例换算
+        void rescaleStreamClock(double ratio);
+        // 叠加到各声部所属的总线；streamFrame为本缓冲第一帧在输出流中的位置
+        void render(BusGraph& buses, int32_t numFrames, int32_t channels, int64_t streamFrame);
+
+    private:
+        enum class EventType : int32_t {
+            Trigger,
+            Release,
+            Replace,
+            StopAll
+        };
+
+        struct Event {
+            EventType type;
+            int32_t clipId;
+            float gain;
+            float pan;
+            int64_t startFrame;
+            AudioBus bus;
+            // Release和Replace的序号，处理后写入m_releasesApplied
+            uint32_t release;
+        };
+
+        struct RetiredClip {
+            uint32_t release;
+            int32_t clipId;
+            std::shared_ptr<const AudioClip> clip;
+        };
+
+        struct Voice {
+            const AudioClip* clip;
+            int32_t clipId;
+            int64_t frame;
+            float gain;
+            float pan;
+            // 按源和输出声道数算好的声像矩阵，输出声道数变化时重建
+            ChannelMatrix matrix;
+            // 触发顺序，用于挑选最早的声部
+            uint64_t order;
+            bool active;
+            // 被抢占后剩余的淡出帧数，0表示正常播放
+            int32_t releaseFrames;
+            // 预约的起播帧，到达前不输出
+            int64_t startFrame;
+            AudioBus bus;
+        };
+
+        void startVoice(const Event& event);
+        Voice* stealVoice();
+        void renderVoice(Voice& voice, float* output, int32_t numFrames, int32_t channels, int64_t streamFrame);
+        void mixSource(Voice& voice, const float* src, float* output, int32_t numFrames, int32_t channels,
+                       float fade, float fadeStep);
+        bool pushEvent(const Event& event);
+        void submitReleaseLocked(EventType type, int32_t clipId, uint32_t release);
+        // 确认序号release（0只处理待核对的请求）；先完成待核对的请求，避免确认越过它
+        void acknowledgeRelease(uint32_t release);
+        // 让所有声部与注册表一致：片段已注销的停止，已替换的换到新片段
+        void reconcileVoices();
+        void advanceReleasesApplied(uint32_t release);
+        void releaseRetiredClipsLocked();
+
+        AudioMixer& m_mixer;
+        MpscQueue<Event, kEventQueueSize> m_events;
+
+        // 控制线程一侧
+        std::mutex m_mutex;
+        std::array<std::shared_ptr<const AudioClip>, kMaxClips> m_clipRefs;
+        // 已注销但音频线程可能仍在播放的片段，确认前编号不会被复用
+        std::vector<RetiredClip> m_retiredClips;
+        uint32_t m_releasesSubmitted;
+
+        // 音频线程读取的注册表，注销时先置空
+        std::array<std::atomic<const AudioClip*>, kMaxClips> m_clips;
+        std::atomic<uint32_t> m_releasesApplied;
+        // 队列满时不在控制线程上等待：注销/替换记下需要核对的最新序号（0为没有），停止全部记一个标志，
+        // 都在下一次处理事件时应用
+        std::atomic<uint32_t> m_pendingReconcile;
+        std::atomic<bool> m_pendingStopAll;
+        std::atomic<int32_t> m_polyphony;
+        std::atomic<StealPolicy> m_stealPolicy;
+
+        // 音频线程一侧
+        std::array<Voice, kMaxVoices> m_voices;
+        uint64_t m_nextOrder;
+};
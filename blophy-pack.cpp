@@ -0,0 +1,101 @@
+/*
+ * blophy-pack.cpp - Oboe Wrapper for C#
+ * Copyright (C) 2025  MojaveHao
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+// 片段包打包工具，在主机上把一批音频文件解码后写成一个片段包
+//
+// 用法: blophy-pack [选项] 输出.bank 音频文件...
+//   --format float      片段存储格式，float或int16
+//   --rate 48000        预先重采样到这个采样率，一次性音效不必在注册时再转换；0表示保持原采样率
+//   --prefix assets/    包内名字的前缀，名字需要与游戏中传给SetClip的路径一致
+// 包内名字为前缀加上命令行中给出的文件路径
+
+#include "blophy-bank.h"
+#include "blophy-clip.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct PackOptions {
+    ClipFormat format = CLIP_FORMAT_FLOAT32;
+    int32_t rate = 0;
+    std::string prefix;
+    std::string output;
+    std::vector<std::string> files;
+};
+
+bool parseOptions(const int argc, char** argv, PackOptions& options) {
+    for (auto i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg == "--format" && hasValue) {
+            options.format = std::strcmp(argv[++i], "int16") == 0 ? CLIP_FORMAT_INT16 : CLIP_FORMAT_FLOAT32;
+        } else if (arg == "--rate" && hasValue) {
+            options.rate = std::atoi(argv[++i]);
+        } else if (arg == "--prefix" && hasValue) {
+            options.prefix = argv[++i];
+        } else if (arg.rfind("--", 0) == 0) {
+            std::fprintf(stderr, "Unknown option: %s\n", arg.c_str());
+            return false;
+        } else if (options.output.empty()) {
+            options.output = arg;
+        } else {
+            options.files.push_back(arg);
+        }
+    }
+    return !options.output.empty() && !options.files.empty() && options.rate >= 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    PackOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        std::fprintf(stderr, "usage: %s [--format float|int16] [--rate 48000] [--prefix assets/] output.bank files...\n",
+                     argv[0]);
+        return 1;
+    }
+
+    std::vector<std::shared_ptr<const AudioClip>> clips;
+    for (const auto& file : options.files) {
+        auto decoded = decodeClip(file, options.format);
+        if (!decoded) {
+            std::fprintf(stderr, "Failed to decode: %s\n", file.c_str());
+            return 1;
+        }
+        if (options.rate > 0 && decoded->sampleRate != options.rate) {
+            decoded = resampleClip(*decoded, options.rate, RESAMPLE_QUALITY_HIGH);
+            if (!decoded) {
+                std::fprintf(stderr, "Failed to resample: %s\n", file.c_str());
+                return 1;
+            }
+        }
+        // 包内名字取自片段的path，复制一份改名
+        auto clip = std::make_shared<AudioClip>(*decoded);
+        clip->path = options.prefix + file;
+        std::printf("%-40s %2d ch %6d Hz %10lld frames\n", clip->path.c_str(), clip->channels, clip->sampleRate,
+                    static_cast<long long>(clip->totalFrames));
+        clips.push_back(std::move(clip));
+    }
+    return writeClipBank(options.output, clips) ? 0 : 1;
+}
@@ -0,0 +1,134 @@
+/*
+ * blophy-queue.h - Oboe Wrapper for C#
+ * Copyright (C) 2025  MojaveHao
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+// 单生产者单消费者无锁环形队列，push/pop都不会分配内存
+// 多个生产者线程需要在外部自行串行化
+template <typename T, size_t Capacity>
+class SpscQueue {
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+    public:
+        SpscQueue() : m_head(0), m_tail(0), m_items() {}
+
+        SpscQueue(const SpscQueue&) = delete;
+        SpscQueue& operator=(const SpscQueue&) = delete;
+
+        // 生产者调用，队列已满时返回false
+        bool push(const T& item) {
+            const size_t tail = m_tail.load(std::memory_order_relaxed);
+            if (tail - m_head.load(std::memory_order_acquire) == Capacity) {
+                return false;
+            }
+            m_items[tail & (Capacity - 1)] = item;
+            m_tail.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        // 消费者调用，队列为空时返回false
+        bool pop(T& item) {
+            const size_t head = m_head.load(std::memory_order_relaxed);
+            if (head == m_tail.load(std::memory_order_acquire)) {
+                return false;
+            }
+            item = m_items[head & (Capacity - 1)];
+            m_head.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+        size_t size() const {
+            return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire);
+        }
+
+        static constexpr size_t capacity() {
+            return Capacity;
+        }
+
+    private:
+        // 头尾索引分处不同缓存行，避免生产者和消费者互相伪共享
+        alignas(64) std::atomic<size_t> m_head;
+        alignas(64) std::atomic<size_t> m_tail;
+        std::array<T, Capacity> m_items;
+};
+
+// 多生产者单消费者的有界无锁队列，每个槽位带序号，生产者之间无需加锁
+// 用于任意线程都可能触发的事件，例如一次性音效
+template <typename T, size_t Capacity>
+class MpscQueue {
+    static_assert(Capacity > 1 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+    public:
+        MpscQueue() : m_head(0), m_tail(0) {
+            for (size_t i = 0; i < Capacity; i++) {
+                m_cells[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        MpscQueue(const MpscQueue&) = delete;
+        MpscQueue& operator=(const MpscQueue&) = delete;
+
+        // 任意线程调用，队列已满时返回false
+        bool push(const T& item) {
+            size_t tail = m_tail.load(std::memory_order_relaxed);
+            for (;;) {
+                Cell& cell = m_cells[tail & (Capacity - 1)];
+                const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+                const auto diff = static_cast<ptrdiff_t>(sequence) - static_cast<ptrdiff_t>(tail);
+                if (diff == 0) {
+                    // 槽位空闲，抢占成功后再写入
+                    if (m_tail.compare_exchange_weak(tail, tail + 1, std::memory_order_relaxed)) {
+                        cell.item = item;
+                        cell.sequence.store(tail + 1, std::memory_order_release);
+                        return true;
+                    }
+                } else if (diff < 0) {
+                    return false;
+                } else {
+                    tail = m_tail.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        // 仅消费者调用，队列为空或队首尚未写完时返回false
+        bool pop(T& item) {
+            const size_t head = m_head.load(std::memory_order_relaxed);
+            Cell& cell = m_cells[head & (Capacity - 1)];
+            if (cell.sequence.load(std::memory_order_acquire) != head + 1) {
+                return false;
+            }
+            item = cell.item;
+            cell.sequence.store(head + Capacity, std::memory_order_release);
+            m_head.store(head + 1, std::memory_order_relaxed);
+            return true;
+        }
+
+    private:
+        struct Cell {
+            std::atomic<size_t> sequence;
+            T item;
+        };
+
+        alignas(64) std::atomic<size_t> m_head;
+        alignas(64) std::atomic<size_t> m_tail;
+        std::array<Cell, Capacity> m_cells;
+};
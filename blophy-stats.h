@@ -0,0 +1,131 @@
+/*
+ * blophy-stats.h - Oboe Wrapper for C#
+ * Copyright (C) 2025  MojaveHao
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include "blophy-common.h"
+
+// 音频回调的运行统计，只由音频线程写入，任意线程读取
+// 写入全是无锁的单写者原子操作，不分配内存；清零通过请求标志交给音频线程执行
+class CallbackStats {
+    public:
+        CallbackStats() :
+                m_histogram(),
+                m_callbacks(0),
+                m_overBudget(0),
+                m_totalNanos(0),
+                m_worstNanos(0),
+                m_budgetNanos(0),
+                m_underruns(0),
+                m_lateCommands(0),
+                m_streamXRuns(0),
+                m_resetRequested(false) {
+        }
+
+        // durationNanos为本次回调耗时，budgetNanos为本缓冲的播放时长
+        void record(const int64_t durationNanos, const int64_t budgetNanos) {
+            if (m_resetRequested.exchange(false, std::memory_order_acquire)) {
+                clear();
+            }
+            // 每格占预算的1/8，最后一格收纳所有超过两倍预算的回调
+            const int64_t bucket = budgetNanos > 0 ? durationNanos * 8 / budgetNanos : kLoadBuckets - 1;
+            const auto index = static_cast<size_t>(std::min<int64_t>(bucket, kLoadBuckets - 1));
+            bump(m_histogram[index]);
+            bump(m_callbacks);
+            if (durationNanos > budgetNanos) {
+                bump(m_overBudget);
+            }
+            m_totalNanos.store(m_totalNanos.load(std::memory_order_relaxed) + durationNanos, std::memory_order_relaxed);
+            if (durationNanos > m_worstNanos.load(std::memory_order_relaxed)) {
+                m_worstNanos.store(durationNanos, std::memory_order_relaxed);
+            }
+            m_budgetNanos.store(budgetNanos, std::memory_order_relaxed);
+        }
+
+        // xruns为当前流累计的欠载次数，换流后从0重新计数
+        void recordXRuns(const int32_t xruns) {
+            const int32_t previous = m_streamXRuns.exchange(xruns, std::memory_order_relaxed);
+            if (xruns > previous) {
+                m_underruns.store(m_underruns.load(std::memory_order_relaxed) + (xruns - previous),
+                                  std::memory_order_relaxed);
+            }
+        }
+
+        // 开新流之前调用，此时音频线程没有在运行
+        void resetStreamXRuns() {
+            m_streamXRuns.store(0, std::memory_order_relaxed);
+        }
+
+        void recordLateCommand() {
+            bump(m_lateCommands);
+        }
+
+        void requestReset() {
+            m_resetRequested.store(true, std::memory_order_release);
+        }
+
+        void snapshot(AudioStats& stats) const {
+            stats.callbackCount = m_callbacks.load(std::memory_order_relaxed);
+            stats.underrunCount = m_underruns.load(std::memory_order_relaxed);
+            stats.lateCommandCount = m_lateCommands.load(std::memory_order_relaxed);
+            stats.overBudgetCount = m_overBudget.load(std::memory_order_relaxed);
+            stats.worstCallbackNanos = m_worstNanos.load(std::memory_order_relaxed);
+            stats.averageCallbackNanos = stats.callbackCount > 0 ?
+                                         m_totalNanos.load(std::memory_order_relaxed) / stats.callbackCount : 0;
+            stats.budgetNanos = m_budgetNanos.load(std::memory_order_relaxed);
+            for (auto i = 0; i < kLoadBuckets; i++) {
+                stats.loadHistogram[i] = m_histogram[i].load(std::memory_order_relaxed);
+            }
+        }
+
+    private:
+        static constexpr int32_t kLoadBuckets = AUDIO_STATS_LOAD_BUCKETS;
+
+        // 单写者，读改写不需要原子指令
+        template <typename T>
+        static void bump(std::atomic<T>& counter) {
+            counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+
+        void clear() {
+            for (auto& bucket : m_histogram) {
+                bucket.store(0, std::memory_order_relaxed);
+            }
+            m_callbacks.store(0, std::memory_order_relaxed);
+            m_overBudget.store(0, std::memory_order_relaxed);
+            m_totalNanos.store(0, std::memory_order_relaxed);
+            m_worstNanos.store(0, std::memory_order_relaxed);
+            m_underruns.store(0, std::memory_order_relaxed);
+            m_lateCommands.store(0, std::memory_order_relaxed);
+        }
+
+        std::array<std::atomic<uint32_t>, kLoadBuckets> m_histogram;
+        std::atomic<int64_t> m_callbacks;
+        std::atomic<int64_t> m_overBudget;
+        std::atomic<int64_t> m_totalNanos;
+        std::atomic<int64_t> m_worstNanos;
+        std::atomic<int64_t> m_budgetNanos;
+        std::atomic<int64_t> m_underruns;
+        std::atomic<int64_t> m_lateCommands;
+        std::atomic<int32_t> m_streamXRuns;
+        std::atomic<bool> m_resetRequested;
+};
@@ -0,0 +1,73 @@
+/*
+ * blophy-status.h - Oboe Wrapper for C#
+ * Copyright (C) 2025  MojaveHao
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <type_traits>
+
+// 音频线程每次回调后写入的共享状态块，C#端通过unsafe指针直接读取，不需要P/Invoke
+// 每个条目独占一条缓存行，由各自的sequence做顺序锁：
+//   1. 读sequence（volatile），为奇数说明正在写入，重读
+//   2. 读其余字段
+//   3. 内存屏障后再读sequence，与第1步不同则重读
+// 所有字段都是普通的定宽整数和浮点数，C#端按Sequential布局、Pack=8映射即可
+
+static constexpr uint32_t kStatusBlockVersion = 2;
+static constexpr int32_t kStatusBlockVoices = 64;
+
+struct alignas(64) StatusHeader {
+    std::atomic<uint32_t> sequence;
+    uint32_t version;
+    int32_t voiceCount;
+    std::atomic<int32_t> sampleRate;
+    // 最近一次回调第一帧在输出流中的位置，以及它预计被听到的CLOCK_MONOTONIC时刻
+    std::atomic<int64_t> streamFrame;
+    std::atomic<int64_t> presentNanos;
+    std::atomic<int64_t> callbackCount;
+};
+
+struct alignas(64) VoiceStatus {
+    std::atomic<uint32_t> sequence;
+    // 槽位上没有播放器时为0
+    std::atomic<int32_t> active;
+    std::atomic<int32_t> state;
+    std::atomic<uint32_t> timelineVersion;
+    // 本次回调结束时的播放头
+    std::atomic<int64_t> playheadFrame;
+    // 在clockNanos时刻被听到的歌曲位置（秒）；playing为1时按经过的时间乘以playbackRate外推
+    std::atomic<double> songTime;
+    std::atomic<int64_t> clockNanos;
+    std::atomic<int32_t> sampleRate;
+    std::atomic<int32_t> playing;
+    std::atomic<float> playbackRate;
+};
+
+struct StatusBlock {
+    StatusHeader header;
+    VoiceStatus voices[kStatusBlockVoices];
+};
+
+// C#端按普通字段读取，要求原子类型与对应的普通类型布局完全一致
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "atomic<uint32_t> must be lock-free and unpadded");
+static_assert(sizeof(std::atomic<int64_t>) == sizeof(int64_t), "atomic<int64_t> must be lock-free and unpadded");
+static_assert(sizeof(std::atomic<double>) == sizeof(double), "atomic<double> must be lock-free and unpadded");
+static_assert(sizeof(std::atomic<float>) == sizeof(float), "atomic<float> must be lock-free and unpadded");
+static_assert(sizeof(VoiceStatus) == 64, "each voice status must occupy exactly one cache line");
+static_assert(std::is_standard_layout<StatusBlock>::value, "status block is read through raw pointers");
@@ -0,0 +1,1242 @@
+/*
+ * blophy-stream.cpp - Oboe Wrapper for C#
+ * Copyright (C) 2025  MojaveHao
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "blophy-stream.h"
+#include <algorithm>
+#include <cstring>
+#include <chrono>
+#include <new>
+
+// 这些解码库已经由libnyquist编译进来，这里直接使用它们的增量接口
+#include "vorbis/vorbisfile.h"
+#include "opusfile.h"
+#include "FLAC/include/FLAC/stream_decoder.h"
+// 与libnyquist的Mp3Decoder使用相同的输出格式
+#define MINIMP3_FLOAT_OUTPUT
+#include "minimp3/minimp3_ex.h"
+
+namespace {
+
+// 连续这么多次数据缺失（OV_HOLE/OP_HOLE）仍读不出音频就当作文件损坏，不在坏数据上空转
+constexpr int32_t kMaxHoles = 32;
+
+uint16_t readLE16(const uint8_t* p) {
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+uint32_t readLE32(const uint8_t* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+uint64_t readLE64(const uint8_t* p) {
+    return static_cast<uint64_t>(readLE32(p)) | (static_cast<uint64_t>(readLE32(p + 4)) << 32);
+}
+
+// Vorbis和Opus的多声道顺序（L C R ...）到WAVE顺序（L R C LFE ...）的映射，下标为Vorbis声道
+// 解码时统一重排，混音矩阵只需要认一种顺序；单声道、立体声和四声道两者相同，返回nullptr
+const int32_t* vorbisChannelMap(const int channels) {
+    static constexpr int32_t kMaps[6][8] = {
+            {0, 2, 1},
+            {0, 1, 2, 3},
+            {0, 2, 1, 3, 4},
+            {0, 2, 1, 4, 5, 3},
+            {0, 2, 1, 5, 6, 4, 3},
+            {0, 2, 1, 6, 7, 4, 5, 3}
+    };
+    if (channels < 3 || channels > 8 || channels == 4) {
+        return nullptr;
+    }
+    return kMaps[channels - 3];
+}
+
+// 对已交错的数据原地重排
+void reorderVorbisChannels(float* samples, const int32_t frames, const int channels) {
+    const int32_t* map = vorbisChannelMap(channels);
+    if (!map) {
+        return;
+    }
+    float frame[8];
+    for (auto i = 0; i < frames; i++) {
+        float* dst = samples + static_cast<size_t>(i) * channels;
+        std::copy_n(dst, channels, frame);
+        for (auto c = 0; c < channels; c++) {
+            dst[map[c]] = frame[c];
+        }
+    }
+}
+
+// 压缩格式的跳转点表，打开时扫描一遍编码数据建立
+// 跳转时从目标之前最近的点开始解码并丢弃多出的部分，代价与文件长度无关
+class SeekIndex {
+    public:
+        // 相邻跳转点至少相隔这么多帧，跳转时最多多解这么多帧
+        static constexpr int64_t kSpacingFrames = 4096;
+        // 解码丢弃时每次最多读这么多帧
+        static constexpr int32_t kDiscardFrames = 2048;
+
+        struct Point {
+            // 从offset开始解码时输出的第一帧（可能略早，以解码器报告的位置为准）
+            int64_t frame;
+            size_t offset;
+        };
+
+        void add(const int64_t frame, const size_t offset) {
+            if (m_points.empty() || frame - m_points.back().frame >= kSpacingFrames) {
+                m_points.push_back({frame, offset});
+            }
+        }
+
+        // 不晚于frame的最后一个跳转点，没有时返回nullptr
+        const Point* find(const int64_t frame) const {
+            const auto it = std::upper_bound(m_points.begin(), m_points.end(), frame,
+                                             [](const int64_t f, const Point& point) { return f < point.frame; });
+            return it == m_points.begin() ? nullptr : &*(it - 1);
+        }
+
+        size_t size() const { return m_points.size(); }
+
+    private:
+        std::vector<Point> m_points;
+};
+
+// 逐页扫描Ogg封装，只读页头；granuleShift为要从granule中扣除的前置样本数（Opus的pre-skip）
+SeekIndex buildOggIndex(const uint8_t* data, const size_t size, const int64_t granuleShift) {
+    static constexpr size_t kPageHeaderBytes = 27;
+    SeekIndex index;
+    bool haveSerial = false;
+    uint32_t serial = 0;
+    // 当前页开头的PCM位置，即上一页的granule
+    int64_t pageStart = 0;
+    for (size_t pos = 0; pos + kPageHeaderBytes <= size;) {
+        const uint8_t* page = data + pos;
+        if (std::memcmp(page, "OggS", 4) != 0) {
+            // 数据损坏时逐字节重新同步
+            pos++;
+            continue;
+        }
+        const size_t segments = page[26];
+        if (pos + kPageHeaderBytes + segments > size) {
+            break;
+        }
+        size_t bodyBytes = 0;
+        for (size_t i = 0; i < segments; i++) {
+            bodyBytes += page[kPageHeaderBytes + i];
+        }
+        const size_t pageBytes = kPageHeaderBytes + segments + bodyBytes;
+        if (pos + pageBytes > size) {
+            break;
+        }
+
+        // 只为第一条逻辑流建索引，多路复用的其它流忽略
+        const uint32_t pageSerial = readLE32(page + 14);
+        if (!haveSerial) {
+            serial = pageSerial;
+            haveSerial = true;
+        }
+        if (pageSerial == serial) {
+            const auto granule = static_cast<int64_t>(readLE64(page + 6));
+            if (pageStart > 0) {
+                index.add(pageStart, pos);
+            }
+            // 没有数据包在本页结束时granule为-1
+            if (granule >= 0) {
+                pageStart = std::max<int64_t>(0, granule - granuleShift);
+            }
+        }
+        pos += pageBytes;
+    }
+    return index;
+}
+
+uint8_t flacCrc8(const uint8_t* data, const size_t size) {
+    uint8_t crc = 0;
+    for (size_t i = 0; i < size; i++) {
+        crc ^= data[i];
+        for (auto bit = 0; bit < 8; bit++) {
+            crc = static_cast<uint8_t>(crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1);
+        }
+    }
+    return crc;
+}
+
+// 从pos开始找下一个通过CRC-8校验的FLAC帧头；number为帧号（固定块大小）或首采样号（可变块大小）
+bool findFlacFrame(const uint8_t* data, const size_t size, size_t& pos, uint64_t& number, bool& variable) {
+    // 帧头最长16字节：同步码和参数4字节、UTF-8编码的序号最多7字节、块大小和采样率各最多2字节、CRC 1字节
+    static constexpr size_t kMaxHeaderBytes = 16;
+    for (; pos + kMaxHeaderBytes <= size; pos++) {
+        const uint8_t* p = data + pos;
+        if (p[0] != 0xFF || (p[1] & 0xFE) != 0xF8) {
+            continue;
+        }
+        const int blockCode = p[2] >> 4;
+        const int rateCode = p[2] & 0x0F;
+        if (blockCode == 0 || rateCode == 0x0F || (p[3] >> 4) >= 11 || (p[3] & 0x01) || ((p[3] >> 1) & 0x07) == 3) {
+            continue;
+        }
+
+        uint64_t value = p[4];
+        int extra = 0;
+        if (value < 0x80) {
+            extra = 0;
+        } else if ((value & 0xE0) == 0xC0) {
+            value &= 0x1F;
+            extra = 1;
+        } else if ((value & 0xF0) == 0xE0) {
+            value &= 0x0F;
+            extra = 2;
+        } else if ((value & 0xF8) == 0xF0) {
+            value &= 0x07;
+            extra = 3;
+        } else if ((value & 0xFC) == 0xF8) {
+            value &= 0x03;
+            extra = 4;
+        } else if ((value & 0xFE) == 0xFC) {
+            value &= 0x01;
+            extra = 5;
+        } else if (value == 0xFE) {
+            value = 0;
+            extra = 6;
+        } else {
+            continue;
+        }
+        size_t length = 5;
+        bool valid = true;
+        for (auto i = 0; i < extra && valid; i++) {
+            const uint8_t byte = p[length++];
+            valid = (byte & 0xC0) == 0x80;
+            value = (value << 6) | (byte & 0x3F);
+        }
+        if (!valid) {
+            continue;
+        }
+        length += blockCode == 6 ? 1 : (blockCode == 7 ? 2 : 0);
+        length += rateCode == 12 ? 1 : (rateCode == 13 || rateCode == 14 ? 2 : 0);
+        if (flacCrc8(p, length) != p[length]) {
+            continue;
+        }
+        number = value;
+        variable = (p[1] & 0x01) != 0;
+        return true;
+    }
+    return false;
+}
+
+// 按平均码率跳着找帧头，只触及文件中很小的一部分
+SeekIndex buildFlacIndex(const uint8_t* data, const size_t size, const int64_t totalFrames,
+                         const int32_t blockSize) {
+    SeekIndex index;
+    if (size < 8 || std::memcmp(data, "fLaC", 4) != 0 || totalFrames <= 0) {
+        return index;
+    }
+    // 跳过元数据块，每块4字节头：最后一块标志、类型和24位长度
+    size_t pos = 4;
+    for (bool last = false; !last && pos + 4 <= size;) {
+        last = (data[pos] & 0x80) != 0;
+        pos += 4 + ((static_cast<size_t>(data[pos + 1]) << 16) | (static_cast<size_t>(data[pos + 2]) << 8) |
+                    data[pos + 3]);
+    }
+    const size_t audioBytes = size > pos ? size - pos : 0;
+    const auto stride = static_cast<size_t>(static_cast<double>(audioBytes) / static_cast<double>(totalFrames) *
+                                            SeekIndex::kSpacingFrames);
+
+    int64_t previous = -1;
+    uint64_t number = 0;
+    bool variable = false;
+    while (findFlacFrame(data, size, pos, number, variable)) {
+        const int64_t frame = variable ? static_cast<int64_t>(number) : static_cast<int64_t>(number) * blockSize;
+        // 误判的同步码会破坏单调性，直接忽略
+        if (frame > previous && frame < totalFrames) {
+            index.add(frame, pos);
+            previous = frame;
+        }
+        pos += std::max<size_t>(1, stride);
+    }
+    return index;
+}
+
+// RIFF/WAVE，PCM整数8/16/24/32位和32/64位浮点
+class WavStreamDecoder final : public StreamDecoder {
+    public:
+        explicit WavStreamDecoder(std::shared_ptr<const FileData> file) :
+                m_file(std::move(file)), m_dataOffset(0), m_dataSize(0), m_sampleRate(0), m_channels(0),
+                m_bitsPerSample(0), m_isFloat(false), m_frameBytes(0), m_totalFrames(0), m_position(0) {}
+
+        bool init() {
+            const uint8_t* data = m_file->data();
+            const size_t size = m_file->size();
+            if (size < 12 || std::memcmp(data, "RIFF", 4) != 0 || std::memcmp(data + 8, "WAVE", 4) != 0) {
+                return false;
+            }
+
+            bool haveFormat = false;
+            size_t offset = 12;
+            while (offset + 8 <= size) {
+                const uint8_t* chunk = data + offset;
+                const uint32_t chunkSize = readLE32(chunk + 4);
+                const size_t body = offset + 8;
+
+                if (std::memcmp(chunk, "fmt ", 4) == 0 && chunkSize >= 16 && body + 16 <= size) {
+                    uint16_t format = readLE16(data + body);
+                    m_channels = readLE16(data + body + 2);
+                    m_sampleRate = static_cast<int>(readLE32(data + body + 4));
+                    m_bitsPerSample = readLE16(data + body + 14);
+                    // WAVE_FORMAT_EXTENSIBLE的真实格式在子格式GUID的前两个字节
+                    if (format == 0xFFFE && chunkSize >= 40 && body + 26 <= size) {
+                        format = readLE16(data + body + 24);
+                    }
+                    if (format != 1 && format != 3) {
+                        LOGW("Unsupported WAV format tag: %d", format);
+                        return false;
+                    }
+                    m_isFloat = format == 3;
+                    haveFormat = true;
+                } else if (std::memcmp(chunk, "data", 4) == 0) {
+                    m_dataOffset = body;
+                    m_dataSize = std::min<size_t>(chunkSize, size - body);
+                    break;
+                }
+                // 块按偶数字节对齐
+                offset = body + chunkSize + (chunkSize & 1u);
+            }
+
+            if (!haveFormat || m_dataOffset == 0 || m_channels <= 0 || m_sampleRate <= 0) {
+                return false;
+            }
+            const bool supported = m_isFloat ? (m_bitsPerSample == 32 || m_bitsPerSample == 64)
+                                             : (m_bitsPerSample == 8 || m_bitsPerSample == 16 ||
+                                                m_bitsPerSample == 24 || m_bitsPerSample == 32);
+            if (!supported) {
+                LOGW("Unsupported WAV bit depth: %d", m_bitsPerSample);
+                return false;
+            }
+            m_frameBytes = static_cast<size_t>(m_channels) * (m_bitsPerSample / 8);
+            m_totalFrames = static_cast<int64_t>(m_dataSize / m_frameBytes);
+            return true;
+        }
+
+        int sampleRate() const override { return m_sampleRate; }
+        int channels() const override { return m_channels; }
+        int64_t totalFrames() const override { return m_totalFrames; }
+
+        int32_t read(float* output, const int32_t maxFrames) override {
+            const auto frames = static_cast<int32_t>(std::min<int64_t>(maxFrames, m_totalFrames - m_position));
+            if (frames <= 0) {
+                return 0;
+            }
+            const uint8_t* src = m_file->data() + m_dataOffset + m_position * m_frameBytes;
+            const int32_t samples = frames * m_channels;
+            for (auto i = 0; i < samples; i++) {
+                output[i] = convertSample(src);
+                src += m_bitsPerSample / 8;
+            }
+            m_position += frames;
+            return frames;
+        }
+
+        bool seek(const int64_t frame) override {
+            m_position = std::max<int64_t>(0, std::min(frame, m_totalFrames));
+            return true;
+        }
+
+    private:
+        float convertSample(const uint8_t* p) const {
+            if (m_isFloat) {
+                if (m_bitsPerSample == 32) {
+                    float value;
+                    std::memcpy(&value, p, sizeof(value));
+                    return value;
+                }
+                double value;
+                std::memcpy(&value, p, sizeof(value));
+                return static_cast<float>(value);
+            }
+            switch (m_bitsPerSample) {
+                case 8:
+                    return (static_cast<int>(p[0]) - 128) / 128.0f;
+                case 16:
+                    return static_cast<int16_t>(readLE16(p)) / 32768.0f;
+                case 24: {
+                    const int32_t value = static_cast<int32_t>(
+                        (static_cast<uint32_t>(p[0]) << 8) | (static_cast<uint32_t>(p[1]) << 16) |
+                        (static_cast<uint32_t>(p[2]) << 24)) >> 8;
+                    return value / 8388608.0f;
+                }
+                default:
+                    return static_cast<float>(static_cast<int32_t>(readLE32(p)) / 2147483648.0);
+            }
+        }
+
+        std::shared_ptr<const FileData> m_file;
+        size_t m_dataOffset;
+        size_t m_dataSize;
+        int m_sampleRate;
+        int m_channels;
+        int m_bitsPerSample;
+        bool m_isFloat;
+        size_t m_frameBytes;
+        int64_t m_totalFrames;
+        int64_t m_position;
+};
+
+// 供vorbisfile回调使用的内存读取游标
+struct MemoryReader {
+    const uint8_t* data;
+    size_t size;
+    size_t position;
+};
+
+size_t memoryRead(void* ptr, const size_t size, const size_t count, void* source) {
+    auto* reader = static_cast<MemoryReader*>(source);
+    const size_t bytes = std::min(size * count, reader->size - reader->position);
+    std::memcpy(ptr, reader->data + reader->position, bytes);
+    reader->position += bytes;
+    return size ? bytes / size : 0;
+}
+
+int memorySeek(void* source, const ogg_int64_t offset, const int whence) {
+    auto* reader = static_cast<MemoryReader*>(source);
+    int64_t base = 0;
+    if (whence == SEEK_CUR) {
+        base = static_cast<int64_t>(reader->position);
+    } else if (whence == SEEK_END) {
+        base = static_cast<int64_t>(reader->size);
+    }
+    const int64_t target = base + offset;
+    if (target < 0 || target > static_cast<int64_t>(reader->size)) {
+        return -1;
+    }
+    reader->position = static_cast<size_t>(target);
+    return 0;
+}
+
+long memoryTell(void* source) {
+    return static_cast<long>(static_cast<MemoryReader*>(source)->position);
+}
+
+class VorbisStreamDecoder final : public StreamDecoder {
+    public:
+        explicit VorbisStreamDecoder(std::shared_ptr<const FileData> file) :
+                m_file(std::move(file)), m_reader{m_file->data(), m_file->size(), 0}, m_vorbis(),
+                m_open(false), m_sampleRate(0), m_channels(0), m_channelMap(nullptr), m_totalFrames(0),
+                m_failed(false) {}
+
+        ~VorbisStreamDecoder() override {
+            if (m_open) {
+                ov_clear(&m_vorbis);
+            }
+        }
+
+        bool init() {
+            const ov_callbacks callbacks = {memoryRead, memorySeek, nullptr, memoryTell};
+            if (ov_open_callbacks(&m_reader, &m_vorbis, nullptr, 0, callbacks) != 0) {
+                return false;
+            }
+            m_open = true;
+            const vorbis_info* info = ov_info(&m_vorbis, -1);
+            if (!info) {
+                return false;
+            }
+            m_sampleRate = static_cast<int>(info->rate);
+            m_channels = info->channels;
+            m_channelMap = vorbisChannelMap(m_channels);
+            m_totalFrames = std::max<int64_t>(0, ov_pcm_total(&m_vorbis, -1));
+            m_seekIndex = buildOggIndex(m_file->data(), m_file->size(), 0);
+            return m_channels > 0;
+        }
+
+        int sampleRate() const override { return m_sampleRate; }
+        int channels() const override { return m_channels; }
+        int64_t totalFrames() const override { return m_totalFrames; }
+
+        int32_t read(float* output, const int32_t maxFrames) override {
+            int32_t written = 0;
+            int32_t holes = 0;
+            while (written < maxFrames && !m_failed) {
+                float** pcm = nullptr;
+                int bitstream = 0;
+                const long frames = ov_read_float(&m_vorbis, &pcm, maxFrames - written, &bitstream);
+                if (frames == 0) {
+                    break;
+                }
+                if (frames == OV_HOLE && ++holes <= kMaxHoles) {
+                    // 数据缺失，跳过继续读取
+                    continue;
+                }
+                if (frames < 0) {
+                    // 其它错误每次调用都会原样返回，按已读到的部分结束，直到下一次成功跳转
+                    LOGE("Vorbis decode error %ld, ending stream", frames);
+                    m_failed = true;
+                    break;
+                }
+                holes = 0;
+                // vorbisfile输出平面格式，交错时顺便重排成WAVE的声道顺序
+                for (long i = 0; i < frames; i++) {
+                    for (auto c = 0; c < m_channels; c++) {
+                        output[(written + i) * m_channels + (m_channelMap ? m_channelMap[c] : c)] = pcm[c][i];
+                    }
+                }
+                written += static_cast<int32_t>(frames);
+            }
+            return written;
+        }
+
+        bool seek(const int64_t frame) override {
+            if (seekFromIndex(frame) || ov_pcm_seek(&m_vorbis, frame) == 0) {
+                m_failed = false;
+                return true;
+            }
+            return false;
+        }
+
+    private:
+        // 长块的重叠窗口需要前一个包，留出一个最长块的余量
+        static constexpr int64_t kPrerollFrames = 2048;
+
+        // 跳到索引点所在的页后解码丢弃到目标帧；落点晚于目标时交给ov_pcm_seek二分查找
+        bool seekFromIndex(const int64_t frame) {
+            const SeekIndex::Point* point = m_seekIndex.find(frame - kPrerollFrames);
+            if (!point || ov_raw_seek(&m_vorbis, static_cast<ogg_int64_t>(point->offset)) != 0) {
+                return false;
+            }
+            int64_t position = ov_pcm_tell(&m_vorbis);
+            if (position < 0 || position > frame) {
+                return false;
+            }
+            int32_t holes = 0;
+            while (position < frame) {
+                float** pcm = nullptr;
+                int bitstream = 0;
+                const auto wanted = static_cast<int>(std::min<int64_t>(frame - position, SeekIndex::kDiscardFrames));
+                const long frames = ov_read_float(&m_vorbis, &pcm, wanted, &bitstream);
+                if (frames == 0) {
+                    return false;
+                }
+                if (frames < 0) {
+                    // 落在坏页上时交给ov_pcm_seek，不在原地空转
+                    if (frames != OV_HOLE || ++holes > kMaxHoles) {
+                        return false;
+                    }
+                    continue;
+                }
+                holes = 0;
+                position += frames;
+            }
+            return true;
+        }
+
+        std::shared_ptr<const FileData> m_file;
+        MemoryReader m_reader;
+        OggVorbis_File m_vorbis;
+        bool m_open;
+        int m_sampleRate;
+        int m_channels;
+        const int32_t* m_channelMap;
+        int64_t m_totalFrames;
+        SeekIndex m_seekIndex;
+        // 遇到不可恢复的解码错误后不再读取
+        bool m_failed;
+};
+
+class OpusStreamDecoder final : public StreamDecoder {
+    public:
+        explicit OpusStreamDecoder(std::shared_ptr<const FileData> file) :
+                m_file(std::move(file)), m_opus(nullptr), m_channels(0), m_totalFrames(0), m_failed(false) {}
+
+        ~OpusStreamDecoder() override {
+            if (m_opus) {
+                op_free(m_opus);
+            }
+        }
+
+        bool init() {
+            int error = 0;
+            m_opus = op_open_memory(m_file->data(), m_file->size(), &error);
+            if (!m_opus) {
+                return false;
+            }
+            m_channels = op_channel_count(m_opus, -1);
+            m_totalFrames = std::max<int64_t>(0, op_pcm_total(m_opus, -1));
+            const OpusHead* head = op_head(m_opus, -1);
+            m_seekIndex = buildOggIndex(m_file->data(), m_file->size(), head ? head->pre_skip : 0);
+            m_discard.resize(static_cast<size_t>(SeekIndex::kDiscardFrames) * std::max(0, m_channels));
+            return m_channels > 0;
+        }
+
+        // Opus总是以48kHz解码
+        int sampleRate() const override { return 48000; }
+        int channels() const override { return m_channels; }
+        int64_t totalFrames() const override { return m_totalFrames; }
+
+        int32_t read(float* output, const int32_t maxFrames) override {
+            int32_t written = 0;
+            int32_t holes = 0;
+            while (written < maxFrames && !m_failed) {
+                const int frames = op_read_float(m_opus, output + written * m_channels,
+                                                 (maxFrames - written) * m_channels, nullptr);
+                if (frames == 0) {
+                    break;
+                }
+                if (frames == OP_HOLE && ++holes <= kMaxHoles) {
+                    // OP_HOLE表示数据缺失，跳过即可
+                    continue;
+                }
+                if (frames < 0) {
+                    // 其它错误每次调用都会原样返回，按已读到的部分结束，直到下一次成功跳转
+                    LOGE("Opus decode error %d, ending stream", frames);
+                    m_failed = true;
+                    break;
+                }
+                holes = 0;
+                reorderVorbisChannels(output + written * m_channels, frames, m_channels);
+                written += frames;
+            }
+            return written;
+        }
+
+        bool seek(const int64_t frame) override {
+            if (seekFromIndex(frame) || op_pcm_seek(m_opus, frame) == 0) {
+                m_failed = false;
+                return true;
+            }
+            return false;
+        }
+
+    private:
+        // 与opusfile自身跳转相同的80ms预滚，让解码器状态收敛
+        static constexpr int64_t kPrerollFrames = 3840;
+
+        bool seekFromIndex(const int64_t frame) {
+            const SeekIndex::Point* point = m_seekIndex.find(frame - kPrerollFrames);
+            if (!point || op_raw_seek(m_opus, static_cast<opus_int64>(point->offset)) != 0) {
+                return false;
+            }
+            int64_t position = op_pcm_tell(m_opus);
+            if (position < 0 || position > frame) {
+                return false;
+            }
+            int32_t holes = 0;
+            while (position < frame) {
+                const auto wanted = static_cast<int>(std::min<int64_t>(frame - position, SeekIndex::kDiscardFrames));
+                const int frames = op_read_float(m_opus, m_discard.data(), wanted * m_channels, nullptr);
+                if (frames == 0) {
+                    return false;
+                }
+                if (frames < 0) {
+                    // 落在坏页上时交给op_pcm_seek，不在原地空转
+                    if (frames != OP_HOLE || ++holes > kMaxHoles) {
+                        return false;
+                    }
+                    continue;
+                }
+                holes = 0;
+                position += frames;
+            }
+            return true;
+        }
+
+        std::shared_ptr<const FileData> m_file;
+        OggOpusFile* m_opus;
+        int m_channels;
+        int64_t m_totalFrames;
+        SeekIndex m_seekIndex;
+        // 跳转时丢弃的解码输出
+        std::vector<float> m_discard;
+        // 遇到不可恢复的解码错误后不再读取
+        bool m_failed;
+};
+
+class Mp3StreamDecoder final : public StreamDecoder {
+    public:
+        explicit Mp3StreamDecoder(std::shared_ptr<const FileData> file) :
+                m_file(std::move(file)), m_open(false) {
+            std::memset(&m_mp3, 0, sizeof(m_mp3));
+        }
+
+        ~Mp3StreamDecoder() override {
+            if (m_open) {
+                mp3dec_ex_close(&m_mp3);
+            }
+        }
+
+        bool init() {
+            if (mp3dec_ex_open_buf(&m_mp3, m_file->data(), m_file->size(), MP3D_SEEK_TO_SAMPLE) != 0) {
+                return false;
+            }
+            m_open = true;
+            return m_mp3.info.channels > 0 && m_mp3.info.hz > 0;
+        }
+
+        int sampleRate() const override { return m_mp3.info.hz; }
+        int channels() const override { return m_mp3.info.channels; }
+        int64_t totalFrames() const override {
+            return static_cast<int64_t>(m_mp3.samples / m_mp3.info.channels);
+        }
+
+        int32_t read(float* output, const int32_t maxFrames) override {
+            const size_t samples = mp3dec_ex_read(&m_mp3, output,
+                                                  static_cast<size_t>(maxFrames) * m_mp3.info.channels);
+            return static_cast<int32_t>(samples / m_mp3.info.channels);
+        }
+
+        bool seek(const int64_t frame) override {
+            // minimp3的位置以样本计，即帧数乘以声道数
+            return mp3dec_ex_seek(&m_mp3, static_cast<uint64_t>(frame) * m_mp3.info.channels) == 0;
+        }
+
+    private:
+        std::shared_ptr<const FileData> m_file;
+        mp3dec_ex_t m_mp3;
+        bool m_open;
+};
+
+class FlacStreamDecoder final : public StreamDecoder {
+    public:
+        explicit FlacStreamDecoder(std::shared_ptr<const FileData> file) :
+                m_file(std::move(file)), m_decoder(nullptr), m_position(0), m_sampleRate(0),
+                m_channels(0), m_bitsPerSample(0), m_blockSize(0), m_totalFrames(0), m_pendingOffset(0),
+                m_seekTarget(-1), m_seekOvershoot(false) {}
+
+        ~FlacStreamDecoder() override {
+            if (m_decoder) {
+                FLAC__stream_decoder_finish(m_decoder);
+                FLAC__stream_decoder_delete(m_decoder);
+            }
+        }
+
+        bool init() {
+            m_decoder = FLAC__stream_decoder_new();
+            if (!m_decoder) {
+                return false;
+            }
+            if (FLAC__stream_decoder_init_stream(m_decoder, onRead, onSeek, onTell, onLength, onEof, onWrite,
+                                                 onMetadata, onError, this) != FLAC__STREAM_DECODER_INIT_STATUS_OK) {
+                return false;
+            }
+            if (!FLAC__stream_decoder_process_until_end_of_metadata(m_decoder)) {
+                return false;
+            }
+            m_seekIndex = buildFlacIndex(m_file->data(), m_file->size(), m_totalFrames, m_blockSize);
+            return m_channels > 0 && m_sampleRate > 0;
+        }
+
+        int sampleRate() const override { return m_sampleRate; }
+        int channels() const override { return m_channels; }
+        int64_t totalFrames() const override { return m_totalFrames; }
+
+        int32_t read(float* output, const int32_t maxFrames) override {
+            int32_t written = 0;
+            while (written < maxFrames) {
+                const int32_t pendingFrames = static_cast<int32_t>(m_pending.size() / m_channels) - m_pendingOffset;
+                if (pendingFrames > 0) {
+                    const int32_t frames = std::min(pendingFrames, maxFrames - written);
+                    std::memcpy(output + written * m_channels, m_pending.data() + m_pendingOffset * m_channels,
+                                sizeof(float) * frames * m_channels);
+                    m_pendingOffset += frames;
+                    written += frames;
+                    continue;
+                }
+
+                m_pending.clear();
+                m_pendingOffset = 0;
+                // 失步重同步、跳过元数据或坏帧时process_single成功却不产出音频，继续解下一帧，
+                // 只有真正到达结尾或出错才算读完，否则调用方会把0帧当作播完
+                while (m_pending.empty()) {
+                    const auto state = FLAC__stream_decoder_get_state(m_decoder);
+                    if (state == FLAC__STREAM_DECODER_END_OF_STREAM || state == FLAC__STREAM_DECODER_ABORTED ||
+                        !FLAC__stream_decoder_process_single(m_decoder)) {
+                        break;
+                    }
+                }
+                if (m_pending.empty()) {
+                    break;
+                }
+            }
+            return written;
+        }
+
+        bool seek(const int64_t frame) override {
+            m_pending.clear();
+            m_pendingOffset = 0;
+            if (seekFromIndex(frame)) {
+                return true;
+            }
+            if (FLAC__stream_decoder_seek_absolute(m_decoder, static_cast<FLAC__uint64>(frame))) {
+                return true;
+            }
+            // 跳转失败后解码器需要flush才能继续使用
+            if (FLAC__stream_decoder_get_state(m_decoder) == FLAC__STREAM_DECODER_SEEK_ERROR) {
+                FLAC__stream_decoder_flush(m_decoder);
+            }
+            return false;
+        }
+
+    private:
+        // 清空解码器输入后把读取位置移到索引点，libFLAC会在那里重新同步帧头
+        bool seekFromIndex(const int64_t frame) {
+            const SeekIndex::Point* point = m_seekIndex.find(frame);
+            if (!point || !FLAC__stream_decoder_flush(m_decoder)) {
+                return false;
+            }
+            m_position = point->offset;
+            m_seekTarget = frame;
+            m_seekOvershoot = false;
+            while (m_pending.empty() && !m_seekOvershoot) {
+                if (FLAC__stream_decoder_get_state(m_decoder) == FLAC__STREAM_DECODER_END_OF_STREAM ||
+                    !FLAC__stream_decoder_process_single(m_decoder)) {
+                    break;
+                }
+            }
+            m_seekTarget = -1;
+            if (m_pending.empty()) {
+                // 落点晚于目标或已到结尾，交给seek_absolute；它会重新定位，不受这里的读取位置影响
+                m_pendingOffset = 0;
+                return false;
+            }
+            return true;
+        }
+
+        static FLAC__StreamDecoderReadStatus onRead(const FLAC__StreamDecoder*, FLAC__byte buffer[], size_t* bytes,
+                                                    void* client) {
+            auto* self = static_cast<FlacStreamDecoder*>(client);
+            const size_t remaining = self->m_file->size() - self->m_position;
+            if (remaining == 0) {
+                *bytes = 0;
+                return FLAC__STREAM_DECODER_READ_STATUS_END_OF_STREAM;
+            }
+            *bytes = std::min(*bytes, remaining);
+            std::memcpy(buffer, self->m_file->data() + self->m_position, *bytes);
+            self->m_position += *bytes;
+            return FLAC__STREAM_DECODER_READ_STATUS_CONTINUE;
+        }
+
+        static FLAC__StreamDecoderSeekStatus onSeek(const FLAC__StreamDecoder*, const FLAC__uint64 offset,
+                                                    void* client) {
+            auto* self = static_cast<FlacStreamDecoder*>(client);
+            if (offset > self->m_file->size()) {
+                return FLAC__STREAM_DECODER_SEEK_STATUS_ERROR;
+            }
+            self->m_position = static_cast<size_t>(offset);
+            return FLAC__STREAM_DECODER_SEEK_STATUS_OK;
+        }
+
+        static FLAC__StreamDecoderTellStatus onTell(const FLAC__StreamDecoder*, FLAC__uint64* offset, void* client) {
+            *offset = static_cast<FlacStreamDecoder*>(client)->m_position;
+            return FLAC__STREAM_DECODER_TELL_STATUS_OK;
+        }
+
+        static FLAC__StreamDecoderLengthStatus onLength(const FLAC__StreamDecoder*, FLAC__uint64* length,
+                                                        void* client) {
+            *length = static_cast<FlacStreamDecoder*>(client)->m_file->size();
+            return FLAC__STREAM_DECODER_LENGTH_STATUS_OK;
+        }
+
+        static FLAC__bool onEof(const FLAC__StreamDecoder*, void* client) {
+            const auto* self = static_cast<FlacStreamDecoder*>(client);
+            return self->m_position >= self->m_file->size();
+        }
+
+        static FLAC__StreamDecoderWriteStatus onWrite(const FLAC__StreamDecoder*, const FLAC__Frame* frame,
+                                                      const FLAC__int32* const buffer[], void* client) {
+            auto* self = static_cast<FlacStreamDecoder*>(client);
+            const auto blockSize = static_cast<int32_t>(frame->header.blocksize);
+            if (self->m_seekTarget >= 0) {
+                // 按索引跳转后丢弃目标之前的帧；libFLAC已把固定块大小的帧号换算成首采样号
+                const auto first = static_cast<int64_t>(frame->header.number.sample_number);
+                if (first > self->m_seekTarget) {
+                    self->m_seekOvershoot = true;
+                    return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+                }
+                if (first + blockSize <= self->m_seekTarget) {
+                    return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+                }
+                self->m_pendingOffset = static_cast<int32_t>(self->m_seekTarget - first);
+                self->m_seekTarget = -1;
+            }
+            const float scale = 1.0f / static_cast<float>(1u << (self->m_bitsPerSample - 1));
+            const size_t base = self->m_pending.size();
+            self->m_pending.resize(base + static_cast<size_t>(blockSize) * self->m_channels);
+            float* out = self->m_pending.data() + base;
+            for (auto i = 0; i < blockSize; i++) {
+                for (auto c = 0; c < self->m_channels; c++) {
+                    *out++ = buffer[c][i] * scale;
+                }
+            }
+            return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+        }
+
+        static void onMetadata(const FLAC__StreamDecoder*, const FLAC__StreamMetadata* metadata, void* client) {
+            if (metadata->type != FLAC__METADATA_TYPE_STREAMINFO) {
+                return;
+            }
+            auto* self = static_cast<FlacStreamDecoder*>(client);
+            self->m_sampleRate = static_cast<int>(metadata->data.stream_info.sample_rate);
+            self->m_channels = static_cast<int>(metadata->data.stream_info.channels);
+            self->m_bitsPerSample = static_cast<int>(metadata->data.stream_info.bits_per_sample);
+            // 固定块大小的流里除最后一帧外都是最大块
+            self->m_blockSize = static_cast<int32_t>(metadata->data.stream_info.max_blocksize);
+            self->m_totalFrames = static_cast<int64_t>(metadata->data.stream_info.total_samples);
+        }
+
+        static void onError(const FLAC__StreamDecoder*, const FLAC__StreamDecoderErrorStatus status, void*) {
+            LOGW("FLAC decode error: %d", static_cast<int>(status));
+        }
+
+        std::shared_ptr<const FileData> m_file;
+        FLAC__StreamDecoder* m_decoder;
+        size_t m_position;
+        int m_sampleRate;
+        int m_channels;
+        int m_bitsPerSample;
+        int32_t m_blockSize;
+        int64_t m_totalFrames;
+        // 一个FLAC帧解出的数据可能多于一次read需要的量
+        std::vector<float> m_pending;
+        int32_t m_pendingOffset;
+        SeekIndex m_seekIndex;
+        // 跳转进行中的目标帧，-1表示没有
+        int64_t m_seekTarget;
+        bool m_seekOvershoot;
+};
+
+bool hasExtension(const std::string& path, const char* extension) {
+    const size_t length = std::strlen(extension);
+    if (path.size() < length) {
+        return false;
+    }
+    for (size_t i = 0; i < length; i++) {
+        const char c = path[path.size() - length + i];
+        if (static_cast<char>(c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c) != extension[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <typename Decoder>
+std::unique_ptr<StreamDecoder> tryOpen(std::shared_ptr<const FileData> file) {
+    auto decoder = std::make_unique<Decoder>(std::move(file));
+    if (!decoder->init()) {
+        return nullptr;
+    }
+    return decoder;
+}
+
+}
+
+std::unique_ptr<StreamDecoder> StreamDecoder::open(std::shared_ptr<const FileData> file, const std::string& path) {
+    if (!file || file->size() < 4) {
+        return nullptr;
+    }
+    const uint8_t* data = file->data();
+    const size_t size = file->size();
+
+    if (size >= 12 && std::memcmp(data, "RIFF", 4) == 0 && std::memcmp(data + 8, "WAVE", 4) == 0) {
+        return tryOpen<WavStreamDecoder>(std::move(file));
+    }
+    if (std::memcmp(data, "fLaC", 4) == 0) {
+        return tryOpen<FlacStreamDecoder>(std::move(file));
+    }
+    if (std::memcmp(data, "OggS", 4) == 0) {
+        // 第一页只有一个段，编码头紧跟在27字节页头和1字节段表之后
+        if (size >= 36 && std::memcmp(data + 28, "OpusHead", 8) == 0) {
+            return tryOpen<OpusStreamDecoder>(std::move(file));
+        }
+        return tryOpen<VorbisStreamDecoder>(std::move(file));
+    }
+    const bool mp3Sync = data[0] == 0xFF && (data[1] & 0xE0) == 0xE0;
+    if (std::memcmp(data, "ID3", 3) == 0 || mp3Sync || hasExtension(path, ".mp3")) {
+        return tryOpen<Mp3StreamDecoder>(std::move(file));
+    }
+    return nullptr;
+}
+
+namespace {
+
+FixedPool& streamBlockPool() {
+    static FixedPool pool(static_cast<size_t>(StreamSource::kBlockFrames) * StreamSource::kPooledChannels * sizeof(float),
+                          static_cast<size_t>(StreamSource::kBlockCount) * StreamSource::kPooledStreams);
+    return pool;
+}
+
+} // namespace
+
+void StreamSource::reservePool() {
+    streamBlockPool();
+}
+
+StreamSource::StreamSource(std::unique_ptr<StreamDecoder> decoder) :
+        m_decoder(std::move(decoder)),
+        m_channels(m_decoder->channels()),
+        m_blocks(kBlockCount),
+        m_generation(0),
+        m_currentBlock(-1),
+        m_currentOffset(0),
+        m_finished(false),
+        m_underruns(0),
+        m_requestedFrame(0),
+        m_requestedGeneration(0),
+        m_loop(false),
+        m_loopStart(0),
+        m_loopEnd(0),
+        m_producerGeneration(0),
+        m_producerFrame(0),
+        m_producerEnded(false) {
+    for (auto i = 0; i < kBlockCount; i++) {
+        if (!m_blocks[i].samples.allocate(streamBlockPool(), static_cast<size_t>(kBlockFrames) * m_channels)) {
+            throw std::bad_alloc();
+        }
+        m_freeBlocks.push(i);
+    }
+}
+
+int StreamSource::sampleRate() const {
+    return m_decoder->sampleRate();
+}
+
+int StreamSource::channels() const {
+    return m_channels;
+}
+
+int64_t StreamSource::totalFrames() const {
+    return m_decoder->totalFrames();
+}
+
+size_t StreamSource::residentBytes() const {
+    return static_cast<size_t>(kBlockCount) * kBlockFrames * m_channels * sizeof(float);
+}
+
+void StreamSource::requestSeek(const int64_t frame) {
+    recycleCurrent();
+    m_generation++;
+    m_finished = false;
+    m_requestedFrame.store(frame, std::memory_order_relaxed);
+    m_requestedGeneration.store(m_generation, std::memory_order_release);
+}
+
+void StreamSource::setLoop(const bool loop) {
+    m_loop.store(loop, std::memory_order_relaxed);
+}
+
+void StreamSource::setLoopRegion(const int64_t startFrame, const int64_t endFrame) {
+    m_loopStart.store(startFrame, std::memory_order_relaxed);
+    m_loopEnd.store(endFrame, std::memory_order_relaxed);
+}
+
+void StreamSource::recycleCurrent() {
+    if (m_currentBlock >= 0) {
+        m_freeBlocks.push(m_currentBlock);
+        m_currentBlock = -1;
+        m_currentOffset = 0;
+    }
+}
+
+const float* StreamSource::acquireFrames(const int32_t maxFrames, int32_t& frames, int64_t& startFrame) {
+    while (!m_finished) {
+        if (m_currentBlock < 0) {
+            int32_t index = -1;
+            if (!m_filledBlocks.pop(index)) {
+                m_underruns.fetch_add(1, std::memory_order_relaxed);
+                return nullptr;
+            }
+            if (m_blocks[index].generation != m_generation) {
+                // 跳转之前解出的旧数据，直接丢弃
+                m_freeBlocks.push(index);
+                continue;
+            }
+            m_currentBlock = index;
+            m_currentOffset = 0;
+        }
+
+        const Block& block = m_blocks[m_currentBlock];
+        if (m_currentOffset >= block.frames) {
+            m_finished = block.endOfStream;
+            recycleCurrent();
+            continue;
+        }
+
+        frames = std::min(maxFrames, block.frames - m_currentOffset);
+        startFrame = block.startFrame + m_currentOffset;
+        return block.samples.data() + static_cast<size_t>(m_currentOffset) * m_channels;
+    }
+    return nullptr;
+}
+
+void StreamSource::releaseFrames(const int32_t frames) {
+    m_currentOffset += frames;
+}
+
+bool StreamSource::isFinished() const {
+    return m_finished;
+}
+
+uint32_t StreamSource::getUnderrunCount() const {
+    return m_underruns.load(std::memory_order_relaxed);
+}
+
+bool StreamSource::fill(const int32_t maxBlocks) {
+    const uint32_t generation = m_requestedGeneration.load(std::memory_order_acquire);
+    if (generation != m_producerGeneration) {
+        const int64_t frame = m_requestedFrame.load(std::memory_order_relaxed);
+        if (!m_decoder->seek(frame)) {
+            // 解码器停在未知位置，接着读会把别处的数据标成目标帧，直接用一个结束块收尾；
+            // 暂时没有空闲块时下次填充再试
+            int32_t index = -1;
+            if (!m_freeBlocks.pop(index)) {
+                return false;
+            }
+            LOGW("Stream seek to frame %lld failed, ending stream", static_cast<long long>(frame));
+            Block& block = m_blocks[index];
+            block.generation = generation;
+            block.startFrame = frame;
+            block.frames = 0;
+            block.endOfStream = true;
+            m_producerGeneration = generation;
+            m_producerFrame = frame;
+            m_producerEnded = true;
+            m_filledBlocks.push(index);
+            return true;
+        }
+        m_producerGeneration = generation;
+        m_producerFrame = frame;
+        m_producerEnded = false;
+    }
+
+    bool worked = false;
+    for (auto n = 0; n < maxBlocks && !m_producerEnded; n++) {
+        int32_t index = -1;
+        if (!m_freeBlocks.pop(index)) {
+            break;
+        }
+
+        Block& block = m_blocks[index];
+        block.generation = generation;
+        block.startFrame = m_producerFrame;
+        block.endOfStream = false;
+
+        // 循环区间的结尾截断在块内，回绕点精确到帧；跳转到区间之后的位置时先播到结尾再回绕
+        const bool loop = m_loop.load(std::memory_order_relaxed);
+        const int64_t loopStart = m_loopStart.load(std::memory_order_relaxed);
+        const int64_t loopEnd = m_loopEnd.load(std::memory_order_relaxed);
+        const bool bounded = loop && loopEnd > 0;
+        int32_t readFrames = kBlockFrames;
+        if (bounded && m_producerFrame < loopEnd) {
+            readFrames = static_cast<int32_t>(std::min<int64_t>(kBlockFrames, loopEnd - m_producerFrame));
+        }
+        block.frames = bounded && m_producerFrame == loopEnd ? 0 : m_decoder->read(block.samples.data(), readFrames);
+
+        if (block.frames == 0) {
+            if (loop && m_producerFrame > loopStart && m_decoder->seek(loopStart)) {
+                // 循环：从区间起点继续解码，消费者看到起始帧变小即知道发生了回绕
+                m_producerFrame = loopStart;
+                block.startFrame = loopStart;
+                readFrames = bounded ? static_cast<int32_t>(std::min<int64_t>(kBlockFrames, loopEnd - loopStart))
+                                     : kBlockFrames;
+                block.frames = m_decoder->read(block.samples.data(), readFrames);
+            }
+            if (block.frames == 0) {
+                block.endOfStream = true;
+                m_producerEnded = true;
+            }
+        }
+        m_producerFrame += block.frames;
+        m_filledBlocks.push(index);
+        worked = true;
+    }
+    return worked;
+}
+
+StreamingService& StreamingService::instance() {
+    static StreamingService service;
+    return service;
+}
+
+StreamingService::StreamingService() : m_stopping(false) {
+    m_thread = std::thread(&StreamingService::threadLoop, this);
+}
+
+StreamingService::~StreamingService() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_condition.notify_all();
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+void StreamingService::add(std::shared_ptr<StreamSource> source) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_sources.push_back(std::move(source));
+    }
+    m_condition.notify_one();
+}
+
+void StreamingService::remove(const StreamSource* source) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_sources.erase(std::remove_if(m_sources.begin(), m_sources.end(),
+                                   [source](const std::shared_ptr<StreamSource>& s) { return s.get() == source; }),
+                    m_sources.end());
+}
+
+void StreamingService::threadLoop() {
+    std::vector<std::shared_ptr<StreamSource>> sources;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [this] { return m_stopping || !m_sources.empty(); });
+            if (m_stopping) {
+                return;
+            }
+            sources = m_sources;
+        }
+
+        // 每轮每个音轨最多解几块，避免一条长跳转饿死其它音轨
+        bool worked = false;
+        for (const auto& source : sources) {
+            worked |= source->fill(kBlocksPerPass);
+        }
+        sources.clear();
+
+        if (!worked) {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait_for(lock, std::chrono::milliseconds(kPollIntervalMs),
+                                 [this] { return m_stopping; });
+        }
+    }
+}
+
+std::shared_ptr<StreamSource> openStreamSource(const std::string& filePath) {
+    auto file = openFileData(filePath);
+    if (!file) {
+        return nullptr;
+    }
+    auto decoder = StreamDecoder::open(std::move(file), filePath);
+    if (!decoder || decoder->channels() <= 0) {
+        LOGW("Streaming decode is not supported for: %s", filePath.c_str());
+        return nullptr;
+    }
+
+    auto source = std::make_shared<StreamSource>(std::move(decoder));
+    LOGI("Opened stream: %s, SR: %d, Channels: %d, Frames: %lld",
+         filePath.c_str(), source->sampleRate(), source->channels(),
+         static_cast<long long>(source->totalFrames()));
+    return source;
+}
@@ -0,0 +1,155 @@
+/*
+ * blophy-stream.h - Oboe Wrapper for C#
+ * Copyright (C) 2025  MojaveHao
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "blophy-arena.h"
+#include "blophy-clip.h"
+#include "blophy-common.h"
+#include "blophy-queue.h"
+
+// 增量解码器，直接读取内存中的编码数据，每次只产出一小段交错float PCM
+class StreamDecoder {
+    public:
+        virtual ~StreamDecoder() = default;
+
+        virtual int sampleRate() const = 0;
+        virtual int channels() const = 0;
+        virtual int64_t totalFrames() const = 0;
+
+        // 解码最多maxFrames帧到output，返回实际帧数，0表示已到结尾
+        virtual int32_t read(float* output, int32_t maxFrames) = 0;
+        virtual bool seek(int64_t frame) = 0;
+
+        // 按文件头识别格式，支持WAV、Ogg Vorbis、Opus、FLAC和MP3，无法识别时返回nullptr
+        static std::unique_ptr<StreamDecoder> open(std::shared_ptr<const FileData> file, const std::string& path);
+};
+
+// 一个正在流式播放的音轨，每个声部各自持有
+// 解码线程把数据写入预分配的块，音频线程按顺序消费，两边通过两条无锁队列交换块
+// 块从引擎初始化时预分配好的共享池中借用，池用完或声道数超过kPooledChannels时才走堆分配
+class StreamSource {
+    public:
+        static constexpr int32_t kBlockFrames = 2048;
+        static constexpr int32_t kBlockCount = 8;
+        // 共享块池按这么多条立体声音轨预留
+        static constexpr int32_t kPooledStreams = 8;
+        static constexpr int32_t kPooledChannels = 2;
+
+        // 预分配并预先写入共享块池，引擎初始化时调用；重复调用无副作用
+        static void reservePool();
+
+        explicit StreamSource(std::unique_ptr<StreamDecoder> decoder);
+
+        StreamSource(const StreamSource&) = delete;
+        StreamSource& operator=(const StreamSource&) = delete;
+
+        int sampleRate() const;
+        int channels() const;
+        int64_t totalFrames() const;
+        size_t residentBytes() const;
+
+        // 以下只能由声部的命令消费者（通常是音频线程）调用
+        void requestSeek(int64_t frame);
+        void setLoop(bool loop);
+        // 循环时解到endFrame（不大于0表示结尾）就跳回startFrame；已解出的块不受影响
+        void setLoopRegion(int64_t startFrame, int64_t endFrame);
+        // 取出当前可读的一段数据，返回nullptr表示欠载或已播完
+        const float* acquireFrames(int32_t maxFrames, int32_t& frames, int64_t& startFrame);
+        void releaseFrames(int32_t frames);
+        bool isFinished() const;
+        uint32_t getUnderrunCount() const;
+
+        // 解码线程调用，返回是否做了任何工作
+        bool fill(int32_t maxBlocks);
+
+    private:
+        struct Block {
+            uint32_t generation;
+            int64_t startFrame;
+            int32_t frames;
+            bool endOfStream;
+            PooledSamples samples;
+        };
+
+        void recycleCurrent();
+
+        std::unique_ptr<StreamDecoder> m_decoder;
+        const int m_channels;
+        std::vector<Block> m_blocks;
+        SpscQueue<int32_t, kBlockCount> m_freeBlocks;
+        SpscQueue<int32_t, kBlockCount> m_filledBlocks;
+
+        // 消费者一侧
+        uint32_t m_generation;
+        int32_t m_currentBlock;
+        int32_t m_currentOffset;
+        bool m_finished;
+        std::atomic<uint32_t> m_underruns;
+
+        // 消费者发布、生产者读取的请求
+        std::atomic<int64_t> m_requestedFrame;
+        std::atomic<uint32_t> m_requestedGeneration;
+        std::atomic<bool> m_loop;
+        std::atomic<int64_t> m_loopStart;
+        std::atomic<int64_t> m_loopEnd;
+
+        // 生产者一侧
+        uint32_t m_producerGeneration;
+        int64_t m_producerFrame;
+        bool m_producerEnded;
+};
+
+// 所有流式音轨共用的后台解码线程
+class StreamingService {
+    public:
+        static StreamingService& instance();
+
+        StreamingService(const StreamingService&) = delete;
+        StreamingService& operator=(const StreamingService&) = delete;
+
+        void add(std::shared_ptr<StreamSource> source);
+        void remove(const StreamSource* source);
+
+    private:
+        // 空闲时的轮询间隔，决定跳转后最慢多久开始重新解码
+        static constexpr int kPollIntervalMs = 4;
+        static constexpr int32_t kBlocksPerPass = 2;
+
+        StreamingService();
+        ~StreamingService();
+
+        void threadLoop();
+
+        std::mutex m_mutex;
+        std::condition_variable m_condition;
+        std::vector<std::shared_ptr<StreamSource>> m_sources;
+        std::thread m_thread;
+        bool m_stopping;
+};
+
+// 打开文件并创建流式音轨，格式不支持流式解码时返回nullptr
+std::shared_ptr<StreamSource> openStreamSource(const std::string& filePath);
@@ -0,0 +1,174 @@
+/*
+ * blophy-stretch.cpp - Oboe Wrapper for C#
+ * Copyright (C) 2025  MojaveHao
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "blophy-stretch.h"
+#include "blophy-kernels.h"
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+// 音乐素材上比较稳妥的参数：40ms序列、8ms交叉淡化、15ms搜索窗口
+constexpr int32_t kSequenceMs = 40;
+constexpr int32_t kOverlapMs = 8;
+constexpr int32_t kSeekMs = 15;
+// 先按这个步长粗搜，再在最佳点附近逐帧细搜
+constexpr int32_t kCoarseStep = 4;
+
+int32_t msToFrames(const int32_t ms, const int32_t sampleRate) {
+    return std::max(1, static_cast<int32_t>(static_cast<int64_t>(sampleRate) * ms / 1000));
+}
+
+} // namespace
+
+TimeStretcher::TimeStretcher(const int32_t channels, const int32_t sampleRate, const float tempo) :
+        m_channels(channels),
+        m_sampleRate(sampleRate),
+        m_sequenceFrames(msToFrames(kSequenceMs, sampleRate)),
+        m_overlapFrames(msToFrames(kOverlapMs, sampleRate)),
+        m_seekFrames(msToFrames(kSeekMs, sampleRate)),
+        m_requiredFrames(std::max(m_seekFrames + m_sequenceFrames,
+                                  static_cast<int32_t>(std::ceil(kMaxTempo * (m_sequenceFrames - m_overlapFrames))) + 1)),
+        m_tempo(1.0f),
+        m_input(static_cast<size_t>(m_requiredFrames) * channels),
+        m_inputSource(m_requiredFrames),
+        m_inputFrames(0),
+        m_tail(static_cast<size_t>(m_overlapFrames) * channels),
+        m_primed(false),
+        m_skipRemainder(0.0),
+        m_output(static_cast<size_t>(m_sequenceFrames) * channels),
+        m_outputSource(m_sequenceFrames),
+        m_outputFrames(0),
+        m_outputOffset(0),
+        m_finishing(false),
+        m_lastSegment(false) {
+    setTempo(tempo);
+}
+
+void TimeStretcher::setTempo(const float tempo) {
+    m_tempo = std::max(kMinTempo, std::min(tempo, kMaxTempo));
+}
+
+void TimeStretcher::reset() {
+    m_inputFrames = 0;
+    m_primed = false;
+    m_skipRemainder = 0.0;
+    m_outputFrames = 0;
+    m_outputOffset = 0;
+    m_finishing = false;
+    m_lastSegment = false;
+}
+
+void TimeStretcher::finish() {
+    m_finishing = true;
+}
+
+int64_t TimeStretcher::sourceFrame() const {
+    if (m_outputOffset < m_outputFrames) {
+        return m_outputSource[m_outputOffset];
+    }
+    if (m_outputFrames > 0) {
+        return m_outputSource[m_outputFrames - 1] + 1;
+    }
+    return -1;
+}
+
+float TimeStretcher::similarity(const int32_t offset) const {
+    float dot = 0.0f;
+    float energy = 0.0f;
+    correlate(m_tail.data(), m_input.data() + static_cast<size_t>(offset) * m_channels, m_overlapFrames * m_channels,
+              dot, energy);
+    // 只按候选段的能量归一化，上一段尾部的能量对所有候选都相同
+    return dot / std::sqrt(energy + 1e-9f);
+}
+
+int32_t TimeStretcher::bestOffset() const {
+    int32_t best = 0;
+    float bestScore = similarity(0);
+    for (auto offset = kCoarseStep; offset <= m_seekFrames; offset += kCoarseStep) {
+        const float score = similarity(offset);
+        if (score > bestScore) {
+            bestScore = score;
+            best = offset;
+        }
+    }
+    const int32_t coarse = best;
+    const int32_t first = std::max(0, coarse - kCoarseStep + 1);
+    const int32_t last = std::min(m_seekFrames, coarse + kCoarseStep - 1);
+    for (auto offset = first; offset <= last; offset++) {
+        if (offset == coarse) {
+            continue;
+        }
+        const float score = similarity(offset);
+        if (score > bestScore) {
+            bestScore = score;
+            best = offset;
+        }
+    }
+    return best;
+}
+
+void TimeStretcher::produce() {
+    const int32_t channels = m_channels;
+    const int32_t offset = m_primed ? bestOffset() : center();
+    const float* segment = m_input.data() + static_cast<size_t>(offset) * channels;
+    float* output = m_output.data();
+
+    // 开头与上一段的尾部线性交叉淡化，第一段没有可拼接的尾部直接复制
+    if (m_primed) {
+        const float step = 1.0f / static_cast<float>(m_overlapFrames);
+        for (auto i = 0; i < m_overlapFrames; i++) {
+            const float weight = static_cast<float>(i) * step;
+            for (auto c = 0; c < channels; c++) {
+                const size_t index = static_cast<size_t>(i) * channels + c;
+                output[index] = m_tail[index] + (segment[index] - m_tail[index]) * weight;
+            }
+        }
+    } else {
+        std::copy_n(segment, m_overlapFrames * channels, output);
+    }
+    const int32_t bodyFrames = m_sequenceFrames - 2 * m_overlapFrames;
+    std::copy_n(segment + static_cast<size_t>(m_overlapFrames) * channels, bodyFrames * channels,
+                output + static_cast<size_t>(m_overlapFrames) * channels);
+    std::copy_n(segment + static_cast<size_t>(m_sequenceFrames - m_overlapFrames) * channels,
+                m_overlapFrames * channels, m_tail.data());
+
+    m_outputFrames = m_sequenceFrames - m_overlapFrames;
+    m_outputOffset = 0;
+    // 播放头取按速度推进的名义位置，不随每段选中的偏移抖动
+    for (auto i = 0; i < m_outputFrames; i++) {
+        const auto index = std::min(m_inputFrames - 1, center() + static_cast<int32_t>(static_cast<float>(i) * m_tempo));
+        if (m_inputSource[index] == kEndPadding) {
+            // 名义位置走进了结尾补的静音，源数据已经全部输出
+            m_outputFrames = i;
+            m_lastSegment = true;
+            break;
+        }
+        m_outputSource[i] = m_inputSource[index];
+    }
+
+    m_skipRemainder += static_cast<double>(m_tempo) * m_outputFrames;
+    const auto skip = std::min(static_cast<int32_t>(m_skipRemainder), m_inputFrames);
+    m_skipRemainder -= skip;
+    const int32_t remaining = m_inputFrames - skip;
+    std::memmove(m_input.data(), m_input.data() + static_cast<size_t>(skip) * channels,
+                 sizeof(float) * remaining * channels);
+    std::memmove(m_inputSource.data(), m_inputSource.data() + skip, sizeof(int64_t) * remaining);
+    m_inputFrames = remaining;
+    m_primed = true;
+}
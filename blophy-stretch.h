@@ -0,0 +1,139 @@
+/*
+ * blophy-stretch.h - Oboe Wrapper for C#
+ * Copyright (C) 2025  MojaveHao
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// WSOLA时间伸缩：改变速度而不改变音高，工作在片段采样率上，输出再交给重采样器
+// 每次从输入中取一段序列，在搜索窗口内找与上一段尾部最相似的位置做交叉淡化拼接，
+// 然后按速度推进输入；缓冲在构造时分配，process只在音频线程调用，不分配内存
+class TimeStretcher {
+    public:
+        static constexpr int32_t kMaxChannels = 8;
+        static constexpr float kMinTempo = 0.5f;
+        static constexpr float kMaxTempo = 2.0f;
+
+        TimeStretcher(int32_t channels, int32_t sampleRate, float tempo);
+
+        TimeStretcher(const TimeStretcher&) = delete;
+        TimeStretcher& operator=(const TimeStretcher&) = delete;
+
+        int32_t channels() const { return m_channels; }
+        int32_t sampleRate() const { return m_sampleRate; }
+        void setTempo(float tempo);
+        float tempo() const { return m_tempo; }
+
+        // 丢弃所有缓冲，下一次process从新的读取位置开始
+        void reset();
+        // 源数据已经读完（由pull在返回false之前调用）：之后缺少的输入以静音补齐，
+        // 把缓冲中剩下的源数据全部输出，输出完后drained()为true，process不再产出
+        void finish();
+        bool drained() const { return m_lastSegment && m_outputOffset >= m_outputFrames; }
+        // 下一个输出帧对应的源帧（按速度换算的名义位置），还没有输出时返回-1
+        int64_t sourceFrame() const;
+
+        // 产出最多numFrames帧到output（交错，覆盖写入）
+        // pull(int64_t& frame, float* samples)取出下一帧源数据并给出它在片段中的帧号，没有数据时返回false
+        // 返回产出的帧数，不足numFrames说明源数据欠载或已播完（此时drained()为true）
+        template <typename Pull>
+        int32_t process(float* output, const int32_t numFrames, Pull&& pull) {
+            int32_t done = 0;
+            while (done < numFrames) {
+                if (m_outputOffset >= m_outputFrames) {
+                    if (m_lastSegment || !fillInput(pull)) {
+                        break;
+                    }
+                    produce();
+                }
+                const int32_t frames = std::min(numFrames - done, m_outputFrames - m_outputOffset);
+                std::copy_n(m_output.data() + static_cast<size_t>(m_outputOffset) * m_channels, frames * m_channels,
+                            output + static_cast<size_t>(done) * m_channels);
+                m_outputOffset += frames;
+                done += frames;
+            }
+            return done;
+        }
+
+    private:
+        template <typename Pull>
+        bool fillInput(Pull& pull) {
+            if (!m_primed && m_inputFrames == 0) {
+                // 搜索窗口以名义位置为中心，第一段前面垫上半个窗口的静音，让第一段正好从名义位置开始
+                std::fill_n(m_input.data(), static_cast<size_t>(center()) * m_channels, 0.0f);
+                std::fill_n(m_inputSource.data(), center(), -1);
+                m_inputFrames = center();
+            }
+            while (m_inputFrames < m_requiredFrames) {
+                int64_t frame = 0;
+                float* samples = m_input.data() + static_cast<size_t>(m_inputFrames) * m_channels;
+                if (m_finishing || !pull(frame, samples)) {
+                    // 没有调用finish说明只是欠载，等下次再取
+                    if (!m_finishing) {
+                        return false;
+                    }
+                    std::fill_n(samples, m_channels, 0.0f);
+                    frame = kEndPadding;
+                }
+                m_inputSource[m_inputFrames++] = frame;
+            }
+            return true;
+        }
+
+        // 用缓冲中的输入拼出下一段输出并推进输入
+        void produce();
+        // 在搜索窗口内找与上一段尾部最相似的起点
+        int32_t bestOffset() const;
+        float similarity(int32_t offset) const;
+        // 名义位置在搜索窗口中的偏移
+        int32_t center() const { return m_seekFrames / 2; }
+
+        // 源读完后补在结尾的静音帧在m_inputSource中的标记，开头垫的静音用-1
+        static constexpr int64_t kEndPadding = -2;
+
+        const int32_t m_channels;
+        const int32_t m_sampleRate;
+        // 每段序列长度、交叉淡化长度和搜索窗口，均以帧计
+        const int32_t m_sequenceFrames;
+        const int32_t m_overlapFrames;
+        const int32_t m_seekFrames;
+        // 产出一段前输入至少要有这么多帧
+        const int32_t m_requiredFrames;
+        float m_tempo;
+
+        std::vector<float> m_input;
+        // 每个输入帧在片段中的帧号，循环回绕后依然准确
+        std::vector<int64_t> m_inputSource;
+        int32_t m_inputFrames;
+        // 上一段末尾留给下一段交叉淡化的部分
+        std::vector<float> m_tail;
+        bool m_primed;
+        // 输入推进量的小数部分
+        double m_skipRemainder;
+
+        std::vector<float> m_output;
+        std::vector<int64_t> m_outputSource;
+        int32_t m_outputFrames;
+        int32_t m_outputOffset;
+
+        bool m_finishing;
+        // 已产出包含源数据结尾的最后一段
+        bool m_lastSegment;
+};